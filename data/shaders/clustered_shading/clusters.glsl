@@ -0,0 +1,23 @@
+#ifndef CLUSTERS
+#define CLUSTERS
+
+// CLUSTER_PIXEL_SIZE and CLUSTER_DEPTH_SLICES, generated from PipelineConfiguration
+#include </data/shaders/pipeline_configuration.glsl>
+
+// the first slice spans the depth range of this many logarithmic slices
+const int numSlicesIntoFirstSlice = 3;
+
+// slices per doubling of the view space depth, the last slice ends at zFar
+float depthSliceScale(float zFar)
+{
+    return (CLUSTER_DEPTH_SLICES + numSlicesIntoFirstSlice) / log2(zFar);
+}
+
+// linearDepth is in [-nearZ:-farZ], see reprojection.glsl
+int clusterDepthSlice(float linearDepth, float zFar)
+{
+    int slice = int(max(log2(-linearDepth) * depthSliceScale(zFar) - numSlicesIntoFirstSlice, 0));
+    return min(slice, CLUSTER_DEPTH_SLICES - 1);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef FRAME_CONSTANTS
+#define FRAME_CONSTANTS
+
+// the camera of the current frame, written once per frame by FrameConstants.cpp, has to match its layout
+layout (std140, binding = 2) uniform frameConstants_
+{
+    mat4 viewMatrix;
+    mat4 viewInvertedMatrix;
+    mat4 projectionMatrix;
+    mat4 projectionInverseMatrix;
+    mat4 viewProjectionMatrix;
+    mat4 viewProjectionInvertedMatrix;
+    mat3 normalMatrix;
+    vec3 cameraEye;
+    float zNear;
+    ivec2 viewport;
+    vec2 screenSize;
+    float zFar;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef GBUFFER_PACKING
+#define GBUFFER_PACKING
+
+#include </data/shaders/common/vertex_packing.glsl>
+
+// the compact G-buffer of the camera pass, see RasterizationStage:
+// diffuse (RGBA8):  rgb diffuse color, a specular intensity, both sRGB encoded
+// normals (RGBA16): xy face normal, zw shading normal, both octahedral mapped to [0:1]
+// the background keeps the cleared normals of zero, which unpack to a zero vector instead of a surface normal
+
+// projects onto the octahedron and unfolds its lower half, unpackNormal is the inverse
+vec2 packNormal(vec3 normal)
+{
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    if (normal.z < 0.0)
+        normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+
+    return normal.xy;
+}
+
+// zero is reserved for the background. it is a corner of the unfolded octahedron that only normals within a
+// quantization step of (0,0,-1) could round to, the clamp moves those and other edge values by at most one step
+vec4 packNormals(vec3 faceNormal, vec3 normal)
+{
+    return max(vec4(packNormal(faceNormal), packNormal(normal)) * 0.5 + 0.5, vec4(1.0 / 65535.0));
+}
+
+vec3 unpackGBufferNormal(vec2 packedNormal)
+{
+    return packedNormal == vec2(0.0) ? vec3(0.0) : unpackNormal(packedNormal * 2.0 - 1.0);
+}
+
+vec3 unpackFaceNormal(vec4 normals)
+{
+    return unpackGBufferNormal(normals.xy);
+}
+
+vec3 unpackShadingNormal(vec4 normals)
+{
+    return unpackGBufferNormal(normals.zw);
+}
+
+// the specular maps of the scenes are grayscale, their luminance is all the lighting needs
+float packSpecular(vec3 specular)
+{
+    return dot(specular, vec3(0.2126, 0.7152, 0.0722));
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MATERIAL_TABLE
+#define MATERIAL_TABLE
+
+// indices and bit positions are the TextureType values
+#define DIFFUSE_TEXTURE 0
+#define SPECULAR_TEXTURE 1
+#define EMISSIVE_TEXTURE 2
+#define BUMP_TEXTURE 3
+#define OPACITY_TEXTURE 4
+
+// has to match MaterialTable::MaterialParameters
+struct MaterialParameters
+{
+    float shininess;
+    uint textureFlags;
+    // a bindless texture handle, or the texture array index and layer
+    uvec2 textures[5];
+    // the feedback index of each texture, TextureStreaming::NotStreamed for the others
+    uint streamedTextures[5];
+};
+
+layout (std430, binding = 0) readonly buffer materialBuffer_
+{
+    MaterialParameters materials[];
+};
+
+bool hasTexture(MaterialParameters material, int type)
+{
+    return (material.textureFlags & (1u << type)) != 0u;
+}
+
+#endif
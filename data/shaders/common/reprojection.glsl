@@ -35,4 +35,19 @@ float linearDepth(sampler2D depthSampler, vec2 uv, mat4 projectionMatrix)
     return linearDepth(depthSample, projectionMatrix);
 }
 
+// the world space position of a depth buffer sample, uv in [0:1]
+vec3 worldCoordinate(float depthSample, vec2 uv, mat4 viewProjectionInvertedMatrix)
+{
+    vec4 ndc = vec4(uv, depthSample, 1.0) * 2.0 - 1.0;
+    vec4 worldCoord = viewProjectionInvertedMatrix * ndc;
+    return worldCoord.xyz / worldCoord.w;
+}
+
+// xy is the uv of a world space position in another view, z its linear depth there, positive in front of the camera
+vec3 reproject(vec3 worldCoord, mat4 viewProjectionMatrix)
+{
+    vec4 clipCoord = viewProjectionMatrix * vec4(worldCoord, 1.0);
+    return vec3(clipCoord.xy / clipCoord.w * 0.5 + 0.5, clipCoord.w);
+}
+
 #endif
@@ -33,6 +33,14 @@ float shadowmapComparisonVSM(sampler2D shadowmap, vec2 scoord, vec3 worldPos, ve
     return VSM(moments, dist);
 }
 
+float shadowmapComparison(sampler2D shadowmap, vec2 scoord, vec3 worldPos, vec3 worldLightPos, float bias)
+{
+    vec3 lightDirection = worldPos - worldLightPos;
+    float dist = length(lightDirection);
+    float comp = texture(shadowmap, scoord).r;
+    return float(dist - bias < comp);
+}
+
 float omnishadowmapComparison(samplerCube shadowmap, vec3 worldPos, vec3 worldLightPos)
 {
     vec3 lightDirection = worldPos - worldLightPos;
@@ -0,0 +1,17 @@
+#ifndef TILE_MASK
+#define TILE_MASK
+
+// size of the convergence tiles, must match the work group size of accumulation.comp
+const int convergenceTileSize = 16;
+
+// tiles whose accumulated error is at or below the threshold have converged and don't need
+// another sample. a negative threshold marks every tile as active.
+bool tileActive(sampler2D tileErrorSampler, ivec2 fragCoord, float tileErrorThreshold)
+{
+    if (tileErrorThreshold < 0.0)
+        return true;
+
+    return texelFetch(tileErrorSampler, fragCoord / convergenceTileSize, 0).r > tileErrorThreshold;
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef VERTEX_PACKING
+#define VERTEX_PACKING
+
+
+// the scene geometry stores positions normalized to the bounds of each mesh
+vec3 unpackPosition(vec3 normalizedPosition, vec3 boundsMin, vec3 boundsExtent)
+{
+    return boundsMin + normalizedPosition * boundsExtent;
+}
+
+// octahedral mapping, the inverse of the encoding in SceneGeometry.cpp
+vec3 unpackNormal(vec2 octahedral)
+{
+    vec3 normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+    if (normal.z < 0.0)
+        normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+
+    return normalize(normal);
+}
+
+#endif
@@ -1,9 +1,13 @@
 #version 330
 
 #extension GL_ARB_shading_language_include : require
+#extension GL_ARB_shading_language_420pack : require
 #include </data/shaders/common/shadowmapping.glsl>
 #include </data/shaders/common/reprojection.glsl>
 #include </data/shaders/common/srgb_utils.glsl>
+#include </data/shaders/common/tile_mask.glsl>
+#include </data/shaders/common/frame_constants.glsl>
+#include </data/shaders/common/gbuffer_packing.glsl>
 
 in vec2 v_uv;
 in vec3 v_viewRay;
@@ -11,44 +15,32 @@ in vec3 v_viewRay;
 out vec3 outColor;
 
 uniform sampler2D diffuseSampler;
-uniform sampler2D specularSampler;
-uniform sampler2D faceNormalSampler;
 uniform sampler2D normalSampler;
 uniform sampler2D depthSampler;
 uniform sampler2D shadowmap;
 uniform sampler2D giSampler;
 uniform sampler2D occlusionSampler;
+uniform sampler2D tileErrorSampler;
 
-uniform mat4 projectionMatrix;
-uniform mat4 projectionInverseMatrix;
 uniform mat4 biasedLightViewProjectionMatrix;
-uniform vec3 cameraEye;
-uniform mat4 viewMatrix;
-uniform mat4 viewInvertedMatrix;
-uniform float zFar;
-uniform float zNear;
-uniform vec2 screenSize;
 
 uniform vec3 worldLightPos;
 uniform vec3 lightDirection;
 uniform vec3 normalizedInverseLightDirection;
 uniform float lightIntensity;
-uniform float exposure;
-
-
-vec3 tonemap(vec3 color)
-{
-    color *= exposure;
-    color /= 1 + color; // that's the reinhard operator
-    return color;
-}
+uniform bool areaLightShadows;
+uniform float tileErrorThreshold;
 
 
 void main()
 {
+    // converged pixels are not accumulated anymore
+    if (!tileActive(tileErrorSampler, ivec2(gl_FragCoord.xy), tileErrorThreshold))
+        discard;
+
     float d = linearDepth(depthSampler, v_uv, projectionMatrix);
 
-    vec3 N = texture(normalSampler, v_uv, 0).xyz * 2.0 - 1.0;
+    vec3 N = unpackShadingNormal(texture(normalSampler, v_uv, 0));
 
     vec3 viewCoord = d * v_viewRay;
     vec3 worldCoord = (viewInvertedMatrix * vec4(viewCoord, 1.0)).xyz;
@@ -62,12 +54,17 @@ void main()
     vec4 scoord = biasedLightViewProjectionMatrix * vec4(worldCoord, 1.0);
 
 
-    float shadowFactor = shadowmapComparisonVSM(shadowmap, scoord.xy/scoord.w, worldCoord, worldLightPos);
+    // the penumbra of the area light is integrated by accumulating hard shadows of jittered light positions
+    const float shadowBias = 0.02;
+    float shadowFactor = areaLightShadows
+        ? shadowmapComparison(shadowmap, scoord.xy/scoord.w, worldCoord, worldLightPos, shadowBias)
+        : shadowmapComparisonVSM(shadowmap, scoord.xy/scoord.w, worldCoord, worldLightPos);
     shadowFactor *= step(0.0, sign(scoord.w));
 
 
-    vec3 diffuseColor = toLinear(texture(diffuseSampler, v_uv, 0).xyz);
-    vec3 specularColor = toLinear(texture(specularSampler, v_uv, 0).xyz);
+    vec4 diffuseSpecular = texture(diffuseSampler, v_uv, 0);
+    vec3 diffuseColor = toLinear(diffuseSpecular.rgb);
+    vec3 specularColor = vec3(toLinear(diffuseSpecular.a));
     vec3 giColor = texture(giSampler, v_uv, 0).xyz;
     float occlusionFactor = texture(occlusionSampler, v_uv, 0).x;
     vec3 ambientTerm = giColor * diffuseColor * occlusionFactor;
@@ -75,7 +72,6 @@ void main()
     const float specularFactor = 0.75;
     vec3 specularTerm = specularFactor * specularColor * pow(max(0.0, ndotH), 20.0) * shadowFactor;
 
+    // linear HDR, tonemapping happens after accumulation
     outColor = ambientTerm + diffuseTerm + specularTerm;
-    outColor = tonemap(outColor);
-    outColor = toSRGB(outColor);
 }
@@ -1,7 +1,8 @@
 #version 140
 #extension GL_ARB_explicit_attrib_location : require
-
-uniform mat4 projectionInverseMatrix;
+#extension GL_ARB_shading_language_420pack : require
+#extension GL_ARB_shading_language_include : require
+#include </data/shaders/common/frame_constants.glsl>
 
 out vec2 v_uv;
 out vec3 v_viewRay;
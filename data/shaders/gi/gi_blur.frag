@@ -2,6 +2,9 @@
 
 #extension GL_ARB_shading_language_include : require
 #include </data/shaders/common/reprojection.glsl>
+#include </data/shaders/common/tile_mask.glsl>
+#include </data/shaders/common/frame_constants.glsl>
+#include </data/shaders/common/gbuffer_packing.glsl>
 
 in vec2 v_uv;
 in vec3 v_viewRay;
@@ -9,11 +12,11 @@ in vec3 v_viewRay;
 out vec3 outColor;
 
 uniform sampler2D giSampler;
-uniform sampler2D faceNormalSampler;
+uniform sampler2D normalSampler;
 uniform sampler2D depthSampler;
+uniform sampler2D tileErrorSampler;
 
-uniform mat4 projectionMatrix;
-uniform mat4 projectionInverseMatrix;
+uniform float tileErrorThreshold;
 
 // global replacement
 #define DIRECTION ivec2(0,0)
@@ -38,7 +41,7 @@ void processSample(int i, ivec2 center, ivec2 offset, vec3 centerNormal, float c
 {
     ivec2 texcoord = center + offset;
     vec3 giSample = texelFetch(giSampler, texcoord, 0).xyz;
-    vec3 normalSample = texelFetch(faceNormalSampler, texcoord, 0).xyz * 2.0 - 1.0;
+    vec3 normalSample = unpackFaceNormal(texelFetch(normalSampler, texcoord, 0));
     float depthSample = linearDepth(depthSampler, texcoord, projectionMatrix);
 
     float normalFactor = 1 - max(0, dot((centerNormal), normalSample));
@@ -50,13 +53,16 @@ void processSample(int i, ivec2 center, ivec2 offset, vec3 centerNormal, float c
 
 void main()
 {
+    ivec2 center = ivec2(gl_FragCoord.xy);
+    if (!tileActive(tileErrorSampler, center, tileErrorThreshold))
+        discard;
+
     vec3 acc = vec3(0.0);
     float factorAcc = 0.0;
 
     // center sample
-    ivec2 center = ivec2(gl_FragCoord.xy);
     float d = linearDepth(depthSampler, v_uv, projectionMatrix);
-    vec3 N = texture(faceNormalSampler, v_uv, 0).xyz * 2.0 - 1.0;
+    vec3 N = unpackFaceNormal(texture(normalSampler, v_uv, 0));
     acc += texelFetch(giSampler, center, 0).xyz;
     factorAcc += 1.0;
 
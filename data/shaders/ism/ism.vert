@@ -1,15 +1,24 @@
 #version 420
+#extension GL_ARB_shading_language_include : require
 
+#include </data/shaders/common/vertex_packing.glsl>
+
+// quantized in the scene geometry, plain floats for other drawables
 layout(location = 0) in vec3 a_vertex;
 layout(location = 1) in vec3 a_normal;
+layout(location = 4) in vec3 a_boundsMin;
+layout(location = 5) in vec3 a_boundsExtent;
 
 out vec3 v_normal;
 
+uniform bool quantizedVertices;
+
 void main()
 {
-    vec4 vertex = vec4(a_vertex, 1.0);
+    vec3 position = quantizedVertices ? unpackPosition(a_vertex, a_boundsMin, a_boundsExtent) : a_vertex;
+    vec4 vertex = vec4(position, 1.0);
 
-    v_normal = a_normal;
+    v_normal = quantizedVertices ? unpackNormal(a_normal.xy) : a_normal;
 
     gl_Position = vertex;
 }
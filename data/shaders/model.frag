@@ -1,8 +1,17 @@
-#version 330
+#version 430
 #extension GL_ARB_shading_language_include : require
 
+#define BINDLESS_TEXTURES
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+// samplers from non-dynamically uniform handles, see MaterialTable::bindlessSupported()
+#extension GL_NV_gpu_shader5 : require
+#endif
+
 #include </data/shaders/common/shadowmapping.glsl>
 #include </data/shaders/common/random.glsl>
+#include </data/shaders/common/gbuffer_packing.glsl>
+#include </data/shaders/common/material_table.glsl>
 
 #define RENDER_RSM
 
@@ -10,31 +19,24 @@ in vec3 v_normal;
 in vec3 v_worldCoord;
 in vec3 v_uv;
 in vec4 v_s;
+flat in uint v_materialIndex;
 
+#ifdef RENDER_RSM
 layout(location = 0) out vec3 outDiffuse;
 layout(location = 1) out vec3 outSpecular;
 layout(location = 2) out vec3 outFaceNormal;
-#ifndef RENDER_RSM
-layout(location = 3) out vec3 outNormal;
+layout(location = 3) out vec2 outVSM;
 #else
-layout(location = 4) out vec2 outVSM;
-# endif
+// the compact layout of gbuffer_packing.glsl
+layout(location = 0) out vec4 outDiffuseSpecular;
+layout(location = 1) out vec4 outNormals;
+#endif
 
 uniform sampler2D shadowmap;
 uniform sampler2D masksTexture;
 
-uniform sampler2D diffuseTexture;
-uniform bool useDiffuseTexture;
-uniform sampler2D specularTexture;
-uniform bool useSpecularTexture;
-uniform sampler2D emissiveTexture;
-uniform bool useEmissiveTexture;
-uniform sampler2D opacityTexture;
-uniform bool useOpacityTexture;
-uniform sampler2D bumpTexture;
 uniform int bumpType;
 
-uniform float shininess;
 uniform float masksOffset;
 uniform vec3 cameraEye;
 
@@ -42,6 +44,62 @@ uniform vec3 cameraEye;
 #define BUMP_HEIGHT 1
 #define BUMP_NORMAL 2
 
+// has to match MaterialTable::TextureArrayCount
+#define TEXTURE_ARRAY_COUNT 8
+
+#ifdef BINDLESS_TEXTURES
+
+vec4 materialTexture(uvec2 location, vec2 uv, vec2 dx, vec2 dy)
+{
+    return textureGrad(sampler2D(location), uv, dx, dy);
+}
+
+vec2 materialTextureSize(uvec2 location)
+{
+    return vec2(textureSize(sampler2D(location), 0));
+}
+
+#else
+
+uniform sampler2DArray textureArrays[TEXTURE_ARRAY_COUNT];
+
+// the material index comes from a per draw attribute, which is not dynamically uniform within a multi-draw,
+// so the arrays are only indexed with constants
+vec4 materialTexture(uvec2 location, vec2 uv, vec2 dx, vec2 dy)
+{
+    vec3 coord = vec3(uv, float(location.y));
+    switch (location.x)
+    {
+    case 0u: return textureGrad(textureArrays[0], coord, dx, dy);
+    case 1u: return textureGrad(textureArrays[1], coord, dx, dy);
+    case 2u: return textureGrad(textureArrays[2], coord, dx, dy);
+    case 3u: return textureGrad(textureArrays[3], coord, dx, dy);
+    case 4u: return textureGrad(textureArrays[4], coord, dx, dy);
+    case 5u: return textureGrad(textureArrays[5], coord, dx, dy);
+    case 6u: return textureGrad(textureArrays[6], coord, dx, dy);
+    case 7u: return textureGrad(textureArrays[7], coord, dx, dy);
+    }
+    return vec4(0.0);
+}
+
+vec2 materialTextureSize(uvec2 location)
+{
+    switch (location.x)
+    {
+    case 0u: return vec2(textureSize(textureArrays[0], 0).xy);
+    case 1u: return vec2(textureSize(textureArrays[1], 0).xy);
+    case 2u: return vec2(textureSize(textureArrays[2], 0).xy);
+    case 3u: return vec2(textureSize(textureArrays[3], 0).xy);
+    case 4u: return vec2(textureSize(textureArrays[4], 0).xy);
+    case 5u: return vec2(textureSize(textureArrays[5], 0).xy);
+    case 6u: return vec2(textureSize(textureArrays[6], 0).xy);
+    case 7u: return vec2(textureSize(textureArrays[7], 0).xy);
+    }
+    return vec2(1.0);
+}
+
+#endif
+
 // taken from http://www.thetenthplanet.de/archives/1180
 mat3 cotangent_frame(vec3 N, vec3 p, vec2 uv)
 {
@@ -66,16 +124,26 @@ void main()
 {
     vec2 uv = v_uv.xy;
 
-    if (useOpacityTexture)
+    MaterialParameters material = materials[v_materialIndex];
+    int materialBumpType = hasTexture(material, BUMP_TEXTURE) ? bumpType : BUMP_NONE;
+
+    // explicit gradients, the texture reads are in non-uniform control flow
+    vec2 uvDx = dFdx(uv);
+    vec2 uvDy = dFdy(uv);
+
+    if (hasTexture(material, OPACITY_TEXTURE))
     {
-        float curAlpha = texture(opacityTexture, uv).r;
+        float curAlpha = materialTexture(material.textures[OPACITY_TEXTURE], uv, uvDx, uvDy).r;
         if (curAlpha < 0.5)
             discard;
     }
 
-    if (useDiffuseTexture)
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+
+    if (hasTexture(material, DIFFUSE_TEXTURE))
     {
-        vec4 diffuseRead = texture(diffuseTexture, uv).rgba;
+        vec4 diffuseRead = materialTexture(material.textures[DIFFUSE_TEXTURE], uv, uvDx, uvDy).rgba;
         if (diffuseRead.a < 0.5)
             discard;
 
@@ -83,50 +151,60 @@ void main()
         // the "normal" read above is for the alpha test
         // passing the average color as uniform would be better
         // but does not speed this up, not bottlenecked by tex lookups
+        // (a footprint of the whole texture selects the coarsest level)
         #ifdef RENDER_RSM
-        diffuseRead = textureLod(diffuseTexture, uv, 32).rgba;
+        diffuseRead = materialTexture(material.textures[DIFFUSE_TEXTURE], uv, vec2(1.0, 0.0), vec2(0.0, 1.0)).rgba;
         #endif
-        outDiffuse = diffuseRead.rgb;
+        diffuse = diffuseRead.rgb;
     }
 
-    vec3 N = normalize(v_normal);
-    outFaceNormal = N * 0.5 + 0.5;
+    vec3 faceNormal = normalize(v_normal);
+    vec3 N = faceNormal;
 
     #ifndef RENDER_RSM
-        if (bumpType != BUMP_NONE)
+        if (materialBumpType != BUMP_NONE)
         {
             mat3 tbn = cotangent_frame(N, v_worldCoord, uv);
-            if (bumpType == BUMP_HEIGHT)
+            if (materialBumpType == BUMP_HEIGHT)
             {
-                float A = textureOffset(bumpTexture, uv, ivec2( 1, 0)).x;
-                float B = textureOffset(bumpTexture, uv, ivec2(-1, 0)).x;
-                float C = textureOffset(bumpTexture, uv, ivec2( 0, 1)).x;
-                float D = textureOffset(bumpTexture, uv, ivec2( 0,-1)).x;
+                uvec2 bumpTexture = material.textures[BUMP_TEXTURE];
+                vec2 texel = 1.0 / materialTextureSize(bumpTexture);
+                float A = materialTexture(bumpTexture, uv + vec2( texel.x, 0.0), uvDx, uvDy).x;
+                float B = materialTexture(bumpTexture, uv + vec2(-texel.x, 0.0), uvDx, uvDy).x;
+                float C = materialTexture(bumpTexture, uv + vec2(0.0,  texel.y), uvDx, uvDy).x;
+                float D = materialTexture(bumpTexture, uv + vec2(0.0, -texel.y), uvDx, uvDy).x;
 
                 vec3 normalBump = vec3(B-A, D-C, 0.1);
                 normalBump = tbn * normalBump;
                 N = normalize(normalBump);
             }
-            else if (bumpType == BUMP_NORMAL)
+            else if (materialBumpType == BUMP_NORMAL)
             {
-                vec3 normalSample = texture(bumpTexture, uv).rgb * 2.0 - 1.0;
+                // normal maps are two channel compressed, z is reconstructed
+                vec2 normalXY = materialTexture(material.textures[BUMP_TEXTURE], uv, uvDx, uvDy).rg * 2.0 - 1.0;
+                vec3 normalSample = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
                 N = normalize(tbn * normalSample);
             }
         }
-    outNormal = N * 0.5 + 0.5;
     #endif
 
-
-    if (useSpecularTexture)
+    if (hasTexture(material, SPECULAR_TEXTURE))
     {
-        outSpecular = texture(specularTexture, uv).rgb;
+        specular = materialTexture(material.textures[SPECULAR_TEXTURE], uv, uvDx, uvDy).rgb;
     }
 
     #ifdef RENDER_RSM
+        outDiffuse = diffuse;
+        outSpecular = specular;
+        outFaceNormal = faceNormal * 0.5 + 0.5;
+
         float dist = length(v_worldCoord - cameraEye);
         float dx = dFdx(dist);
         float dy = dFdy(dist);
 
         outVSM = vec2(dist, dist * dist + 0.25 * (dx*dx + dy*dy));
+    #else
+        outDiffuseSpecular = vec4(diffuse, packSpecular(specular));
+        outNormals = packNormals(faceNormal, N);
     #endif
 }
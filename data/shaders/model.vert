@@ -1,15 +1,27 @@
-#version 330
+#version 430
 #extension GL_ARB_shading_language_include : require
 
+#include </data/shaders/common/vertex_packing.glsl>
+
+// quantized in the scene geometry, plain floats for other drawables
 layout(location = 0) in vec3 a_vertex;
 layout(location = 1) in vec3 a_normal;
 layout(location = 2) in vec3 a_uv;
+// per draw, from the scene geometry's instanced attributes or set as constant attribute values
+layout(location = 3) in uint a_materialIndex;
+layout(location = 4) in vec3 a_boundsMin;
+layout(location = 5) in vec3 a_boundsExtent;
+
+// the z-prepass and the texture feedback pass test against the depth of other programs using this shader
+invariant gl_Position;
 
 out vec3 v_normal;
 out vec3 v_worldCoord;
 out vec3 v_uv;
 out vec4 v_s;
+flat out uint v_materialIndex;
 
+uniform bool quantizedVertices;
 uniform mat4 model;
 uniform mat4 viewProjection;
 uniform vec2 ndcOffset;
@@ -21,13 +33,22 @@ uniform mat4 biasedShadowTransform;
 
 void main()
 {
-    vec4 vertex = vec4(a_vertex, 1.0);
+    vec3 position = quantizedVertices ? unpackPosition(a_vertex, a_boundsMin, a_boundsExtent) : a_vertex;
+    vec4 vertex = vec4(position, 1.0);
 
-    v_worldCoord = a_vertex;
-    v_normal = a_normal;
+    v_worldCoord = position;
+    v_normal = quantizedVertices ? unpackNormal(a_normal.xy) : a_normal;
     v_uv = a_uv;
+    v_materialIndex = a_materialIndex;
     gl_Position = viewProjection * model * vertex;
 
+    // depth of field: shift vertices by the current circle of confusion sample,
+    // scaled by their distance to the focal plane (w is the view space depth)
+    gl_Position.xy += cocPoint * (gl_Position.w - focalDist);
+
+    // antialiasing: subpixel offset, multiplied by w to be unaffected by the perspective divide
+    gl_Position.xy += ndcOffset * gl_Position.w;
+
     vec4 v_s_tmp = biasedShadowTransform * vertex;
     v_s = v_s_tmp;
 }
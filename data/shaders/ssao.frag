@@ -1,7 +1,11 @@
 #version 330
 
 #extension GL_ARB_shading_language_include : require
+#extension GL_ARB_shading_language_420pack : require
 #include </data/shaders/common/reprojection.glsl>
+#include </data/shaders/common/tile_mask.glsl>
+#include </data/shaders/common/frame_constants.glsl>
+#include </data/shaders/common/gbuffer_packing.glsl>
 
 in vec2 v_uv;
 in vec3 v_viewRay;
@@ -12,15 +16,16 @@ uniform sampler2D normalSampler;
 uniform sampler2D depthSampler;
 uniform sampler1D ssaoKernelSampler;
 uniform sampler2D ssaoNoiseSampler;
+uniform sampler2D tileErrorSampler;
 
-uniform mat3 normalMatrix;
-uniform mat4 projectionMatrix;
-uniform mat4 projectionInverseMatrix;
-uniform mat4 view;
-uniform float farZ;
-uniform vec2 screenSize;
 uniform vec4 samplerSizes;
 uniform float ssaoRadius;
+// the samples of a frame are every kernelStride-th kernel texel starting at kernelOffset
+uniform float kernelTexelSize;
+uniform float kernelOffset;
+uniform float kernelStride;
+uniform float noiseRotation;
+uniform float tileErrorThreshold;
 
 
 bool equalsDelta(float v1, float v2, float d)
@@ -34,6 +39,11 @@ mat3 noised(const in vec3 normal, in vec2 uv)
 
     vec3 random = texture(ssaoNoiseSampler, uv).xyz;
 
+    // rotate the noise per frame to get new sample directions when accumulating
+    float c = cos(noiseRotation);
+    float s = sin(noiseRotation);
+    random.xy = mat2(c, s, -s, c) * random.xy;
+
     // orientation matrix
     vec3 t = normalize(random - normal * dot(random, normal));
     vec3 b = cross(normal, t);
@@ -54,7 +64,8 @@ float ssao(float depth, vec3 normal)
 
     for (float i = 0.0; i < samplerSizes[0]; ++i)
     {
-        vec3 s = m * texture(ssaoKernelSampler, i * samplerSizes[1]).xyz;
+        float kernelIndex = i * kernelStride + kernelOffset;
+        vec3 s = m * texture(ssaoKernelSampler, (kernelIndex + 0.5) * kernelTexelSize).xyz;
 
         s *= 2.0 * ssaoRadius;
         s += origin;
@@ -77,10 +88,13 @@ float ssao(float depth, vec3 normal)
 
 void main()
 {
+    if (!tileActive(tileErrorSampler, ivec2(gl_FragCoord.xy), tileErrorThreshold))
+        discard;
+
     float d = linearDepth(depthSampler, v_uv, projectionMatrix);
-    vec3 normal = texture(normalSampler, v_uv, 0).xyz * 2.0 - 1.0;
+    vec3 normal = unpackFaceNormal(texture(normalSampler, v_uv, 0));
 
-    if (-d >= farZ * 0.99) {
+    if (-d >= zFar * 0.99) {
         outOcclusion = 1.0;
         return;
     }
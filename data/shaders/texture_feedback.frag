@@ -0,0 +1,61 @@
+#version 430
+#extension GL_ARB_shading_language_include : require
+
+#include </data/shaders/common/material_table.glsl>
+
+// drawn with an equal depth test after the camera pass, so only the visible fragments request texture levels.
+// nothing is discarded, the cutouts of alpha tested geometry failed the depth test already
+layout(early_fragment_tests) in;
+
+in vec3 v_uv;
+flat in uint v_materialIndex;
+
+uniform uint feedbackOffset;
+
+// has to match TextureStreaming::NotStreamed
+#define NOT_STREAMED 0xFFFFFFFFu
+
+layout (std430, binding = 1) readonly buffer streamedTextureSizes_
+{
+    uvec2 streamedTextureSizes[];
+};
+
+// the finest level each streamed texture has been sampled at, see TextureStreaming
+layout (std430, binding = 2) buffer textureFeedback_
+{
+    uint requestedLevels[];
+};
+
+void requestLevel(uint streamedTexture, vec2 dx, vec2 dy)
+{
+    if (streamedTexture == NOT_STREAMED)
+        return;
+
+    // the level that would be sampled if the texture had all its levels resident
+    vec2 size = vec2(streamedTextureSizes[streamedTexture]);
+    float lengthX = length(dx * size);
+    float lengthY = length(dy * size);
+    // anisotropic filtering selects the level of the shorter axis, for up to 16 samples
+    float level = max(log2(min(lengthX, lengthY)), log2(max(lengthX, lengthY)) - 4.0);
+
+    atomicMin(requestedLevels[streamedTexture], uint(max(level, 0.0)));
+}
+
+void main()
+{
+    // the same gradients as model.frag, before the non-uniform control flow
+    vec2 uvDx = dFdx(v_uv.xy);
+    vec2 uvDy = dFdy(v_uv.xy);
+
+    // a different pixel of each 8x8 block each frame, a few samples per texture are enough
+    uvec2 blockPixel = uvec2(gl_FragCoord.xy) % 8u;
+    if (blockPixel.x + blockPixel.y * 8u != feedbackOffset)
+        return;
+
+    MaterialParameters material = materials[v_materialIndex];
+    for (int type = DIFFUSE_TEXTURE; type <= OPACITY_TEXTURE; ++type)
+    {
+        if (hasTexture(material, type))
+            requestLevel(material.streamedTextures[type], uvDx, uvDy);
+    }
+}
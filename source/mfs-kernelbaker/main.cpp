@@ -0,0 +1,37 @@
+#include <iostream>
+#include <string>
+
+#include <multiframepainter/KernelCache.h>
+
+
+// Pre-bakes the sampling kernels for the common multi-frame counts into the kernel cache,
+// so the painter does not have to generate them at startup.
+int main(int argc, char * argv[])
+{
+    std::string filename = argc > 1 ? argv[1] : "data/kernels.cache";
+
+    const unsigned int multiFrameCounts[] = { 1, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    const KernelType kernel2Types[] = { KernelType::AntiAliasing, KernelType::DepthOfField, KernelType::Shadow, KernelType::VPL };
+    const unsigned int ssaoKernelSizes[] = { 16, 64 };
+
+    KernelCache cache(filename);
+
+    for (auto count : multiFrameCounts)
+    {
+        std::cout << "Baking kernels with " << count << " samples" << std::endl;
+        for (auto type : kernel2Types)
+            cache.kernel2(KernelCache::defaultKey(type, count));
+    }
+
+    for (auto size : ssaoKernelSizes)
+        cache.kernel3(KernelCache::defaultKey(KernelType::SSAO, size));
+
+    if (!cache.save())
+    {
+        std::cerr << "Could not write " << filename << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << filename << std::endl;
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include "AccumulationStage.h"
+
+#include <glm/vec2.hpp>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/boolean.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/bitfield.h>
+
+#include <globjects/Buffer.h>
+#include <globjects/Texture.h>
+#include <globjects/Program.h>
+#include <globjects/Shader.h>
+#include <globjects/Uniform.h>
+
+#include <gloperate/painter/AbstractViewportCapability.h>
+#include <gloperate/painter/AbstractPerspectiveProjectionCapability.h>
+#include <gloperate/painter/AbstractCameraCapability.h>
+
+#include <reflectionzeug/property/PropertyGroup.h>
+
+#include "MultiFramePainter.h"
+#include "PerfCounter.h"
+
+using namespace gl;
+
+namespace
+{
+    const int tileSize = 16; // must match shader
+
+    // the variance estimate is meaningless for the first few samples
+    const int minConvergenceSampleCount = 8;
+
+    // reprojected history is weighted at most like this many samples, so view dependent shading can catch up
+    const unsigned int maxReprojectedSampleCount = 64;
+}
+
+AccumulationStage::AccumulationStage()
+: currentFrame(1)
+, reprojectHistory(false)
+, m_resetAccumulationUniform(nullptr)
+, m_tileErrorThresholdUniform(nullptr)
+, m_previousViewProjectionUniform(nullptr)
+, m_convergenceBufferFrames{ { 0, 0 } }
+, m_convergedSampleCount(0)
+, m_convergenceStartFrame(1)
+, m_exposure(1.0f)
+, m_errorThreshold(0.002f)
+, m_maxSampleCount(1024)
+, m_adaptiveSampling(true)
+, m_temporalReprojection(true)
+{
+}
+
+AccumulationStage::~AccumulationStage()
+{
+}
+
+void AccumulationStage::initProperties(MultiFramePainter& painter)
+{
+    auto group = painter.addGroup("Accumulation");
+    group->addProperty<float>("Exposure",
+        [this]() { return m_exposure; },
+        [this](const float & exposure) {
+            m_exposure = exposure;
+        }
+    )->setOptions({
+        { "minimum", 0.0f },
+        { "step", 0.1f },
+        { "precision", 2u },
+    });
+
+    // standard error of the tonemapped luminance below which a tile counts as converged, 0 disables early termination
+    group->addProperty<float>("ErrorThreshold",
+        [this]() { return m_errorThreshold; },
+        [this](const float & threshold) {
+            m_errorThreshold = threshold;
+            resetConvergence();
+        }
+    )->setOptions({
+        { "minimum", 0.0f },
+        { "step", 0.0005f },
+        { "precision", 4u },
+    });
+
+    group->addProperty<int>("MaxSampleCount",
+        [this]() { return m_maxSampleCount; },
+        [this](const int & count) {
+            m_maxSampleCount = count;
+            resetConvergence();
+        }
+    )->setOptions({
+        { "minimum", 1 },
+    });
+
+    // only render tiles that have not converged yet once the variance estimate is meaningful
+    group->addProperty<bool>("AdaptiveSampling",
+        [this]() { return m_adaptiveSampling; },
+        [this](const bool & value) {
+            m_adaptiveSampling = value;
+        }
+    );
+
+    group->addProperty<bool>("TemporalReprojection",
+        [this]() { return m_temporalReprojection; },
+        [this, &painter](const bool & value) {
+            m_temporalReprojection = value;
+            painter.resetAccumulation();
+        }
+    );
+}
+
+void AccumulationStage::initialize()
+{
+    accumulation = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    accumulation->setName("Accumulation");
+
+    accumulatedFrame = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    accumulatedFrame->setName("Accumulated Frame");
+
+    tileError = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    tileError->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    tileError->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    tileError->setName("Tile Error");
+
+    sampleCount = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    sampleCount->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    sampleCount->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    sampleCount->setName("Sample Count");
+
+    historyGeometry = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    historyGeometry->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    historyGeometry->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    historyGeometry->setName("History Geometry");
+
+    m_reprojectedAccumulation = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    m_reprojectedAccumulation->setName("Reprojected Accumulation");
+
+    m_reprojectedSampleCount = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    m_reprojectedSampleCount->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    m_reprojectedSampleCount->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    m_reprojectedSampleCount->setName("Reprojected Sample Count");
+
+    for (auto& buffer : m_convergenceBuffers)
+    {
+        buffer = new globjects::Buffer();
+        buffer->setName("convergence counter");
+        buffer->setData(sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    }
+
+    m_program = new globjects::Program();
+    m_program->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/accumulation/accumulation.comp"));
+    m_program->setUniform("frameSampler", 0);
+    m_program->setUniform("depthSampler", 1);
+    m_program->setUniform("normalSampler", 2);
+    m_resetAccumulationUniform = m_program->getUniform<bool>("resetAccumulation");
+    m_tileErrorThresholdUniform = m_program->getUniform<float>("tileErrorThreshold");
+
+    m_reprojectionProgram = new globjects::Program();
+    m_reprojectionProgram->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/accumulation/reprojection.comp"));
+    m_reprojectionProgram->setUniform("accumulationSampler", 0);
+    m_reprojectionProgram->setUniform("sampleCountSampler", 1);
+    m_reprojectionProgram->setUniform("historyGeometrySampler", 2);
+    m_reprojectionProgram->setUniform("depthSampler", 3);
+    m_reprojectionProgram->setUniform("normalSampler", 4);
+    m_reprojectionProgram->setUniform("maxSampleCount", maxReprojectedSampleCount);
+    m_previousViewProjectionUniform = m_reprojectionProgram->getUniform<glm::mat4>("previousViewProjectionMatrix");
+}
+
+void AccumulationStage::updateConvergence()
+{
+    if (converged())
+        return;
+
+    // the accumulation buffer holds currentFrame - 1 samples at this point
+    if (currentFrame - m_convergenceStartFrame >= m_maxSampleCount)
+    {
+        m_convergedSampleCount = currentFrame - 1;
+        return;
+    }
+
+    auto index = currentFrame % 2;
+    auto evaluatedFrameCount = m_convergenceBufferFrames[index] - m_convergenceStartFrame + 1;
+    if (m_errorThreshold <= 0.0f || evaluatedFrameCount < minConvergenceSampleCount)
+        return;
+
+    GLuint unconvergedTileCount = 0;
+    m_convergenceBuffers[index]->getSubData(0, sizeof(GLuint), &unconvergedTileCount);
+
+    if (unconvergedTileCount == 0)
+        m_convergedSampleCount = currentFrame - 1;
+}
+
+void AccumulationStage::resetConvergence()
+{
+    m_convergenceBufferFrames = { { 0, 0 } };
+    m_convergedSampleCount = 0;
+    m_convergenceStartFrame = currentFrame;
+}
+
+bool AccumulationStage::converged() const
+{
+    return m_convergedSampleCount > 0;
+}
+
+int AccumulationStage::convergedSampleCount() const
+{
+    return m_convergedSampleCount;
+}
+
+float AccumulationStage::tileMaskThreshold() const
+{
+    if (!m_adaptiveSampling || m_errorThreshold <= 0.0f || currentFrame - m_convergenceStartFrame < minConvergenceSampleCount)
+        return -1.0f;
+
+    return m_errorThreshold;
+}
+
+bool AccumulationStage::temporalReprojection() const
+{
+    return m_temporalReprojection;
+}
+
+void AccumulationStage::process()
+{
+    if (viewport->hasChanged())
+        resizeTextures(viewport->width(), viewport->height());
+
+    // has its own timer, gl timer queries can't be nested
+    if (reprojectHistory && currentFrame > 1)
+        reproject();
+
+    AutoGLPerfCounter c("Accumulation");
+
+    auto index = currentFrame % 2;
+    auto& convergenceBuffer = m_convergenceBuffers[index];
+    GLuint zero = 0;
+    convergenceBuffer->clearData(GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    convergenceBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+
+    frame->bindActive(0);
+    depthBuffer->bindActive(1);
+    normalBuffer->bindActive(2);
+    accumulation->bindImageTexture(0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    accumulatedFrame->bindImageTexture(1, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    tileError->bindImageTexture(2, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    sampleCount->bindImageTexture(3, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+    historyGeometry->bindImageTexture(4, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    // the first sample overwrites whatever is left in the accumulation buffer
+    m_resetAccumulationUniform->set(currentFrame == 1);
+    m_program->setUniform("exposure", m_exposure);
+    m_program->setUniform("errorThreshold", m_errorThreshold);
+    m_tileErrorThresholdUniform->set(tileMaskThreshold());
+
+    int numTilesX = (viewport->width() + tileSize - 1) / tileSize;
+    int numTilesY = (viewport->height() + tileSize - 1) / tileSize;
+    m_program->dispatchCompute(numTilesX, numTilesY, 1);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    m_convergenceBufferFrames[index] = currentFrame;
+    m_previousViewProjection = projection->projection() * camera->view();
+}
+
+void AccumulationStage::reproject()
+{
+    AutoGLPerfCounter c("Reprojection");
+
+    accumulation->bindActive(0);
+    sampleCount->bindActive(1);
+    historyGeometry->bindActive(2);
+    depthBuffer->bindActive(3);
+    normalBuffer->bindActive(4);
+    m_reprojectedAccumulation->bindImageTexture(0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    m_reprojectedSampleCount->bindImageTexture(1, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+
+    m_previousViewProjectionUniform->set(m_previousViewProjection);
+
+    int numGroupsX = (viewport->width() + tileSize - 1) / tileSize;
+    int numGroupsY = (viewport->height() + tileSize - 1) / tileSize;
+    m_reprojectionProgram->dispatchCompute(numGroupsX, numGroupsY, 1);
+
+    // the history is read at arbitrary positions, so it can't be reprojected in place
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glCopyImageSubData(m_reprojectedAccumulation->id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+        accumulation->id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+        viewport->width(), viewport->height(), 1);
+    glCopyImageSubData(m_reprojectedSampleCount->id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+        sampleCount->id(), GL_TEXTURE_2D, 0, 0, 0, 0,
+        viewport->width(), viewport->height(), 1);
+}
+
+void AccumulationStage::resizeTextures(int width, int height)
+{
+    accumulation->image2D(0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    accumulatedFrame->image2D(0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    sampleCount->image2D(0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    historyGeometry->image2D(0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    m_reprojectedAccumulation->image2D(0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    m_reprojectedSampleCount->image2D(0, GL_R32UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    int numTilesX = (width + tileSize - 1) / tileSize;
+    int numTilesY = (height + tileSize - 1) / tileSize;
+    tileError->image2D(0, GL_R32F, numTilesX, numTilesY, 0, GL_RED, GL_FLOAT, nullptr);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+
+#include <glm/mat4x4.hpp>
+
+#include <globjects/base/ref_ptr.h>
+
+namespace globjects
+{
+    class Buffer;
+    class Program;
+    class Texture;
+    template <typename T> class Uniform;
+}
+
+namespace gloperate
+{
+    class AbstractViewportCapability;
+    class AbstractPerspectiveProjectionCapability;
+    class AbstractCameraCapability;
+}
+
+class MultiFramePainter;
+
+
+class AccumulationStage
+{
+public:
+    AccumulationStage();
+    ~AccumulationStage();
+
+    void initProperties(MultiFramePainter& painter);
+
+    void initialize();
+    void process();
+
+    // evaluates the convergence test of an earlier frame, call before deciding whether to render another frame
+    void updateConvergence();
+    void resetConvergence();
+    bool converged() const;
+    int convergedSampleCount() const;
+
+    // error threshold for skipping converged tiles in the current frame, negative if all tiles have to be rendered
+    float tileMaskThreshold() const;
+
+    // whether camera changes keep the history by reprojecting it instead of starting over
+    bool temporalReprojection() const;
+
+    gloperate::AbstractPerspectiveProjectionCapability * projection;
+    gloperate::AbstractViewportCapability * viewport;
+    gloperate::AbstractCameraCapability * camera;
+
+    // 1-based index of the sample that is accumulated by the next call to process()
+    int currentFrame;
+
+    // moves the accumulated samples into the current view before accumulating the next one
+    bool reprojectHistory;
+
+    globjects::ref_ptr<globjects::Texture> frame;
+    globjects::ref_ptr<globjects::Texture> depthBuffer;
+    // the packed normals of the camera's G-buffer, see gbuffer_packing.glsl
+    globjects::ref_ptr<globjects::Texture> normalBuffer;
+
+    globjects::ref_ptr<globjects::Texture> accumulation;
+    globjects::ref_ptr<globjects::Texture> accumulatedFrame;
+    globjects::ref_ptr<globjects::Texture> tileError;
+    globjects::ref_ptr<globjects::Texture> sampleCount;
+    globjects::ref_ptr<globjects::Texture> historyGeometry;
+
+protected:
+    void reproject();
+    void resizeTextures(int width, int height);
+
+    globjects::ref_ptr<globjects::Program> m_program;
+    globjects::ref_ptr<globjects::Program> m_reprojectionProgram;
+    // looked up once, setting them by name would allocate a string every frame
+    globjects::Uniform<bool> * m_resetAccumulationUniform;
+    globjects::Uniform<float> * m_tileErrorThresholdUniform;
+    globjects::Uniform<glm::mat4> * m_previousViewProjectionUniform;
+
+    globjects::ref_ptr<globjects::Texture> m_reprojectedAccumulation;
+    globjects::ref_ptr<globjects::Texture> m_reprojectedSampleCount;
+    glm::mat4 m_previousViewProjection;
+
+    // the unconverged tile count is read back two frames later to avoid stalling on the GPU
+    std::array<globjects::ref_ptr<globjects::Buffer>, 2> m_convergenceBuffers;
+    std::array<int, 2> m_convergenceBufferFrames;
+    int m_convergedSampleCount;
+    // first frame after the last reset or reprojection, the convergence test only considers the frames since then
+    int m_convergenceStartFrame;
+
+    float m_exposure;
+    float m_errorThreshold;
+    int m_maxSampleCount;
+    bool m_adaptiveSampling;
+    bool m_temporalReprojection;
+};
@@ -0,0 +1,36 @@
+#include "AllocationTracker.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+
+namespace
+{
+    using AllocationCountFunction = uint64_t (*)();
+
+    // looked up once, the executable doesn't change
+    AllocationCountFunction allocationCountFunction()
+    {
+#ifdef _WIN32
+        static auto function = reinterpret_cast<AllocationCountFunction>(GetProcAddress(GetModuleHandle(nullptr), "mfsAllocationCount"));
+#else
+        static auto function = reinterpret_cast<AllocationCountFunction>(dlsym(RTLD_DEFAULT, "mfsAllocationCount"));
+#endif
+        return function;
+    }
+}
+
+
+bool AllocationTracker::enabled()
+{
+    return allocationCountFunction() != nullptr;
+}
+
+uint64_t AllocationTracker::allocationCount()
+{
+    auto function = allocationCountFunction();
+    return function ? function() : 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Reads the heap allocation count of the executable, which replaces the global operator new with a counting one
+// and exports the count as mfsAllocationCount(). mfs-viewer does so when built with OPTION_TRACK_ALLOCATIONS,
+// otherwise tracking is disabled and the count stays at zero. On ELF and Mach-O platforms the replacement serves
+// all libraries of the process, on Windows only the executable's own allocations are counted. Allocations of
+// background threads, e.g. while a scene is loading, are included.
+class AllocationTracker
+{
+public:
+    static bool enabled();
+    static uint64_t allocationCount();
+};
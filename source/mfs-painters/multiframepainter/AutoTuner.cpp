@@ -0,0 +1,327 @@
+#include "AutoTuner.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+#include <globjects/Query.h>
+
+#include "FileUtils.h"
+
+using namespace gl;
+
+
+namespace
+{
+    const char s_magic[4] = { 'M', 'F', 'S', 'P' };
+    // bump when PipelineConfiguration's tuned members change, old files are ignored then
+    const uint32_t s_version = 1;
+
+    // covers the shader compilation and lets texture streaming and the caches settle
+    const size_t s_warmupFrames = 8;
+    const size_t s_measuredFrames = 16;
+    // query results are usually available after two or three frames
+    const size_t s_maxPendingMeasurements = 8;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t reserved;
+        // GL_RENDERER, the timings only hold for the GPU they were measured on
+        char renderer[128];
+    };
+
+    struct FileEntry
+    {
+        uint32_t preset;
+        uint32_t width;
+        uint32_t height;
+        uint32_t zPrepass;
+        uint32_t clusterPixelSize;
+        uint32_t clusterDepthSlices;
+        uint32_t giWorkGroupSize;
+        float milliseconds;
+    };
+}
+
+
+AutoTuner::AutoTuner(const std::string & filename)
+: m_filename(filename)
+, m_running(false)
+, m_candidate(0)
+, m_candidateFrame(0)
+, m_currentMeasurement(nullptr)
+{
+    auto renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+    m_renderer = renderer ? renderer : "";
+    m_renderer.resize(std::min(m_renderer.size(), sizeof(FileHeader::renderer) - 1));
+
+    m_measurements.resize(s_maxPendingMeasurements);
+    for (auto & measurement : m_measurements)
+    {
+        measurement.begin = new globjects::Query();
+        measurement.end = new globjects::Query();
+        measurement.candidate = 0;
+        measurement.pending = false;
+    }
+
+    load();
+}
+
+AutoTuner::~AutoTuner()
+{
+}
+
+bool AutoTuner::find(Preset preset, int width, int height, int maxTextureSize, PipelineConfiguration & configuration) const
+{
+    auto result = m_results.find(Key(static_cast<uint32_t>(preset), static_cast<uint32_t>(width), static_cast<uint32_t>(height)));
+    if (result == m_results.end())
+        return false;
+
+    // only the tuned members are persisted
+    auto found = configuration;
+    found.zPrepass = result->second.configuration.zPrepass;
+    found.clusterPixelSize = result->second.configuration.clusterPixelSize;
+    found.clusterDepthSlices = result->second.configuration.clusterDepthSlices;
+    found.giWorkGroupSize = result->second.configuration.giWorkGroupSize;
+
+    if (!found.valid(width, height, maxTextureSize))
+    {
+        std::cout << "Ignoring invalid pipeline configuration in " << m_filename << std::endl;
+        return false;
+    }
+
+    configuration = found;
+    return true;
+}
+
+void AutoTuner::start(Preset preset, int width, int height, const std::vector<PipelineConfiguration> & candidates)
+{
+    cancel();
+    if (candidates.empty())
+        return;
+
+    m_running = true;
+    m_key = Key(static_cast<uint32_t>(preset), static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    m_candidates = candidates;
+    m_frameTimes.assign(candidates.size(), std::vector<uint64_t>());
+    for (auto & frameTimes : m_frameTimes)
+        frameTimes.reserve(s_measuredFrames);
+
+    m_candidate = 0;
+    m_candidateFrame = 0;
+    m_best = candidates.front();
+}
+
+void AutoTuner::cancel()
+{
+    m_running = false;
+    m_currentMeasurement = nullptr;
+
+    // results of queries that are still in flight are dropped
+    for (auto & measurement : m_measurements)
+        measurement.pending = false;
+}
+
+bool AutoTuner::running() const
+{
+    return m_running;
+}
+
+const PipelineConfiguration & AutoTuner::configuration() const
+{
+    if (!m_running)
+        return m_best;
+
+    // after the last candidate it keeps rendering until its measurements are available
+    return m_candidates[candidateIndex()];
+}
+
+size_t AutoTuner::candidateIndex() const
+{
+    return std::min(m_candidate, m_candidates.size() - 1);
+}
+
+size_t AutoTuner::candidateCount() const
+{
+    return m_candidates.size();
+}
+
+void AutoTuner::beginFrame()
+{
+    m_currentMeasurement = nullptr;
+    if (!m_running || m_candidate >= m_candidates.size() || m_candidateFrame < s_warmupFrames)
+        return;
+
+    auto measurement = std::find_if(m_measurements.begin(), m_measurements.end(), [](const Measurement & measurement) {
+        return !measurement.pending;
+    });
+
+    // all queries are in flight, the frame is not measured then
+    if (measurement == m_measurements.end())
+        return;
+
+    measurement->begin->counter(GL_TIMESTAMP);
+    m_currentMeasurement = &*measurement;
+}
+
+bool AutoTuner::endFrame()
+{
+    if (!m_running)
+        return false;
+
+    if (m_currentMeasurement)
+    {
+        m_currentMeasurement->end->counter(GL_TIMESTAMP);
+        m_currentMeasurement->candidate = m_candidate;
+        m_currentMeasurement->pending = true;
+        m_currentMeasurement = nullptr;
+    }
+
+    if (m_candidate < m_candidates.size() && ++m_candidateFrame == s_warmupFrames + s_measuredFrames)
+    {
+        ++m_candidate;
+        m_candidateFrame = 0;
+    }
+
+    readMeasurements();
+
+    auto pending = std::any_of(m_measurements.begin(), m_measurements.end(), [](const Measurement & measurement) {
+        return measurement.pending;
+    });
+    if (m_candidate < m_candidates.size() || pending)
+        return false;
+
+    finish();
+    return true;
+}
+
+void AutoTuner::readMeasurements()
+{
+    for (auto & measurement : m_measurements)
+    {
+        if (!measurement.pending || !measurement.end->resultAvailable())
+            continue;
+
+        // the end is written after the begin, so both are available
+        auto begin = measurement.begin->get64(GL_QUERY_RESULT);
+        auto end = measurement.end->get64(GL_QUERY_RESULT);
+        m_frameTimes[measurement.candidate].push_back(end - begin);
+        measurement.pending = false;
+    }
+}
+
+void AutoTuner::finish()
+{
+    m_running = false;
+
+    auto bestIndex = m_candidates.size();
+    uint64_t bestTime = 0;
+    for (auto i = size_t(0); i < m_candidates.size(); ++i)
+    {
+        auto & frameTimes = m_frameTimes[i];
+        if (frameTimes.empty())
+            continue;
+
+        // the median ignores the frames that happened to be interrupted
+        std::nth_element(frameTimes.begin(), frameTimes.begin() + frameTimes.size() / 2, frameTimes.end());
+        auto time = frameTimes[frameTimes.size() / 2];
+
+        if (bestIndex == m_candidates.size() || time < bestTime)
+        {
+            bestIndex = i;
+            bestTime = time;
+        }
+    }
+
+    if (bestIndex == m_candidates.size())
+        return;
+
+    m_best = m_candidates[bestIndex];
+    m_results[m_key] = Result{ m_best, bestTime / 1000000.f };
+
+    save();
+}
+
+void AutoTuner::load()
+{
+    m_results.clear();
+
+    std::ifstream stream(m_filename, std::ios::binary);
+    if (!stream)
+        return;
+
+    FileHeader header;
+    if (!stream.read(reinterpret_cast<char *>(&header), sizeof(FileHeader)))
+        return;
+
+    if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.version != s_version)
+    {
+        std::cout << "Ignoring outdated pipeline cache " << m_filename << std::endl;
+        return;
+    }
+
+    header.renderer[sizeof(header.renderer) - 1] = '\0';
+    if (m_renderer != header.renderer)
+    {
+        std::cout << "Ignoring pipeline cache " << m_filename << " of " << header.renderer << std::endl;
+        return;
+    }
+
+    for (auto i = 0u; i < header.entryCount; ++i)
+    {
+        FileEntry entry;
+        if (!stream.read(reinterpret_cast<char *>(&entry), sizeof(FileEntry)))
+            return;
+
+        Result result;
+        result.configuration.zPrepass = entry.zPrepass != 0;
+        result.configuration.clusterPixelSize = static_cast<int>(entry.clusterPixelSize);
+        result.configuration.clusterDepthSlices = static_cast<int>(entry.clusterDepthSlices);
+        result.configuration.giWorkGroupSize = static_cast<int>(entry.giWorkGroupSize);
+        result.milliseconds = entry.milliseconds;
+
+        m_results[Key(entry.preset, entry.width, entry.height)] = result;
+    }
+}
+
+bool AutoTuner::save() const
+{
+    FileHeader header;
+    std::memset(&header, 0, sizeof(FileHeader));
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.entryCount = static_cast<uint32_t>(m_results.size());
+    std::memcpy(header.renderer, m_renderer.data(), m_renderer.size());
+
+    auto written = writeFileAtomically(m_filename, [&](std::ostream & stream) {
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+
+        for (const auto & result : m_results)
+        {
+            const auto & configuration = result.second.configuration;
+            auto entry = FileEntry{
+                std::get<0>(result.first),
+                std::get<1>(result.first),
+                std::get<2>(result.first),
+                configuration.zPrepass ? 1u : 0u,
+                static_cast<uint32_t>(configuration.clusterPixelSize),
+                static_cast<uint32_t>(configuration.clusterDepthSlices),
+                static_cast<uint32_t>(configuration.giWorkGroupSize),
+                result.second.milliseconds
+            };
+            stream.write(reinterpret_cast<const char *>(&entry), sizeof(FileEntry));
+        }
+    });
+
+    if (!written)
+        std::cout << "Could not write pipeline cache " << m_filename << std::endl;
+
+    return written;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <globjects/base/ref_ptr.h>
+
+#include "PipelineConfiguration.h"
+#include "Preset.h"
+
+namespace globjects
+{
+    class Query;
+}
+
+
+// Finds the fastest pipeline configuration of a scene at a resolution. Each candidate renders a few frames to
+// warm up, which also absorbs its shader compilation, then the GPU time of the following frames is measured
+// with timestamp queries. Their results are read once available, so measuring never stalls the pipeline.
+// The fastest candidate by median frame time is persisted per scene and resolution, results of another GPU
+// are ignored when loading.
+class AutoTuner
+{
+public:
+    AutoTuner(const std::string & filename);
+    ~AutoTuner();
+
+    // the persisted result, false if the scene has not been tuned at this resolution or the result is not valid
+    // there, e.g. from a corrupt file or a GPU with a smaller maximum texture size
+    bool find(Preset preset, int width, int height, int maxTextureSize, PipelineConfiguration & configuration) const;
+
+    // restarts the tuning with the given candidates, the first one is the fallback if none can be measured
+    void start(Preset preset, int width, int height, const std::vector<PipelineConfiguration> & candidates);
+    void cancel();
+    bool running() const;
+
+    // while running, the candidate the next frame has to be rendered with. afterwards, the fastest one
+    const PipelineConfiguration & configuration() const;
+    // the index of the candidate configuration() returns while running
+    size_t candidateIndex() const;
+    size_t candidateCount() const;
+
+    // call around each frame's rendering while running, endFrame() returns true when the tuning has finished
+    void beginFrame();
+    bool endFrame();
+
+protected:
+    using Key = std::tuple<uint32_t, uint32_t, uint32_t>;
+
+    struct Result
+    {
+        PipelineConfiguration configuration;
+        float milliseconds;
+    };
+
+    struct Measurement
+    {
+        globjects::ref_ptr<globjects::Query> begin;
+        globjects::ref_ptr<globjects::Query> end;
+        size_t candidate;
+        bool pending;
+    };
+
+    void readMeasurements();
+    void finish();
+
+    void load();
+    bool save() const;
+
+    std::string m_filename;
+    std::string m_renderer;
+    std::map<Key, Result> m_results;
+
+    bool m_running;
+    Key m_key;
+    std::vector<PipelineConfiguration> m_candidates;
+    std::vector<std::vector<uint64_t>> m_frameTimes;
+    size_t m_candidate;
+    size_t m_candidateFrame;
+    PipelineConfiguration m_best;
+
+    std::vector<Measurement> m_measurements;
+    Measurement * m_currentMeasurement;
+};
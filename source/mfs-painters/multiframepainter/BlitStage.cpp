@@ -7,6 +7,8 @@
 
 #include <globjects/Texture.h>
 #include <globjects/Framebuffer.h>
+#include <globjects/Program.h>
+#include <globjects/Uniform.h>
 
 #include <gloperate/painter/AbstractViewportCapability.h>
 #include <gloperate/primitives/ScreenAlignedQuad.h>
@@ -19,7 +21,11 @@ using namespace gl;
 
 
 BlitStage::BlitStage()
-: m_currentBuffer("Shaded Frame")
+: m_currentBuffer("Accumulated Frame")
+, m_currentBufferTexture(nullptr)
+, m_singleChannel(false)
+, m_softRenderBufferActive(false)
+, m_softRenderBufferActiveUniform(nullptr)
 {
 }
 
@@ -31,6 +37,9 @@ void BlitStage::initialize()
     m_screenAlignedQuad = new gloperate::ScreenAlignedQuad(
         globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "data/shaders/blit.frag")
     );
+    m_screenAlignedQuad->program()->setUniform("someBuffer", 0);
+    m_screenAlignedQuad->program()->setUniform("softRenderBuffer", 1);
+    m_softRenderBufferActiveUniform = m_screenAlignedQuad->program()->getUniform<bool>("softRenderBufferActive");
 
     m_currentMipLevel = 0;
 }
@@ -44,8 +53,10 @@ void BlitStage::initProperties(MultiFramePainter& painter)
     painter.addProperty<std::string>("Buffer",
         [this]() { return m_currentBuffer; },
         [this](const std::string & value) {
-            m_currentBuffer = value;
+            selectBuffer(value);
         })->setOption("choices", bufferNames);
+    selectBuffer(m_currentBuffer);
+
     painter.addProperty<int>("MipLevel",
         [this]() { return m_currentMipLevel; },
         [this](const int & value) {
@@ -57,31 +68,12 @@ void BlitStage::process()
 {
     AutoGLPerfCounter c("Blit");
 
-    globjects::ref_ptr<globjects::Texture> buffer;
-    for (auto b : m_buffers) {
-        std::string name = b->name();
-        if (b->name() == m_currentBuffer) {
-            buffer = b;
-            break;
-        }
-    }
+    m_screenAlignedQuad->program()->setUniform("singleChannel", m_singleChannel);
 
-    bool singleChannel =
-        m_currentBuffer.find("Occlusion") != std::string::npos ||
-        m_currentBuffer.find("Pull") != std::string::npos ||
-        m_currentBuffer.find("Push") != std::string::npos ||
-        m_currentBuffer.find("softrender") != std::string::npos ||
-        m_currentBuffer.find("Depth") != std::string::npos;
-    m_screenAlignedQuad->program()->setUniform("singleChannel", singleChannel);
-
-    buffer->bindActive(0);
-    buffer->bindActive(1);
-    m_screenAlignedQuad->program()->setUniform("someBuffer", 0);
-    m_screenAlignedQuad->program()->setUniform("softRenderBuffer", 1);
+    m_currentBufferTexture->bindActive(0);
+    m_currentBufferTexture->bindActive(1);
     m_screenAlignedQuad->program()->setUniform("mipLevel", m_currentMipLevel);
-
-    bool softRenderBufferActive = m_currentBuffer.find("softrender") != std::string::npos;
-    m_screenAlignedQuad->program()->setUniform("softRenderBufferActive", softRenderBufferActive);
+    m_softRenderBufferActiveUniform->set(m_softRenderBufferActive);
 
     auto viewportRect = std::array<GLint, 4>{ {
         viewport->x(),
@@ -114,3 +106,26 @@ void BlitStage::process()
     auto defaultFbo = globjects::Framebuffer::defaultFBO();
     m_fbo->blit(GL_COLOR_ATTACHMENT0, virtualViewportRect, defaultFbo, GL_BACK_LEFT, viewportRect, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 }
+
+void BlitStage::selectBuffer(const std::string & name)
+{
+    m_currentBuffer = name;
+
+    m_currentBufferTexture = nullptr;
+    for (auto b : m_buffers) {
+        if (b->name() == m_currentBuffer) {
+            m_currentBufferTexture = b;
+            break;
+        }
+    }
+
+    m_singleChannel =
+        m_currentBuffer.find("Occlusion") != std::string::npos ||
+        m_currentBuffer.find("Error") != std::string::npos ||
+        m_currentBuffer.find("Pull") != std::string::npos ||
+        m_currentBuffer.find("Push") != std::string::npos ||
+        m_currentBuffer.find("softrender") != std::string::npos ||
+        m_currentBuffer.find("Depth") != std::string::npos;
+
+    m_softRenderBufferActive = m_currentBuffer.find("softrender") != std::string::npos;
+}
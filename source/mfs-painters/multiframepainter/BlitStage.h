@@ -10,6 +10,7 @@ namespace globjects
 {
     class Framebuffer;
     class Texture;
+    template <typename T> class Uniform;
 }
 
 namespace gloperate
@@ -39,8 +40,15 @@ public:
 	std::vector<globjects::ref_ptr<globjects::Texture>> m_buffers;
 
 protected:
+    // resolves the buffer by name once, not every frame
+    void selectBuffer(const std::string & name);
+
     globjects::ref_ptr<globjects::Framebuffer> m_fbo;
     std::string m_currentBuffer;
+    globjects::Texture * m_currentBufferTexture;
+    bool m_singleChannel;
+    bool m_softRenderBufferActive;
     int m_currentMipLevel;
     globjects::ref_ptr<gloperate::ScreenAlignedQuad> m_screenAlignedQuad;
+    globjects::Uniform<bool> * m_softRenderBufferActiveUniform;
 };
@@ -0,0 +1,166 @@
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec4.hpp>
+#include <glm/vector_relational.hpp>
+
+
+namespace
+{
+    const uint32_t s_maxLeafSize = 4;
+
+    using Planes = std::array<glm::vec4, 6>;
+
+    // the planes of the clip volume in world space, pointing inwards (Gribb and Hartmann)
+    Planes extractPlanes(const glm::mat4 & transform)
+    {
+        auto row = [&transform](int i) {
+            return glm::vec4(transform[0][i], transform[1][i], transform[2][i], transform[3][i]);
+        };
+
+        return Planes{ {
+            row(3) + row(0), row(3) - row(0),
+            row(3) + row(1), row(3) - row(1),
+            row(3) + row(2), row(3) - row(2)
+        } };
+    }
+
+    enum class Containment
+    {
+        Outside,
+        Intersecting,
+        Inside
+    };
+
+    // planeMask has a bit for each plane the box still has to be tested against, the planes the box is inside of are cleared
+    Containment classify(const BoundingBox & box, const Planes & planes, uint32_t & planeMask)
+    {
+        for (auto i = 0u; i < planes.size(); ++i)
+        {
+            if (!(planeMask & (1u << i)))
+                continue;
+
+            auto normal = glm::vec3(planes[i]);
+            auto farthest = glm::mix(box.min, box.max, glm::greaterThan(normal, glm::vec3(0.0f)));
+            auto nearest = glm::mix(box.max, box.min, glm::greaterThan(normal, glm::vec3(0.0f)));
+
+            if (glm::dot(normal, farthest) + planes[i].w < 0.0f)
+                return Containment::Outside;
+
+            if (glm::dot(normal, nearest) + planes[i].w >= 0.0f)
+                planeMask &= ~(1u << i);
+        }
+
+        return planeMask == 0 ? Containment::Inside : Containment::Intersecting;
+    }
+}
+
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(const std::vector<BoundingBox> & boxes)
+: m_boxes(boxes)
+, m_indices(boxes.size())
+{
+    std::iota(m_indices.begin(), m_indices.end(), 0);
+
+    if (!boxes.empty())
+    {
+        m_nodes.reserve(2 * boxes.size());
+        build(0, static_cast<uint32_t>(boxes.size()));
+    }
+}
+
+uint32_t BoundingVolumeHierarchy::build(uint32_t first, uint32_t count)
+{
+    auto begin = m_indices.begin() + first;
+    auto end = begin + count;
+
+    auto bounds = m_boxes[*begin];
+    auto centerMin = (bounds.min + bounds.max) * 0.5f;
+    auto centerMax = centerMin;
+    for (auto index = begin; index != end; ++index)
+    {
+        const auto & box = m_boxes[*index];
+        bounds.min = glm::min(bounds.min, box.min);
+        bounds.max = glm::max(bounds.max, box.max);
+        centerMin = glm::min(centerMin, (box.min + box.max) * 0.5f);
+        centerMax = glm::max(centerMax, (box.min + box.max) * 0.5f);
+    }
+
+    auto nodeIndex = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back({ bounds, 0, first, count });
+
+    if (count <= s_maxLeafSize)
+        return nodeIndex;
+
+    auto extent = centerMax - centerMin;
+    auto axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    auto half = count / 2;
+    std::nth_element(begin, begin + half, end, [this, axis](uint32_t a, uint32_t b) {
+        return m_boxes[a].min[axis] + m_boxes[a].max[axis] < m_boxes[b].min[axis] + m_boxes[b].max[axis];
+    });
+
+    build(first, half);
+    auto secondChild = build(first + half, count - half);
+    m_nodes[nodeIndex].secondChild = secondChild;
+
+    return nodeIndex;
+}
+
+void BoundingVolumeHierarchy::cull(const glm::mat4 & transform, std::vector<uint32_t> & visible) const
+{
+    if (m_nodes.empty())
+        return;
+
+    auto planes = extractPlanes(transform);
+
+    struct StackEntry
+    {
+        uint32_t node;
+        uint32_t planeMask;
+    };
+
+    // the depth is logarithmic in the number of boxes
+    std::array<StackEntry, 64> stack;
+    auto stackSize = 0u;
+    stack[stackSize++] = { 0, (1u << planes.size()) - 1 };
+
+    while (stackSize > 0)
+    {
+        auto entry = stack[--stackSize];
+        const auto & node = m_nodes[entry.node];
+
+        auto containment = classify(node.bounds, planes, entry.planeMask);
+        if (containment == Containment::Outside)
+            continue;
+
+        if (containment == Containment::Inside)
+        {
+            visible.insert(visible.end(), m_indices.begin() + node.first, m_indices.begin() + node.first + node.count);
+            continue;
+        }
+
+        if (node.secondChild == 0)
+        {
+            for (auto i = node.first; i < node.first + node.count; ++i)
+            {
+                auto planeMask = entry.planeMask;
+                if (classify(m_boxes[m_indices[i]], planes, planeMask) != Containment::Outside)
+                    visible.push_back(m_indices[i]);
+            }
+            continue;
+        }
+
+        stack[stackSize++] = { node.secondChild, entry.planeMask };
+        stack[stackSize++] = { entry.node + 1, entry.planeMask };
+    }
+}
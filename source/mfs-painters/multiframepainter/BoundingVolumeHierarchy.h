@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+
+struct BoundingBox
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Binary hierarchy over a fixed set of boxes, split at the median of the longest axis.
+// Every node covers a contiguous range of the sorted box indices, so nodes that are completely
+// inside the frustum don't have to be traversed any further.
+class BoundingVolumeHierarchy
+{
+public:
+    BoundingVolumeHierarchy();
+    BoundingVolumeHierarchy(const std::vector<BoundingBox> & boxes);
+
+    // appends the indices of the boxes that intersect the clip volume of transform, in no particular order
+    void cull(const glm::mat4 & transform, std::vector<uint32_t> & visible) const;
+
+protected:
+    struct Node
+    {
+        BoundingBox bounds;
+        // the first child directly follows its parent, leaves have no second child
+        uint32_t secondChild;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    uint32_t build(uint32_t first, uint32_t count);
+
+    std::vector<BoundingBox> m_boxes;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_indices;
+};
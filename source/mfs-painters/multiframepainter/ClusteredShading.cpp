@@ -1,8 +1,7 @@
 #include "ClusteredShading.h"
 
-#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
 #include <glm/integer.hpp>
-#include <glm/gtc/matrix_inverse.hpp>
 
 #include <glbinding/gl/enum.h>
 #include <glbinding/gl/boolean.h>
@@ -25,19 +24,18 @@ using namespace gl;
 
 namespace
 {
-    const int clusterPixelSize = 128;
-    const int numDepthSlices = 16;
     const int maxVPLCount = 1024;
 }
 
 
 ClusteredShading::ClusteredShading()
+: m_width(0)
+, m_height(0)
+, m_numClustersX(0)
+, m_numClustersY(0)
+, m_numClusters(0)
 {
-
-    m_clusterIDProgram = new globjects::Program();
-    m_clusterIDProgram->attach(
-        globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/clustered_shading/clustering.comp")
-    );
+    createPrograms();
 
     compactUsedClusterIDs = globjects::Texture::createDefault(GL_TEXTURE_1D);
     compactUsedClusterIDs->setName("compact clusters2");
@@ -48,11 +46,6 @@ ClusteredShading::ClusteredShading()
     m_atomicCounter->setName("atomic counter");
     m_atomicCounter->setData(sizeof(gl::GLuint), nullptr, GL_STATIC_DRAW);
 
-    m_lightListsProgram = new globjects::Program();
-    m_lightListsProgram->attach(
-        globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/clustered_shading/light_lists.comp")
-    );
-
     //lightListsBuffer = new globjects::Buffer();
     lightLists = globjects::Texture::createDefault(GL_TEXTURE_2D);
     //lightLists->texBuffer(GL_R16UI, lightListsBuffer);
@@ -67,12 +60,33 @@ ClusteredShading::~ClusteredShading()
 
 }
 
+void ClusteredShading::createPrograms()
+{
+    m_clusterIDProgram = new globjects::Program();
+    m_clusterIDProgram->attach(
+        globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/clustered_shading/clustering.comp")
+    );
+
+    m_lightListsProgram = new globjects::Program();
+    m_lightListsProgram->attach(
+        globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/clustered_shading/light_lists.comp")
+    );
+}
+
+void ClusteredShading::setConfiguration(const PipelineConfiguration & configuration)
+{
+    if (configuration == m_configuration)
+        return;
+
+    m_configuration = configuration;
+    createPrograms();
+
+    if (m_width > 0 && m_height > 0)
+        resizeTexture(m_width, m_height);
+}
+
 void ClusteredShading::process(
     const VPLProcessor& vplProcessor,
-    const glm::mat4& view,
-    const glm::mat4& projection,
-    const glm::ivec2& viewport,
-    float zFar,
     int vplStartIndex,
     int vplEndIndex,
     globjects::ref_ptr<globjects::Texture> depthBuffer,
@@ -88,8 +102,6 @@ void ClusteredShading::process(
         lightListIds->bindImageTexture(1, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16UI);
         m_atomicCounter->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
         m_clusterIDProgram->setUniform("depthSampler", 0);
-        m_clusterIDProgram->setUniform("projectionMatrix", projection);
-        m_clusterIDProgram->setUniform("zFar", zFar);
         m_clusterIDProgram->dispatchCompute(m_numClustersX, m_numClustersY, 1);
     }
     {
@@ -100,13 +112,11 @@ void ClusteredShading::process(
         vplProcessor.packedVplBuffer->bindBase(GL_UNIFORM_BUFFER, 0);
         clusterCorners->bindImageTexture(2, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
         m_atomicCounter->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
-        m_lightListsProgram->setUniform("viewport", viewport);
-        m_lightListsProgram->setUniform("projectionMatrix", projection);
-        m_lightListsProgram->setUniform("viewProjectionInverseMatrix", glm::inverse(projection * view));
-        m_lightListsProgram->setUniform("zFar", zFar);
         m_lightListsProgram->setUniform("vplStartIndex", vplStartIndex);
         m_lightListsProgram->setUniform("vplEndIndex", vplEndIndex);
-        m_lightListsProgram->dispatchCompute(m_numClusters, 16, 1);
+        // one work group per sub-list of each cluster
+        auto subListCount = m_configuration.interleavedSize * m_configuration.interleavedSize;
+        m_lightListsProgram->dispatchCompute(m_numClusters, subListCount, 1);
         gl::glMemoryBarrier(gl::GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
     }
 }
@@ -114,6 +124,11 @@ void ClusteredShading::process(
 
 void ClusteredShading::resizeTexture(int width, int height)
 {
+    m_width = width;
+    m_height = height;
+
+    auto clusterPixelSize = m_configuration.clusterPixelSize;
+    auto numDepthSlices = m_configuration.clusterDepthSlices;
     m_numClustersX = int(glm::ceil(float(width) / clusterPixelSize));
     m_numClustersY = int(glm::ceil(float(height) / clusterPixelSize));
     m_numClusters = m_numClustersX * m_numClustersY * numDepthSlices;
@@ -4,6 +4,8 @@
 
 #include <globjects/base/ref_ptr.h>
 
+#include "PipelineConfiguration.h"
+
 namespace globjects
 {
     class Buffer;
@@ -29,15 +31,13 @@ public:
 
     void process(
         const VPLProcessor& vplProcessor,
-        const glm::mat4& view,
-        const glm::mat4& projection,
-        const glm::ivec2& viewport,
-        float zFar,
         int vplStartIndex,
         int vplEndIndex,
         globjects::ref_ptr<globjects::Texture> depthBuffer,
         const globjects::ref_ptr<globjects::Buffer> vplBuffer);
     void resizeTexture(int width, int height);
+    // rebuilds the programs, the configuration's named string has to be registered already
+    void setConfiguration(const PipelineConfiguration & configuration);
 
     globjects::ref_ptr<globjects::Buffer> vplBuffer;
     globjects::ref_ptr<globjects::Texture> compactUsedClusterIDs;
@@ -47,6 +47,11 @@ public:
     globjects::ref_ptr<globjects::Texture> clusterCorners;
 
 private:
+    void createPrograms();
+
+    PipelineConfiguration m_configuration;
+    int m_width;
+    int m_height;
     int m_numClustersX;
     int m_numClustersY;
     int m_numClusters;
@@ -8,6 +8,7 @@
 #include <globjects/Texture.h>
 #include <globjects/Program.h>
 #include <globjects/Framebuffer.h>
+#include <globjects/Uniform.h>
 
 #include <gloperate/primitives/ScreenAlignedQuad.h>
 #include <gloperate/painter/AbstractViewportCapability.h>
@@ -31,7 +32,11 @@ namespace
 }
 
 DeferredShadingStage::DeferredShadingStage()
-: m_exposure(1.0)
+: tileErrorThreshold(-1.0f)
+, m_tileErrorThresholdUniform(nullptr)
+, m_biasedLightViewProjectionUniform(nullptr)
+, m_inverseLightDirectionUniform(nullptr)
+, m_areaLightShadowsUniform(nullptr)
 {
 }
 
@@ -41,18 +46,6 @@ DeferredShadingStage::~DeferredShadingStage()
 
 void DeferredShadingStage::initProperties(MultiFramePainter& painter)
 {
-
-    auto group = painter.addGroup("DeferredShading");
-    group->addProperty<float>("Exposure",
-        [this]() { return m_exposure; },
-        [this](const float & exposure) {
-            m_exposure = exposure;
-        }
-    )->setOptions({
-        { "minimum", 0.0f },
-        { "step", 0.1f },
-        { "precision", 2u },
-    });
 }
 
 
@@ -70,6 +63,18 @@ void DeferredShadingStage::initialize()
         globjects::Shader::fromFile(GL_VERTEX_SHADER, "data/shaders/deferredshading.vert"),
         globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "data/shaders/deferredshading.frag"));
 
+    m_program->setUniform("diffuseSampler", 0);
+    m_program->setUniform("normalSampler", 1);
+    m_program->setUniform("depthSampler", 2);
+    m_program->setUniform("shadowmap", 3);
+    m_program->setUniform("giSampler", 4);
+    m_program->setUniform("occlusionSampler", 5);
+    m_program->setUniform("tileErrorSampler", 6);
+    m_tileErrorThresholdUniform = m_program->getUniform<float>("tileErrorThreshold");
+    m_biasedLightViewProjectionUniform = m_program->getUniform<glm::mat4>("biasedLightViewProjectionMatrix");
+    m_inverseLightDirectionUniform = m_program->getUniform<glm::vec3>("normalizedInverseLightDirection");
+    m_areaLightShadowsUniform = m_program->getUniform<bool>("areaLightShadows");
+
     m_screenAlignedQuad = new gloperate::ScreenAlignedQuad(m_program);
 }
 
@@ -82,8 +87,6 @@ void DeferredShadingStage::process()
         viewport->width(),
         viewport->height());
 
-    const auto screenSize = glm::vec2(viewport->width(), viewport->height());
-
     if (viewport->hasChanged())
         resizeTexture(viewport->width(), viewport->height());
 
@@ -91,39 +94,23 @@ void DeferredShadingStage::process()
     m_fbo->setDrawBuffer(GL_COLOR_ATTACHMENT0);
 
     diffuseBuffer->bindActive(0);
-    specularBuffer->bindActive(1);
-    faceNormalBuffer->bindActive(2);
-    normalBuffer->bindActive(3);
-    depthBuffer->bindActive(4);
-    shadowmap->bindActive(5);
-    giBuffer->bindActive(6);
-    occlusionBuffer->bindActive(7);
-
-
-    m_screenAlignedQuad->program()->setUniform("diffuseSampler", 0);
-    m_screenAlignedQuad->program()->setUniform("specularSampler", 1);
-    m_screenAlignedQuad->program()->setUniform("faceNormalSampler", 2);
-    m_screenAlignedQuad->program()->setUniform("normalSampler", 3);
-    m_screenAlignedQuad->program()->setUniform("depthSampler", 4);
-    m_screenAlignedQuad->program()->setUniform("shadowmap", 5);
-    m_screenAlignedQuad->program()->setUniform("giSampler", 6);
-    m_screenAlignedQuad->program()->setUniform("occlusionSampler", 7);
-
-    m_screenAlignedQuad->program()->setUniform("projectionMatrix", projection->projection());
-    m_screenAlignedQuad->program()->setUniform("projectionInverseMatrix", projection->projectionInverted());
-    m_screenAlignedQuad->program()->setUniform("viewMatrix", camera->view());
-    m_screenAlignedQuad->program()->setUniform("viewInvertedMatrix", camera->viewInverted());
-    m_screenAlignedQuad->program()->setUniform("biasedLightViewProjectionMatrix", *biasedShadowTransform);
-    m_screenAlignedQuad->program()->setUniform("cameraEye", camera->eye());
-    m_screenAlignedQuad->program()->setUniform("zFar", projection->zFar());
-    m_screenAlignedQuad->program()->setUniform("zNear", projection->zNear());
-    m_screenAlignedQuad->program()->setUniform("screenSize", screenSize);
+    normalBuffer->bindActive(1);
+    depthBuffer->bindActive(2);
+    shadowmap->bindActive(3);
+    giBuffer->bindActive(4);
+    occlusionBuffer->bindActive(5);
+    tileError->bindActive(6);
+
+
+    m_tileErrorThresholdUniform->set(tileErrorThreshold);
+
+    m_biasedLightViewProjectionUniform->set(*biasedShadowTransform);
 
     m_screenAlignedQuad->program()->setUniform("worldLightPos", *lightPosition);
     m_screenAlignedQuad->program()->setUniform("lightDirection", *lightDirection);
-    m_screenAlignedQuad->program()->setUniform("normalizedInverseLightDirection", -glm::normalize(*lightDirection));
+    m_inverseLightDirectionUniform->set(-glm::normalize(*lightDirection));
     m_screenAlignedQuad->program()->setUniform("lightIntensity", *lightIntensity);
-    m_screenAlignedQuad->program()->setUniform("exposure", m_exposure);
+    m_areaLightShadowsUniform->set(*areaLightShadows);
 
     m_screenAlignedQuad->draw();
 
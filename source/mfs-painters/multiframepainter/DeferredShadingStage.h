@@ -13,6 +13,7 @@ namespace globjects
     class Framebuffer;
     class Texture;
     class Program;
+    template <typename T> class Uniform;
 }
 
 namespace gloperate
@@ -42,18 +43,20 @@ public:
     gloperate::AbstractViewportCapability * viewport;
     gloperate::AbstractCameraCapability * camera;
 
+    // the compact camera G-buffer, see gbuffer_packing.glsl
     globjects::ref_ptr<globjects::Texture> diffuseBuffer;
-    globjects::ref_ptr<globjects::Texture> specularBuffer;
+    globjects::ref_ptr<globjects::Texture> normalBuffer;
     globjects::ref_ptr<globjects::Texture> giBuffer;
     globjects::ref_ptr<globjects::Texture> occlusionBuffer;
-    globjects::ref_ptr<globjects::Texture> faceNormalBuffer;
-    globjects::ref_ptr<globjects::Texture> normalBuffer;
     globjects::ref_ptr<globjects::Texture> depthBuffer;
     globjects::ref_ptr<globjects::Texture> shadowmap;
+    globjects::ref_ptr<globjects::Texture> tileError;
+    float tileErrorThreshold;
     glm::mat4* biasedShadowTransform;
     glm::vec3* lightPosition;
     glm::vec3* lightDirection;
     float* lightIntensity;
+    bool* areaLightShadows;
 
     globjects::ref_ptr<globjects::Texture> shadedFrame;
 
@@ -63,6 +66,9 @@ protected:
     globjects::ref_ptr<globjects::Framebuffer> m_fbo;
     globjects::ref_ptr<gloperate::ScreenAlignedQuad> m_screenAlignedQuad;
     globjects::ref_ptr<globjects::Program> m_program;
-
-    float m_exposure;
+    // names past the small string buffer, cached so the per-frame updates stay allocation free
+    globjects::Uniform<float> * m_tileErrorThresholdUniform;
+    globjects::Uniform<glm::mat4> * m_biasedLightViewProjectionUniform;
+    globjects::Uniform<glm::vec3> * m_inverseLightDirectionUniform;
+    globjects::Uniform<bool> * m_areaLightShadowsUniform;
 };
@@ -0,0 +1,33 @@
+#include "FileUtils.h"
+
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+
+bool writeFileAtomically(const std::string & filename, const std::function<void(std::ostream &)> & write)
+{
+    auto tempFilename = filename + ".tmp";
+
+    std::ofstream stream(tempFilename, std::ios::binary | std::ios::trunc);
+    write(stream);
+
+    // some write errors only show up when the buffered data is flushed
+    stream.close();
+    if (!stream)
+    {
+        std::remove(tempFilename.c_str());
+        return false;
+    }
+
+    // both replace an existing file in one step, readers see either the old or the new file
+#ifdef _WIN32
+    return MoveFileExA(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(tempFilename.c_str(), filename.c_str()) == 0;
+#endif
+}
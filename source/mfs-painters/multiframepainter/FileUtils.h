@@ -0,0 +1,11 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+
+// writes the file through write() into a temporary file first and renames that over filename afterwards, so an
+// interrupted or failed write can't corrupt an existing file and concurrent readers never see a partial one.
+// false if writing or renaming failed, filename is left untouched in the first case
+bool writeFileAtomically(const std::string & filename, const std::function<void(std::ostream &)> & write);
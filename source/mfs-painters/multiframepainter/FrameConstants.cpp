@@ -0,0 +1,107 @@
+#include "FrameConstants.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glm/mat3x3.hpp>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/bitfield.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/values.h>
+
+#include <globjects/Buffer.h>
+
+#include <gloperate/painter/AbstractCameraCapability.h>
+#include <gloperate/painter/AbstractPerspectiveProjectionCapability.h>
+#include <gloperate/painter/AbstractViewportCapability.h>
+
+using namespace gl;
+
+
+FrameConstants::FrameConstants()
+: m_data(nullptr)
+, m_slotSize(0)
+, m_currentSlot(0)
+{
+    m_fences.fill(nullptr);
+
+    static_assert(sizeof(Constants) == 480, "FrameConstants::Constants has to match the std140 layout of frame_constants.glsl");
+}
+
+FrameConstants::~FrameConstants()
+{
+    for (auto fence : m_fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+
+    if (m_buffer)
+        m_buffer->unmap();
+}
+
+void FrameConstants::initialize()
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    auto slotAlignment = static_cast<size_t>(std::max(alignment, 1));
+    m_slotSize = (sizeof(Constants) + slotAlignment - 1) / slotAlignment * slotAlignment;
+
+    auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    m_buffer = new globjects::Buffer();
+    m_buffer->setName("Frame Constants");
+    m_buffer->setStorage(SlotCount * m_slotSize, nullptr, flags);
+    m_data = static_cast<unsigned char *>(m_buffer->mapRange(0, SlotCount * m_slotSize, flags));
+
+    m_currentSlot = 0;
+}
+
+void FrameConstants::update(
+    const gloperate::AbstractCameraCapability & camera,
+    const gloperate::AbstractPerspectiveProjectionCapability & projection,
+    const gloperate::AbstractViewportCapability & viewport)
+{
+    if (!m_buffer)
+    {
+        initialize();
+    }
+    else
+    {
+        // the previous frame's commands read from the current slot
+        m_fences[m_currentSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+        m_currentSlot = (m_currentSlot + 1) % SlotCount;
+    }
+
+    auto & fence = m_fences[m_currentSlot];
+    if (fence)
+    {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    const auto normal = camera.normal();
+
+    Constants constants;
+    constants.view = camera.view();
+    constants.viewInverted = camera.viewInverted();
+    constants.projection = projection.projection();
+    constants.projectionInverted = projection.projectionInverted();
+    constants.viewProjection = constants.projection * constants.view;
+    constants.viewProjectionInverted = constants.viewInverted * constants.projectionInverted;
+    for (auto i = 0; i < 3; ++i)
+        constants.normal[i] = glm::vec4(normal[i], 0.f);
+    constants.eye = camera.eye();
+    constants.zNear = projection.zNear();
+    constants.viewport = glm::ivec2(viewport.width(), viewport.height());
+    constants.screenSize = glm::vec2(constants.viewport);
+    constants.zFar = projection.zFar();
+    constants.padding[0] = constants.padding[1] = constants.padding[2] = 0.f;
+
+    auto offset = m_currentSlot * m_slotSize;
+    std::memcpy(m_data + offset, &constants, sizeof(Constants));
+
+    m_buffer->bindRange(GL_UNIFORM_BUFFER, Binding, offset, sizeof(Constants));
+}
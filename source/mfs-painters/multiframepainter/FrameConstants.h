@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <glbinding/gl/types.h>
+
+#include <globjects/base/ref_ptr.h>
+
+namespace globjects
+{
+    class Buffer;
+}
+
+namespace gloperate
+{
+    class AbstractCameraCapability;
+    class AbstractPerspectiveProjectionCapability;
+    class AbstractViewportCapability;
+}
+
+
+// The camera matrices and derived values that most passes of a frame share, in a uniform block instead of
+// per program uniforms set by name. The block lives in a persistently mapped buffer with a slot for each frame
+// in flight, so writing the next frame's constants never waits for the GPU to finish reading the previous ones.
+class FrameConstants
+{
+public:
+    // has to match frame_constants.glsl
+    static const gl::GLuint Binding = 2;
+
+    FrameConstants();
+    ~FrameConstants();
+
+    // call once per frame before rendering: writes the constants into the next slot and binds it
+    void update(
+        const gloperate::AbstractCameraCapability & camera,
+        const gloperate::AbstractPerspectiveProjectionCapability & projection,
+        const gloperate::AbstractViewportCapability & viewport);
+
+protected:
+    // frames the CPU may be ahead of the GPU before update() has to wait
+    static const size_t SlotCount = 3;
+
+    // std140 layout of frame_constants.glsl
+    struct Constants
+    {
+        glm::mat4 view;
+        glm::mat4 viewInverted;
+        glm::mat4 projection;
+        glm::mat4 projectionInverted;
+        glm::mat4 viewProjection;
+        glm::mat4 viewProjectionInverted;
+        // a mat3 has the stride of a mat4 column
+        glm::vec4 normal[3];
+        glm::vec3 eye;
+        float zNear;
+        glm::ivec2 viewport;
+        glm::vec2 screenSize;
+        float zFar;
+        float padding[3];
+    };
+
+    void initialize();
+
+    globjects::ref_ptr<globjects::Buffer> m_buffer;
+    unsigned char * m_data;
+    size_t m_slotSize;
+
+    // raw sync objects, a globjects::Sync would be allocated for every frame
+    std::array<gl::GLsync, SlotCount> m_fences;
+    size_t m_currentSlot;
+};
@@ -12,6 +12,7 @@
 #include <globjects/Program.h>
 #include <globjects/Framebuffer.h>
 #include <globjects/Shader.h>
+#include <globjects/Uniform.h>
 
 #include <gloperate/painter/CameraCapability.h>
 #include <gloperate/painter/OrthographicProjectionCapability.h>
@@ -20,17 +21,27 @@
 
 #include <reflectionzeug/property/extensions/GlmProperties.h>
 
+#include "KernelGenerationStage.h"
 #include "ModelLoadingStage.h"
 #include "MultiFramePainter.h"
 #include "PerfCounter.h"
 #include "ImperfectShadowmap.h"
+#include "SurfelCloud.h"
 #include "ClusteredShading.h"
 #include "VPLProcessor.h"
 
 using namespace gl;
 
 GIStage::GIStage(ModelLoadingStage& modelLoadingStage, KernelGenerationStage& kernelGenerationStage)
-: modelLoadingStage(modelLoadingStage)
+: currentFrame(1)
+, tileErrorThreshold(-1.0f)
+, modelLoadingStage(modelLoadingStage)
+, kernelGenerationStage(kernelGenerationStage)
+, m_giTileErrorThresholdUniform(nullptr)
+, m_giIntensityFactorUniform(nullptr)
+, m_vplClampingValueUniform(nullptr)
+, m_blurXTileErrorThresholdUniform(nullptr)
+, m_blurYTileErrorThresholdUniform(nullptr)
 {
     rsmRenderer = std::make_unique<RasterizationStage>("RSM", modelLoadingStage, kernelGenerationStage, true);
     m_lightCamera = std::make_unique<gloperate::CameraCapability>();
@@ -47,7 +58,8 @@ void GIStage::initProperties(MultiFramePainter& painter)
 {
     painter.addProperty<glm::vec3>("RSMLightPosition",
         [this]() { return m_lightCamera->eye(); },
-        [this](const glm::vec3 & pos) {
+        [this, &painter](const glm::vec3 & pos) {
+            painter.resetAccumulation();
             m_lightCamera->setEye(pos);
         });
     //painter.addProperty<glm::vec3>("RSMLightDirection",
@@ -57,30 +69,35 @@ void GIStage::initProperties(MultiFramePainter& painter)
     //    });
     painter.addProperty<glm::vec3>("RSMLightCenter",
         [this]() { return m_lightCamera->center(); },
-        [this](const glm::vec3 & center) {
+        [this, &painter](const glm::vec3 & center) {
+            painter.resetAccumulation();
             m_lightCamera->setCenter(center);
         });
 
     painter.addProperty<bool>("MoveSun",
         [this]() { return moveLight; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+        painter.resetAccumulation();
         moveLight = value;
     });
 
     painter.addProperty<float>("SunCyclePosition",
         [this]() { return sunCyclePosition; },
-        [this](const float & value) {
+        [this, &painter](const float & value) {
+            painter.resetAccumulation();
             sunCyclePosition = value;
         });
     painter.addProperty<float>("SunCycleSpeed",
         [this]() { return sunCycleSpeed; },
-        [this](const float & value) {
+        [this, &painter](const float & value) {
+            painter.resetAccumulation();
             sunCycleSpeed = value;
     });
 
     painter.addProperty<float>("LightIntensity",
         [this]() { return lightIntensity; },
-        [this](const float & intensity) {
+        [this, &painter](const float & intensity) {
+            painter.resetAccumulation();
             lightIntensity = intensity;
         }
     )->setOptions({
@@ -89,9 +106,30 @@ void GIStage::initProperties(MultiFramePainter& painter)
         { "precision", 2u },
     });
 
+    painter.addProperty<bool>("AreaLightShadows",
+        [this]() { return areaLightShadows; },
+        [this, &painter](const bool & value) {
+            painter.resetAccumulation();
+            areaLightShadows = value;
+    });
+
+    // offset of the jittered light positions, the light is 4 units away from its center
+    painter.addProperty<float>("AreaLightSize",
+        [this]() { return areaLightSize; },
+        [this, &painter](const float & size) {
+            painter.resetAccumulation();
+            areaLightSize = size;
+        }
+    )->setOptions({
+        { "minimum", 0.0f },
+        { "step", 0.05f },
+        { "precision", 2u },
+    });
+
     painter.addProperty<float>("GIIntensityFactor",
         [this]() { return giIntensityFactor; },
-        [this](const float & factor) {
+        [this, &painter](const float & factor) {
+            painter.resetAccumulation();
             giIntensityFactor = factor;
         }
     )->setOptions({
@@ -102,7 +140,8 @@ void GIStage::initProperties(MultiFramePainter& painter)
 
     painter.addProperty<float>("VPLClampingValue",
         [this]() { return vplClampingValue; },
-        [this](const float & value) {
+        [this, &painter](const float & value) {
+            painter.resetAccumulation();
             vplClampingValue = value;
         }
     )->setOptions({
@@ -113,7 +152,8 @@ void GIStage::initProperties(MultiFramePainter& painter)
 
     painter.addProperty<int>("VPLStartIndex",
         [this]() { return vplStartIndex; },
-        [this](const int & value) {
+        [this, &painter](const int & value) {
+            painter.resetAccumulation();
             if (value < vplEndIndex)
                 vplStartIndex = value;
         }
@@ -124,7 +164,8 @@ void GIStage::initProperties(MultiFramePainter& painter)
 
     painter.addProperty<int>("VPLEndIndex",
         [this]() { return vplEndIndex; },
-        [this](const int & value) {
+        [this, &painter](const int & value) {
+            painter.resetAccumulation();
             if (value > vplStartIndex)
                 vplEndIndex = value;
         }
@@ -135,19 +176,22 @@ void GIStage::initProperties(MultiFramePainter& painter)
 
     painter.addProperty<bool>("ScaleISMs",
         [this]() { return scaleISMs; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+            painter.resetAccumulation();
             scaleISMs = value;
     });
 
     painter.addProperty<bool>("PointsOnlyToScaledISMs",
         [this]() { return pointsOnlyIntoScaledISMs; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+            painter.resetAccumulation();
             pointsOnlyIntoScaledISMs = value;
     });
 
     painter.addProperty<float>("TessLevelFactor",
         [this]() { return tessLevelFactor; },
-        [this](const float & value) {
+        [this, &painter](const float & value) {
+            painter.resetAccumulation();
             tessLevelFactor = value;
         }
     )->setOptions({
@@ -158,36 +202,49 @@ void GIStage::initProperties(MultiFramePainter& painter)
 
     painter.addProperty<bool>("UsePushPull",
         [this]() { return usePushPull; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+        painter.resetAccumulation();
         usePushPull = value;
     });
 
     painter.addProperty<bool>("GIShadowing",
         [this]() { return enableShadowing; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+            painter.resetAccumulation();
             enableShadowing = value;
             giShaderRebuildRequired = true;
     });
 
     painter.addProperty<bool>("ShowVPLPositions",
         [this]() { return showVPLPositions; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+            painter.resetAccumulation();
             showVPLPositions = value;
             giShaderRebuildRequired = true;
     });
 
     painter.addProperty<bool>("UseInterleaving",
         [this]() { return useInterleaving; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+            painter.resetAccumulation();
             useInterleaving = value;
             giShaderRebuildRequired = true;
     });
 
     painter.addProperty<bool>("ShuffleLights",
         [this]() { return shuffleLights; },
-        [this](const bool & value) {
+        [this, &painter](const bool & value) {
+        painter.resetAccumulation();
         shuffleLights = value;
     });
+
+    // samples different RSM positions every frame, accumulation integrates over all of them
+    painter.addProperty<bool>("JitterVPLs",
+        [this]() { return jitterVPLs; },
+        [this, &painter](const bool & value) {
+            painter.resetAccumulation();
+            jitterVPLs = value;
+    });
 }
 
 void GIStage::initialize()
@@ -210,9 +267,10 @@ void GIStage::initialize()
     m_blurFinalFbo = new globjects::Framebuffer();
     m_blurFinalFbo->attachTexture(GL_COLOR_ATTACHMENT0, giBlurFinalBuffer);
 
-    m_lightCamera->setEye(modelLoadingStage.getCurrentPresetInformation().lightPosition);
-    m_lightCamera->setCenter(modelLoadingStage.getCurrentPresetInformation().lightCenter);
+    loadPreset(modelLoadingStage.getCurrentPresetInformation());
     lightIntensity = 5.0f;
+    areaLightShadows = true;
+    areaLightSize = 0.2f;
 
     giIntensityFactor = 3000.0f;
     vplClampingValue = 0.001f;
@@ -230,6 +288,7 @@ void GIStage::initialize()
 
     useInterleaving = true;
     shuffleLights = true;
+    jitterVPLs = true;
 
     rsmRenderer->camera = m_lightCamera.get();
 
@@ -245,6 +304,7 @@ void GIStage::initialize()
     rsmRenderer->initialize();
 
     ism = std::make_unique<ImperfectShadowmap>();
+    surfelCloud = std::make_unique<SurfelCloud>();
     vplProcessor = std::make_unique<VPLProcessor>();
     clusteredShading = std::make_unique<ClusteredShading>();
 
@@ -267,35 +327,26 @@ void GIStage::render()
     clusteredShading->lightListIds->bindImageTexture(1, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R16UI);
     clusteredShading->lightLists->bindImageTexture(2, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R16UI);
 
-    faceNormalBuffer->bindActive(0);
+    normalBuffer->bindActive(0);
     depthBuffer->bindActive(1);
     auto ismShadowMap = usePushPull ? ism->pushPullResultBuffer : ism->depthBuffer;
     ismShadowMap->bindActive(2);
+    tileError->bindActive(3);
 
     auto viewProjectionInvertedMatrix = camera->viewInverted() * projection->projectionInverted();
 
 
     vplProcessor->vplBuffer->bindBase(GL_UNIFORM_BUFFER, 0);
 
-    m_giProgram->setUniform("faceNormalSampler", 0);
-    m_giProgram->setUniform("depthSampler", 1);
-    m_giProgram->setUniform("ismDepthSampler", 2);
+    m_giTileErrorThresholdUniform->set(tileErrorThreshold);
 
-    m_giProgram->setUniform("projectionMatrix", projection->projection());
-    m_giProgram->setUniform("projectionInverseMatrix", projection->projectionInverted());
-    m_giProgram->setUniform("viewport", glm::ivec2(viewport->width(), viewport->height()));
-    m_giProgram->setUniform("viewMatrix", camera->view());
-    m_giProgram->setUniform("viewInvertedMatrix", camera->viewInverted());
-    m_giProgram->setUniform("viewProjectionInvertedMatrix", camera->viewInverted() * projection->projectionInverted());
-    m_giProgram->setUniform("zFar", projection->zFar());
-    m_giProgram->setUniform("zNear", projection->zNear());
-    m_giProgram->setUniform("giIntensityFactor", giIntensityFactor);
-    m_giProgram->setUniform("vplClampingValue", vplClampingValue);
+    m_giIntensityFactorUniform->set(giIntensityFactor);
+    m_vplClampingValueUniform->set(vplClampingValue);
     m_giProgram->setUniform("vplStartIndex", vplStartIndex);
     m_giProgram->setUniform("vplEndIndex", vplEndIndex);
 
-    int workgroupSize = 8;
-    int interleavedSize = 4;
+    int workgroupSize = m_configuration.giWorkGroupSize;
+    int interleavedSize = useInterleaving ? m_configuration.interleavedSize : 1;
     // the interleavedSize is used to round up to make sure everything is covered at the image borders
     int numGroupsX = divCeil(viewport->width(),  workgroupSize * interleavedSize) * interleavedSize;
     int numGroupsY = divCeil(viewport->height(), workgroupSize * interleavedSize) * interleavedSize;
@@ -308,18 +359,14 @@ void GIStage::render()
 void GIStage::blur()
 {
     giBuffer->bindActive(0); 
-    faceNormalBuffer->bindActive(1);
+    normalBuffer->bindActive(1);
     depthBuffer->bindActive(2);
+    tileError->bindActive(3);
 
     m_blurTempFbo->bind();
     m_blurTempFbo->setDrawBuffer(GL_COLOR_ATTACHMENT0);
 
-    m_blurXScreenAlignedQuad->program()->setUniform("giSampler", 0);
-    m_blurXScreenAlignedQuad->program()->setUniform("faceNormalSampler", 1);
-    m_blurXScreenAlignedQuad->program()->setUniform("depthSampler", 2);
-
-    m_blurXScreenAlignedQuad->program()->setUniform("projectionMatrix", projection->projection());
-    m_blurXScreenAlignedQuad->program()->setUniform("projectionInverseMatrix", projection->projectionInverted());
+    m_blurXTileErrorThresholdUniform->set(tileErrorThreshold);
 
     m_blurXScreenAlignedQuad->draw();
 
@@ -331,18 +378,23 @@ void GIStage::blur()
     m_blurFinalFbo->bind();
     m_blurFinalFbo->setDrawBuffer(GL_COLOR_ATTACHMENT0);
 
-    m_blurYScreenAlignedQuad->program()->setUniform("giSampler", 0);
-    m_blurYScreenAlignedQuad->program()->setUniform("faceNormalSampler", 1);
-    m_blurYScreenAlignedQuad->program()->setUniform("depthSampler", 2);
-
-    m_blurYScreenAlignedQuad->program()->setUniform("projectionMatrix", projection->projection());
-    m_blurYScreenAlignedQuad->program()->setUniform("projectionInverseMatrix", projection->projectionInverted());
+    m_blurYTileErrorThresholdUniform->set(tileErrorThreshold);
 
     m_blurYScreenAlignedQuad->draw();
 
     m_blurFinalFbo->unbind();
 }
 
+void GIStage::loadPreset(const PresetInformation& preset)
+{
+    m_lightCamera->setEye(preset.lightPosition);
+    m_lightCamera->setCenter(preset.lightCenter);
+
+    // the scene may have changed
+    if (surfelCloud)
+        surfelCloud->invalidate();
+}
+
 void GIStage::process()
 {
     if (viewport->hasChanged())
@@ -359,6 +411,13 @@ void GIStage::process()
     float radians = glm::radians(degree);
     glm::vec3 direction = { 0.0, -glm::sin(radians), glm::cos(radians) };
     m_lightCamera->setEye(m_lightCamera->center() - (direction * 4.0f));
+    if (areaLightShadows) {
+        auto sampleIndex = static_cast<size_t>(currentFrame - 1) % kernelGenerationStage.shadowKernel.size();
+        auto lightSample = kernelGenerationStage.shadowKernel[sampleIndex] * areaLightSize;
+        auto tangent = glm::normalize(glm::cross(direction, glm::vec3(1.0f, 0.0f, 0.0f)));
+        auto bitangent = glm::cross(tangent, direction);
+        m_lightCamera->setEye(m_lightCamera->eye() + tangent * lightSample.x + bitangent * lightSample.y);
+    }
     if (moveLight) {
         sunCyclePosition += sunCycleSpeed;
         sunCyclePosition = glm::mod(sunCyclePosition, degreeSpan * 2);
@@ -372,12 +431,19 @@ void GIStage::process()
 
     {
         AutoGLPerfCounter c("VPLP");
-        vplProcessor->process(*rsmRenderer.get(), lightIntensity, shuffleLights);
+        auto sampleIndex = static_cast<size_t>(currentFrame - 1) % kernelGenerationStage.vplKernel.size();
+        auto samplingOffset = jitterVPLs ? kernelGenerationStage.vplKernel[sampleIndex] : glm::vec2(0.0f);
+        vplProcessor->process(*rsmRenderer.get(), lightIntensity, shuffleLights, samplingOffset);
     }
 
+    if (usePushPull)
+        surfelCloud->update(modelLoadingStage.getSceneGeometry(), modelLoadingStage.getDrawablesMap(), tessLevelFactor);
+
     {
         ism->process(
+            modelLoadingStage.getSceneGeometry(),
             modelLoadingStage.getDrawablesMap(),
+            *surfelCloud.get(),
             *vplProcessor.get(),
             vplStartIndex,
             vplEndIndex,
@@ -392,10 +458,6 @@ void GIStage::process()
     {
         clusteredShading->process(
             *vplProcessor.get(),
-            camera->view(),
-            projection->projection(),
-            glm::ivec2(viewport->width(), viewport->height()),
-            projection->zFar(),
             vplStartIndex,
             vplEndIndex,
             depthBuffer,
@@ -422,6 +484,20 @@ const char * const boolToString(bool b)
     return b ? "true" : "false";
 }
 
+void GIStage::setConfiguration(const PipelineConfiguration & configuration)
+{
+    m_configuration = configuration;
+
+    rsmRenderer->useZPrepass = configuration.zPrepass;
+    clusteredShading->setConfiguration(configuration);
+    giShaderRebuildRequired = true;
+}
+
+bool GIStage::lightMoving() const
+{
+    return moveLight;
+}
+
 void GIStage::rebuildGIShader()
 {
     globjects::Shader::globalReplace("#define SHOW_VPL_POSITIONS false", std::string("#define SHOW_VPL_POSITIONS ") + boolToString(showVPLPositions));
@@ -435,6 +511,14 @@ void GIStage::rebuildGIShader()
     m_giProgram = new globjects::Program();
     m_giProgram->attach(shader);
 
+    m_giProgram->setUniform("normalSampler", 0);
+    m_giProgram->setUniform("depthSampler", 1);
+    m_giProgram->setUniform("ismDepthSampler", 2);
+    m_giProgram->setUniform("tileErrorSampler", 3);
+    m_giTileErrorThresholdUniform = m_giProgram->getUniform<float>("tileErrorThreshold");
+    m_giIntensityFactorUniform = m_giProgram->getUniform<float>("giIntensityFactor");
+    m_vplClampingValueUniform = m_giProgram->getUniform<float>("vplClampingValue");
+
     giShaderRebuildRequired = false;
 }
 
@@ -459,6 +543,16 @@ void GIStage::rebuildBlurShaders()
         globjects::Shader::fromFile(GL_VERTEX_SHADER, "data/shaders/deferredshading.vert"),
         blurFragShaderY);
 
+    for (auto program : { blurXProgram, blurYProgram })
+    {
+        program->setUniform("giSampler", 0);
+        program->setUniform("normalSampler", 1);
+        program->setUniform("depthSampler", 2);
+        program->setUniform("tileErrorSampler", 3);
+    }
+    m_blurXTileErrorThresholdUniform = blurXProgram->getUniform<float>("tileErrorThreshold");
+    m_blurYTileErrorThresholdUniform = blurYProgram->getUniform<float>("tileErrorThreshold");
+
     m_blurXScreenAlignedQuad = new gloperate::ScreenAlignedQuad(blurXProgram);
     m_blurYScreenAlignedQuad = new gloperate::ScreenAlignedQuad(blurYProgram);
 
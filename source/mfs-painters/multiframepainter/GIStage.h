@@ -6,6 +6,7 @@
 
 #include "RasterizationStage.h"
 #include "ModelLoadingStage.h"
+#include "PipelineConfiguration.h"
 
 
 namespace globjects
@@ -13,6 +14,7 @@ namespace globjects
     class Program;
     class Framebuffer;
     class Texture;
+    template <typename T> class Uniform;
 }
 
 namespace gloperate
@@ -27,6 +29,7 @@ class ImperfectShadowmap;
 class ModelLoadingStage;
 class VPLProcessor;
 class ClusteredShading;
+class SurfelCloud;
 
 
 class GIStage
@@ -37,21 +40,39 @@ public:
 
     void initProperties(MultiFramePainter& painter);
     void initialize();
+    void loadPreset(const PresetInformation& preset);
     void process();
 
-    globjects::ref_ptr<globjects::Texture> faceNormalBuffer;
+    // the GI program is rebuilt with the next process(), the configuration's named string has to be registered already
+    void setConfiguration(const PipelineConfiguration & configuration);
+
+    bool lightMoving() const;
+
+    // the packed normals of the camera's G-buffer, see gbuffer_packing.glsl
+    globjects::ref_ptr<globjects::Texture> normalBuffer;
     globjects::ref_ptr<globjects::Texture> depthBuffer;
 
     globjects::ref_ptr<globjects::Texture> giBuffer;
     globjects::ref_ptr<globjects::Texture> giBlurTempBuffer;
     globjects::ref_ptr<globjects::Texture> giBlurFinalBuffer;
+
+    // converged tiles are skipped, see AccumulationStage::tileMaskThreshold()
+    globjects::ref_ptr<globjects::Texture> tileError;
+    float tileErrorThreshold;
+
     std::unique_ptr<ImperfectShadowmap> ism;
+    std::unique_ptr<SurfelCloud> surfelCloud;
     std::unique_ptr<VPLProcessor> vplProcessor;
     std::unique_ptr<ClusteredShading> clusteredShading;
 
     glm::vec3 lightPosition;
     glm::vec3 lightDirection;
     float lightIntensity;
+    // the light position is jittered across the shadow kernel each frame, accumulation integrates the penumbra
+    bool areaLightShadows;
+
+    // 1-based sample index, selects the light position sample
+    int currentFrame;
 
     std::unique_ptr<RasterizationStage> rsmRenderer;
 
@@ -60,6 +81,7 @@ public:
     gloperate::AbstractCameraCapability * camera;
 
     ModelLoadingStage& modelLoadingStage;
+    KernelGenerationStage& kernelGenerationStage;
 
 
 protected:
@@ -76,11 +98,20 @@ protected:
     globjects::ref_ptr<globjects::Program> m_giProgram;
     globjects::ref_ptr<gloperate::ScreenAlignedQuad> m_blurXScreenAlignedQuad;
     globjects::ref_ptr<gloperate::ScreenAlignedQuad> m_blurYScreenAlignedQuad;
+    // fetched whenever the programs are rebuilt, setting the long names directly allocates each frame
+    globjects::Uniform<float> * m_giTileErrorThresholdUniform;
+    globjects::Uniform<float> * m_giIntensityFactorUniform;
+    globjects::Uniform<float> * m_vplClampingValueUniform;
+    globjects::Uniform<float> * m_blurXTileErrorThresholdUniform;
+    globjects::Uniform<float> * m_blurYTileErrorThresholdUniform;
 
     std::unique_ptr<gloperate::OrthographicProjectionCapability> m_lightProjection;
     std::unique_ptr<gloperate::AbstractViewportCapability> m_lightViewport;
     std::unique_ptr<gloperate::AbstractCameraCapability> m_lightCamera;
+
+    PipelineConfiguration m_configuration;
     
+    float areaLightSize;
     float giIntensityFactor;
     float vplClampingValue;
 
@@ -98,6 +129,7 @@ protected:
     bool showVPLPositions;
     bool useInterleaving;
     bool shuffleLights;
+    bool jitterVPLs;
 
     bool giShaderRebuildRequired;
     bool blurShaderRebuildRequired;
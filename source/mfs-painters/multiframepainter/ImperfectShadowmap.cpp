@@ -18,6 +18,7 @@
 #include <globjects/Texture.h>
 #include <globjects/Framebuffer.h>
 #include <globjects/Buffer.h>
+#include <globjects/Uniform.h>
 
 #include <gloperate/primitives/VertexDrawable.h>
 #include <gloperate/primitives/PolygonalDrawable.h>
@@ -26,6 +27,8 @@
 
 #include "VPLProcessor.h"
 #include "PerfCounter.h"
+#include "SceneGeometry.h"
+#include "SurfelCloud.h"
 
 using namespace gl;
 
@@ -45,6 +48,8 @@ ImperfectShadowmap::ImperfectShadowmap()
         globjects::Shader::fromFile(GL_GEOMETRY_SHADER, "data/shaders/ism/ism.geom"),
         globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "data/shaders/ism/ism.frag")
     );
+    m_shadowmapPointsOnlyIntoScaledUniform = m_shadowmapProgram->getUniform<bool>("pointsOnlyIntoScaledISMs");
+    m_shadowmapQuantizedVerticesUniform = m_shadowmapProgram->getUniform<bool>("quantizedVertices");
 
     m_pullLevelZeroProgram = new globjects::Program();
     m_pullLevelZeroProgram->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/ism/pull.comp"));
@@ -64,6 +69,7 @@ ImperfectShadowmap::ImperfectShadowmap()
 
     m_pointSoftRenderProgram = new globjects::Program();
     m_pointSoftRenderProgram->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/ism/ism.comp"));
+    m_pointSoftRenderPointsOnlyIntoScaledUniform = m_pointSoftRenderProgram->getUniform<bool>("pointsOnlyIntoScaledISMs");
 
     m_fbo = new globjects::Framebuffer();
     depthBuffer = globjects::Texture::createDefault();
@@ -92,25 +98,11 @@ ImperfectShadowmap::ImperfectShadowmap()
     pushBuffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST_MIPMAP_NEAREST);
     pushBuffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
 
-    auto b = new globjects::Buffer();
-    b->setData(sizeof(glm::vec4) * (1 << 23) , nullptr, GL_STATIC_DRAW);
-    pointBuffer = new globjects::Texture(GL_TEXTURE_BUFFER);
-    pointBuffer->setName("Point Buffer");
-    pointBuffer->texBuffer(GL_RGBA32F, b);
-
-
     pushPullResultBuffer = new globjects::Texture(GL_TEXTURE_2D);
     pushPullResultBuffer->setName("Pushpull result");
     pushPullResultBuffer->storage2D(1, GL_R16, totalIsmPixelSize, totalIsmPixelSize);
     pushPullResultBuffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST);
     pushPullResultBuffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
-
-    m_atomicCounter = new globjects::Buffer();
-    m_atomicCounter->setName("atomic counter");
-    m_atomicCounter->setData(sizeof(gl::GLuint)*1024 * 4, nullptr, GL_STATIC_DRAW);
-    m_atomicCounterTexture = new globjects::Texture(GL_TEXTURE_BUFFER);
-    m_atomicCounterTexture->setName("pointCounterTexture");
-    //m_atomicCounterTexture->texBuffer(GL_R32UI, b);
 }
 
 ImperfectShadowmap::~ImperfectShadowmap()
@@ -122,12 +114,15 @@ void ImperfectShadowmap::pullpush(int ismPixelSize, float zFar) const
 {
     AutoGLDebugGroup c("ISM pushpull");
 
+    static const char * pullCounterNames[] = { nullptr, "PL1", "PL2", "PL3" };
+    static const char * pushCounterNames[] = { "PS0", "PS1", "PS2" };
+
     softrenderBuffer->bindActive(0);
 
     // i indicates to which level is written
     for (int i = 1; i <= 6; i++) {
         if (i <= 3)
-            PerfCounter::beginGL("PL" + std::to_string(i));
+            PerfCounter::beginGL(pullCounterNames[i]);
         if (i == 4)
             PerfCounter::beginGL("PLO"); // PLO = pull, other
 
@@ -145,7 +140,7 @@ void ImperfectShadowmap::pullpush(int ismPixelSize, float zFar) const
         program->dispatchCompute(numGroups, numGroups, 1);
 
         if (i <= 3)
-            PerfCounter::endGL("PL" + std::to_string(i));
+            PerfCounter::endGL(pullCounterNames[i]);
     }
     PerfCounter::endGL("PLO");
 
@@ -154,7 +149,7 @@ void ImperfectShadowmap::pullpush(int ismPixelSize, float zFar) const
     PerfCounter::beginGL("PSO");
     for (int i = 5; i >= 0; i--) {
         if (i <= 2)
-            PerfCounter::beginGL("PS" + std::to_string(i));
+            PerfCounter::beginGL(pushCounterNames[i]);
 
         gl::glMemoryBarrier(gl::GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
         pullBuffer->bindImageTexture(0, i, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
@@ -175,15 +170,15 @@ void ImperfectShadowmap::pullpush(int ismPixelSize, float zFar) const
         program->dispatchCompute(numGroups, numGroups, 1);
 
         if (i <= 2)
-            PerfCounter::endGL("PS" + std::to_string(i));
+            PerfCounter::endGL(pushCounterNames[i]);
         if (i == 3)
             PerfCounter::endGL("PSO");
     }
 }
 
-void ImperfectShadowmap::process(const IdDrawablesMap& drawablesMap, const VPLProcessor& vplProcessor, int vplStartIndex, int vplEndIndex, bool scaleISMs, bool pointsOnlyIntoScaledISMs, float tessLevelFactor, bool usePushPull, float zFar) const
+void ImperfectShadowmap::process(const SceneGeometry& sceneGeometry, const IdDrawablesMap& drawablesMap, const SurfelCloud& surfels, const VPLProcessor& vplProcessor, int vplStartIndex, int vplEndIndex, bool scaleISMs, bool pointsOnlyIntoScaledISMs, float tessLevelFactor, bool usePushPull, float zFar) const
 {
-    render(drawablesMap, vplProcessor, vplStartIndex, vplEndIndex, scaleISMs, pointsOnlyIntoScaledISMs, tessLevelFactor, usePushPull, zFar);
+    render(sceneGeometry, drawablesMap, surfels, vplProcessor, vplStartIndex, vplEndIndex, scaleISMs, pointsOnlyIntoScaledISMs, tessLevelFactor, usePushPull, zFar);
     int vplCount = vplEndIndex - vplStartIndex;
     int ismCount = (scaleISMs) ? vplCount : maxIsmCount;
     int ismIndices1d = int(pow(2, ceil(log2(ismCount) / 2))); // next even power of two
@@ -191,7 +186,7 @@ void ImperfectShadowmap::process(const IdDrawablesMap& drawablesMap, const VPLPr
     pullpush(ismPixelSize, zFar);
 }
 
-void ImperfectShadowmap::render(const IdDrawablesMap& drawablesMap, const VPLProcessor& vplProcessor, int vplStartIndex, int vplEndIndex, bool scaleISMs, bool pointsOnlyIntoScaledISMs, float tessLevelFactor, bool usePushPull, float zFar) const
+void ImperfectShadowmap::render(const SceneGeometry& sceneGeometry, const IdDrawablesMap& drawablesMap, const SurfelCloud& surfels, const VPLProcessor& vplProcessor, int vplStartIndex, int vplEndIndex, bool scaleISMs, bool pointsOnlyIntoScaledISMs, float tessLevelFactor, bool usePushPull, float zFar) const
 {
     glEnable(GL_DEPTH_TEST);
     glDepthMask(GL_TRUE);
@@ -205,21 +200,35 @@ void ImperfectShadowmap::render(const IdDrawablesMap& drawablesMap, const VPLPro
     m_fbo->clearBuffer(GL_COLOR, 0, glm::vec4(0.0f));
 
     vplProcessor.packedVplBuffer->bindBase(GL_UNIFORM_BUFFER, 0);
-    gl::GLuint zero = 0;
-    m_atomicCounter->clearData(GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
-    m_atomicCounter->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
 
     softrenderBuffer->clearImage(0, GL_RED_INTEGER, GL_UNSIGNED_INT, glm::uvec4(0xFFFFFFFF));
     softrenderBuffer->bindImageTexture(0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
-    pointBuffer->bindImageTexture(1, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    if (usePushPull) {
+        // the surfels are sampled once per scene, so only the splatting remains per frame
+        AutoGLPerfCounter c("ISM CS");
+        gl::glMemoryBarrier(gl::GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        surfels.buffer()->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+
+        m_pointSoftRenderProgram->setUniform("surfelCount", surfels.surfelCount());
+        m_pointSoftRenderProgram->setUniform("viewport", glm::ivec2(totalIsmPixelSize, totalIsmPixelSize));
+        m_pointSoftRenderProgram->setUniform("zFar", zFar);
+        m_pointSoftRenderProgram->setUniform("vplStartIndex", vplStartIndex);
+        m_pointSoftRenderProgram->setUniform("vplEndIndex", vplEndIndex);
+        m_pointSoftRenderProgram->setUniform("scaleISMs", scaleISMs);
+        m_pointSoftRenderPointsOnlyIntoScaledUniform->set(pointsOnlyIntoScaledISMs);
+        m_pointSoftRenderProgram->setUniform("usePushPull", usePushPull);
+        m_pointSoftRenderProgram->dispatchCompute(1024, 1, 1);
+        return;
+    }
 
     m_shadowmapProgram->setUniform("viewport", glm::ivec2(totalIsmPixelSize, totalIsmPixelSize));
     m_shadowmapProgram->setUniform("zFar", zFar);
     m_shadowmapProgram->setUniform("vplStartIndex", vplStartIndex);
     m_shadowmapProgram->setUniform("vplEndIndex", vplEndIndex);
     m_shadowmapProgram->setUniform("scaleISMs", scaleISMs);
-    m_shadowmapProgram->setUniform("pointsOnlyIntoScaledISMs", pointsOnlyIntoScaledISMs);
-    m_shadowmapProgram->setUniform("usePushPull", usePushPull);
+    m_shadowmapPointsOnlyIntoScaledUniform->set(pointsOnlyIntoScaledISMs);
     m_shadowmapProgram->setUniform("tessLevelFactor", tessLevelFactor);
 
     m_shadowmapProgram->use();
@@ -229,6 +238,15 @@ void ImperfectShadowmap::render(const IdDrawablesMap& drawablesMap, const VPLPro
 
     {
         AutoGLPerfCounter c("ISM render");
+
+        // depth only, so the whole scene is a single multi-draw
+        m_shadowmapQuantizedVerticesUniform->set(true);
+        sceneGeometry.bind();
+        // not culled, the VPLs see the scene in all directions
+        sceneGeometry.draw(sceneGeometry.allDraws(), 0, sceneGeometry.allDraws().drawCount(), GL_PATCHES);
+        sceneGeometry.release();
+        m_shadowmapQuantizedVerticesUniform->set(false);
+
         for (const auto& pair : drawablesMap)
         {
             auto& drawables = pair.second;
@@ -240,22 +258,4 @@ void ImperfectShadowmap::render(const IdDrawablesMap& drawablesMap, const VPLPro
     }
 
     m_shadowmapProgram->release();
-
-    if (usePushPull) {
-        AutoGLPerfCounter c("ISM CS");
-        gl::glMemoryBarrier(gl::GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-        gl::glMemoryBarrier(gl::GL_SHADER_STORAGE_BARRIER_BIT);
-
-        m_pointSoftRenderProgram->setUniform("viewport", glm::ivec2(totalIsmPixelSize, totalIsmPixelSize));
-        m_pointSoftRenderProgram->setUniform("zFar", zFar);
-        m_pointSoftRenderProgram->setUniform("vplStartIndex", vplStartIndex);
-        m_pointSoftRenderProgram->setUniform("vplEndIndex", vplEndIndex);
-        m_pointSoftRenderProgram->setUniform("scaleISMs", scaleISMs);
-        m_pointSoftRenderProgram->setUniform("pointsOnlyIntoScaledISMs", pointsOnlyIntoScaledISMs);
-        m_pointSoftRenderProgram->setUniform("usePushPull", usePushPull);
-        m_pointSoftRenderProgram->setUniform("tessLevelFactor", tessLevelFactor);
-        m_pointSoftRenderProgram->dispatchCompute(1024, 1, 1);
-    }
-
-
 }
@@ -11,6 +11,7 @@ namespace globjects
     class Program;
     class Framebuffer;
     class Texture;
+    template <typename T> class Uniform;
 }
 
 namespace gloperate
@@ -19,6 +20,8 @@ namespace gloperate
 }
 
 class VPLProcessor;
+class SceneGeometry;
+class SurfelCloud;
 
 
 class ImperfectShadowmap
@@ -28,7 +31,9 @@ public:
     ~ImperfectShadowmap();
 
     void process(
+        const SceneGeometry& sceneGeometry,
         const IdDrawablesMap& drawablesMap,
+        const SurfelCloud& surfels,
         const VPLProcessor& vplProcessor,
         int vplStartIndex,
         int vplEndIndex,
@@ -42,12 +47,13 @@ public:
     globjects::ref_ptr<globjects::Texture> softrenderBuffer;
     globjects::ref_ptr<globjects::Texture> pullBuffer;
     globjects::ref_ptr<globjects::Texture> pushBuffer;
-    globjects::ref_ptr<globjects::Texture> pointBuffer;
     globjects::ref_ptr<globjects::Texture> pushPullResultBuffer;
 
 protected:
     void render(
+        const SceneGeometry& sceneGeometry,
         const IdDrawablesMap& drawablesMap,
+        const SurfelCloud& surfels,
         const VPLProcessor& vplProcessor,
         int vplStartIndex,
         int vplEndIndex,
@@ -68,6 +74,8 @@ protected:
     globjects::ref_ptr<globjects::Program> m_pushProgram;
     globjects::ref_ptr<globjects::Program> m_pushLevelZeroProgram;
     globjects::ref_ptr<globjects::Program> m_pointSoftRenderProgram;
-    globjects::ref_ptr<globjects::Buffer> m_atomicCounter;
-    globjects::ref_ptr<globjects::Texture> m_atomicCounterTexture;
+    // held directly, their names are too long for the string setUniform() builds to avoid the heap
+    globjects::Uniform<bool> * m_shadowmapPointsOnlyIntoScaledUniform;
+    globjects::Uniform<bool> * m_shadowmapQuantizedVerticesUniform;
+    globjects::Uniform<bool> * m_pointSoftRenderPointsOnlyIntoScaledUniform;
 };
@@ -0,0 +1,381 @@
+#include "KernelCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include <glkernel/sample.h>
+#include <glkernel/scale.h>
+#include <glkernel/sort.hpp>
+#include <glkernel/shuffle.hpp>
+
+#include "FileUtils.h"
+#include "MappedFile.h"
+
+
+namespace
+{
+    const char s_magic[4] = { 'M', 'F', 'S', 'K' };
+    // bump when the generation of any kernel type changes, old files are ignored then
+    const uint32_t s_version = 2;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t reserved;
+    };
+
+    struct FileEntry
+    {
+        uint32_t type;
+        uint32_t sequence;
+        uint32_t count;
+        uint32_t seed;
+        uint32_t components;
+        float rangeMin;
+        float rangeMax;
+        uint32_t reserved;
+        // in bytes from the start of the file
+        uint64_t offset;
+    };
+
+    uint32_t reverseBits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    // hash based owen scrambling, see Burley 2020, Practical Hash-based Owen Scrambling
+    uint32_t owenScramble(uint32_t x, uint32_t seed)
+    {
+        x = reverseBits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverseBits(x);
+    }
+
+    // first two dimensions of the sobol sequence as 0.32 fixed point
+    uint32_t sobol(uint32_t index, unsigned int dimension)
+    {
+        if (dimension == 0)
+            return reverseBits(index);
+
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+        {
+            if (index & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    float radicalInverse(uint32_t index, uint32_t base)
+    {
+        auto inverseBase = 1.0 / base;
+        auto factor = inverseBase;
+        auto result = 0.0;
+        for (; index; index /= base, factor *= inverseBase)
+            result += (index % base) * factor;
+
+        return static_cast<float>(result);
+    }
+
+    float fixedPointToFloat(uint32_t x)
+    {
+        // 24 bits fit into the mantissa, keeps the result below 1
+        return (x >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float fract(float x)
+    {
+        return x - std::floor(x);
+    }
+
+    // point in [0, 1)^2, the kernel type decorrelates e.g. the anti-aliasing and depth of field kernels
+    void generateSequence(glkernel::kernel2 & kernel, const KernelKey & key)
+    {
+        std::seed_seq seeds{ key.seed, static_cast<uint32_t>(key.type) };
+        std::mt19937 random(seeds);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+        // cranley-patterson rotation for halton and r2, owen scrambling for sobol
+        auto offset = glm::vec2(uniform(random), uniform(random));
+        uint32_t scrambleSeeds[2] = { static_cast<uint32_t>(random()), static_cast<uint32_t>(random()) };
+
+        // r2 uses the plastic number, see http://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
+        const double g = 1.32471795724474602596;
+        const auto r2Step = glm::vec2(static_cast<float>(1.0 / g), static_cast<float>(1.0 / (g * g)));
+
+        for (auto i = 0u; i < kernel.size(); ++i)
+        {
+            switch (key.sequence)
+            {
+            case KernelSequence::Halton:
+                kernel[i] = glm::vec2(fract(radicalInverse(i, 2) + offset.x), fract(radicalInverse(i, 3) + offset.y));
+                break;
+            case KernelSequence::Sobol:
+                kernel[i] = glm::vec2(fixedPointToFloat(owenScramble(sobol(i, 0), scrambleSeeds[0])), fixedPointToFloat(owenScramble(sobol(i, 1), scrambleSeeds[1])));
+                break;
+            case KernelSequence::R2:
+                kernel[i] = glm::vec2(fract(offset.x + i * r2Step.x), fract(offset.y + i * r2Step.y));
+                break;
+            default:
+                assert(false);
+            }
+        }
+    }
+}
+
+
+KernelCache::KernelCache(const std::string & filename)
+: m_filename(filename)
+{
+    load();
+}
+
+KernelCache::~KernelCache()
+{
+}
+
+void KernelCache::load()
+{
+    m_mappedKernels.clear();
+    m_file = std::make_unique<MappedFile>(m_filename);
+
+    auto data = m_file->data();
+    auto size = m_file->size();
+    if (!data || size < sizeof(FileHeader))
+        return;
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+    if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.version != s_version)
+    {
+        std::cout << "Ignoring outdated kernel cache " << m_filename << std::endl;
+        return;
+    }
+
+    if (sizeof(FileHeader) + header.entryCount * sizeof(FileEntry) > size)
+        return;
+
+    for (auto i = 0u; i < header.entryCount; ++i)
+    {
+        FileEntry entry;
+        std::memcpy(&entry, data + sizeof(FileHeader) + i * sizeof(FileEntry), sizeof(FileEntry));
+
+        auto byteCount = uint64_t(entry.count) * entry.components * sizeof(float);
+        if (entry.offset % sizeof(float) != 0 || entry.offset + byteCount > size)
+            return;
+
+        auto key = KernelKey{ static_cast<KernelType>(entry.type), static_cast<KernelSequence>(entry.sequence), entry.count, entry.seed, entry.rangeMin, entry.rangeMax };
+        if (components(key.type) != entry.components)
+            continue;
+
+        m_mappedKernels[tupleKey(key)] = reinterpret_cast<const float *>(data + entry.offset);
+    }
+}
+
+const float * KernelCache::find(const KernelKey & key) const
+{
+    auto mapped = m_mappedKernels.find(tupleKey(key));
+    if (mapped != m_mappedKernels.end())
+        return mapped->second;
+
+    auto generated = m_generatedKernels.find(tupleKey(key));
+    if (generated != m_generatedKernels.end())
+        return generated->second.data();
+
+    return nullptr;
+}
+
+glkernel::kernel2 KernelCache::kernel2(const KernelKey & key)
+{
+    assert(components(key.type) == 2);
+
+    auto values = find(key);
+    if (!values)
+    {
+        auto kernel = generateKernel2(key);
+        auto & storage = m_generatedKernels[tupleKey(key)];
+        for (auto i = 0u; i < kernel.size(); ++i)
+            storage.insert(storage.end(), { kernel[i].x, kernel[i].y });
+
+        return kernel;
+    }
+
+    auto kernel = glkernel::kernel2{ static_cast<uint16_t>(key.count) };
+    for (auto i = 0u; i < kernel.size(); ++i)
+        kernel[i] = glm::vec2(values[i * 2], values[i * 2 + 1]);
+
+    return kernel;
+}
+
+glkernel::kernel3 KernelCache::kernel3(const KernelKey & key)
+{
+    assert(components(key.type) == 3);
+
+    auto values = find(key);
+    if (!values)
+    {
+        auto kernel = generateKernel3(key);
+        auto & storage = m_generatedKernels[tupleKey(key)];
+        for (auto i = 0u; i < kernel.size(); ++i)
+            storage.insert(storage.end(), { kernel[i].x, kernel[i].y, kernel[i].z });
+
+        return kernel;
+    }
+
+    auto kernel = glkernel::kernel3{ static_cast<uint16_t>(key.count) };
+    for (auto i = 0u; i < kernel.size(); ++i)
+        kernel[i] = glm::vec3(values[i * 3], values[i * 3 + 1], values[i * 3 + 2]);
+
+    return kernel;
+}
+
+bool KernelCache::save()
+{
+    if (m_generatedKernels.empty())
+        return true;
+
+    // gather everything before the mapping is released
+    std::vector<FileEntry> entries;
+    std::vector<float> values;
+
+    auto addEntry = [&entries, &values](const Key & key, const float * data) {
+        auto type = static_cast<KernelType>(std::get<0>(key));
+        auto count = std::get<2>(key);
+        auto entry = FileEntry{ std::get<0>(key), std::get<1>(key), count, std::get<3>(key), components(type), std::get<4>(key), std::get<5>(key), 0, values.size() * sizeof(float) };
+        entries.push_back(entry);
+        values.insert(values.end(), data, data + count * entry.components);
+    };
+
+    for (const auto & kernel : m_mappedKernels)
+        addEntry(kernel.first, kernel.second);
+    for (const auto & kernel : m_generatedKernels)
+        addEntry(kernel.first, kernel.second.data());
+
+    auto dataOffset = sizeof(FileHeader) + entries.size() * sizeof(FileEntry);
+    for (auto & entry : entries)
+        entry.offset += dataOffset;
+
+    FileHeader header;
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.reserved = 0;
+
+    // the file can't be replaced while it is mapped
+    m_mappedKernels.clear();
+    m_file.reset();
+
+    auto written = writeFileAtomically(m_filename, [&](std::ostream & stream) {
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+        stream.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(FileEntry));
+        stream.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(float));
+    });
+
+    if (written)
+        m_generatedKernels.clear();
+    else
+        std::cout << "Could not write kernel cache " << m_filename << std::endl;
+
+    // maps the new file, or the old one again if writing failed
+    load();
+
+    return written;
+}
+
+KernelKey KernelCache::defaultKey(KernelType type, unsigned int count, KernelSequence sequence)
+{
+    switch (type)
+    {
+    case KernelType::AntiAliasing:
+        return { type, sequence, count, 0, -.5f, .5f };
+    case KernelType::VPL:
+        return { type, sequence, count, 0, 0.f, 1.f };
+    case KernelType::SSAO:
+        return { type, KernelSequence::Poisson, count, 0, -1.f, 1.f };
+    default:
+        return { type, sequence, count, 0, -1.f, 1.f };
+    }
+}
+
+unsigned int KernelCache::components(KernelType type)
+{
+    return type == KernelType::SSAO ? 3 : 2;
+}
+
+glkernel::kernel2 KernelCache::generateKernel2(const KernelKey & key)
+{
+    auto kernel = glkernel::kernel2{ static_cast<uint16_t>(key.count) };
+
+    // the order of the sequences matters, they are neither shuffled nor sorted
+    if (key.sequence != KernelSequence::Poisson)
+    {
+        generateSequence(kernel, key);
+        for (auto i = 0u; i < kernel.size(); ++i)
+            kernel[i] = glm::vec2(glm::mix(key.rangeMin, key.rangeMax, kernel[i].x), glm::mix(key.rangeMin, key.rangeMax, kernel[i].y));
+
+        return kernel;
+    }
+
+    glkernel::sample::poisson_square(kernel);
+    glkernel::scale::range(kernel, key.rangeMin, key.rangeMax);
+
+    switch (key.type)
+    {
+    case KernelType::AntiAliasing:
+    case KernelType::VPL:
+        glkernel::shuffle::random(kernel, 1);
+        break;
+    case KernelType::DepthOfField:
+    case KernelType::Shadow:
+        glkernel::sort::distance(kernel, { 0.f, 0.f });
+        break;
+    default:
+        assert(false);
+    }
+
+    return kernel;
+}
+
+glkernel::kernel3 KernelCache::generateKernel3(const KernelKey & key)
+{
+    assert(key.type == KernelType::SSAO);
+
+    auto kernel = glkernel::kernel3{ static_cast<uint16_t>(key.count) };
+    glkernel::sample::best_candidate(kernel);
+    glkernel::scale::range(kernel, key.rangeMin, key.rangeMax);
+    for (int i = 0; i < kernel.size(); i++)
+    {
+        auto& elem = kernel[i];
+        elem.z = glm::abs(elem.z);
+        elem = glm::normalize(elem);
+        // taken from http://john-chapman-graphics.blogspot.de/2013/01/ssao-tutorial.html
+        float scale = float(i) / float(kernel.size());
+        scale = glm::mix(0.1f, 1.0f, scale * scale);
+        elem *= scale;
+        elem.z = std::max(0.1f, elem.z);
+    }
+
+    return kernel;
+}
+
+KernelCache::Key KernelCache::tupleKey(const KernelKey & key)
+{
+    return Key{ static_cast<uint32_t>(key.type), static_cast<uint32_t>(key.sequence), key.count, key.seed, key.rangeMin, key.rangeMax };
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <glkernel/Kernel.h>
+
+
+enum class KernelType : uint32_t
+{
+    AntiAliasing = 0,
+    DepthOfField = 1,
+    Shadow = 2,
+    VPL = 3,
+    SSAO = 4
+};
+
+// point sets for the 2d kernels. poisson sets are only well distributed as a whole,
+// every prefix of the low-discrepancy sequences is well distributed, too.
+enum class KernelSequence : uint32_t
+{
+    Poisson = 0,
+    Halton = 1,
+    Sobol = 2,
+    R2 = 3
+};
+
+struct KernelKey
+{
+    KernelType type;
+    KernelSequence sequence;
+    uint32_t count;
+    // scrambles the low-discrepancy sequences. glkernel's poisson sampler is not reproducible,
+    // there the seed only distinguishes variants of the same kernel.
+    uint32_t seed;
+    float rangeMin;
+    float rangeMax;
+};
+
+class MappedFile;
+
+// Generated sampling kernels, persisted in a binary file that is memory-mapped on load.
+// Kernels that are not in the file are generated on demand and written back by save().
+class KernelCache
+{
+public:
+    KernelCache(const std::string & filename);
+    ~KernelCache();
+
+    glkernel::kernel2 kernel2(const KernelKey & key);
+    glkernel::kernel3 kernel3(const KernelKey & key);
+
+    // writes the file if kernels have been generated since it was loaded
+    bool save();
+
+    // the key the painter uses for a kernel of the given type and size
+    static KernelKey defaultKey(KernelType type, unsigned int count, KernelSequence sequence = KernelSequence::Poisson);
+    static unsigned int components(KernelType type);
+
+    static glkernel::kernel2 generateKernel2(const KernelKey & key);
+    static glkernel::kernel3 generateKernel3(const KernelKey & key);
+
+protected:
+    using Key = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, float, float>;
+    static Key tupleKey(const KernelKey & key);
+
+    void load();
+    const float * find(const KernelKey & key) const;
+
+    std::string m_filename;
+    std::unique_ptr<MappedFile> m_file;
+
+    // pointers into the mapped file
+    std::map<Key, const float *> m_mappedKernels;
+    std::map<Key, std::vector<float>> m_generatedKernels;
+};
@@ -3,60 +3,41 @@
 #include <glm/gtc/random.hpp>
 
 #include <glkernel/Kernel.h>
-#include <glkernel/sample.h>
-#include <glkernel/scale.h>
-#include <glkernel/sort.hpp>
-#include <glkernel/shuffle.hpp>
 
 
 KernelGenerationStage::KernelGenerationStage()
+: sequence(KernelSequence::Poisson)
+{
+}
+
+KernelGenerationStage::~KernelGenerationStage()
 {
 }
 
 void KernelGenerationStage::initialize()
 {
+    // pre-baked by mfs-kernelbaker, kernels that are missing are generated and added
+    m_cache = std::make_unique<KernelCache>("data/kernels.cache");
 }
 
 void KernelGenerationStage::process(int multiFrameCount)
 {
-    auto& aaSamples = antiAliasingKernel;
-    aaSamples = { static_cast<uint16_t>(multiFrameCount) };
-    glkernel::sample::poisson_square(aaSamples);
-    glkernel::scale::range(aaSamples, -.5f, .5f);
-    glkernel::shuffle::random(aaSamples, 1);
-
-    auto& dofSamples = depthOfFieldKernel;
-    dofSamples = { static_cast<uint16_t>(multiFrameCount) };
-    glkernel::sample::poisson_square(dofSamples);
-    glkernel::scale::range(dofSamples, -1.f, 1.f);
-    glkernel::sort::distance(dofSamples, { 0.f, 0.f });
-
-    auto& shadowSamples = shadowKernel;
-    shadowSamples = { static_cast<uint16_t>(multiFrameCount) };
-    glkernel::sample::poisson_square(shadowSamples);
-    glkernel::scale::range(shadowSamples, -1.f, 1.f);
-    glkernel::sort::distance(shadowSamples, { 0.f, 0.f });
-}
+    auto count = static_cast<unsigned int>(multiFrameCount);
 
+    antiAliasingKernel = m_cache->kernel2(KernelCache::defaultKey(KernelType::AntiAliasing, count, sequence));
+    depthOfFieldKernel = m_cache->kernel2(KernelCache::defaultKey(KernelType::DepthOfField, count, sequence));
+    shadowKernel = m_cache->kernel2(KernelCache::defaultKey(KernelType::Shadow, count, sequence));
+    vplKernel = m_cache->kernel2(KernelCache::defaultKey(KernelType::VPL, count));
 
+    m_cache->save();
+}
 
 glkernel::kernel3 KernelGenerationStage::getSSAOKernel(unsigned int size) const
 {
-    glkernel::kernel3 ssaoSamples = glkernel::kernel3{ static_cast<uint16_t>(size) };
-    glkernel::sample::best_candidate(ssaoSamples);
-    glkernel::scale::range(ssaoSamples, -1.0f, 1.0f);
-    for (int i = 0; i < ssaoSamples.size(); i++)
-    {
-        auto& elem = ssaoSamples[i];
-        elem.z = glm::abs(elem.z);
-        elem = glm::normalize(elem);
-        // taken from http://john-chapman-graphics.blogspot.de/2013/01/ssao-tutorial.html
-        float scale = float(i) / float(ssaoSamples.size());
-        scale = glm::mix(0.1f, 1.0f, scale * scale);
-        elem *= scale;
-        elem.z = std::max(0.1f, elem.z);
-    }
-    return ssaoSamples;
+    auto kernel = m_cache->kernel3(KernelCache::defaultKey(KernelType::SSAO, size));
+    m_cache->save();
+
+    return kernel;
 }
 
 std::vector<glm::vec3> KernelGenerationStage::getSSAONoise(unsigned int size) const
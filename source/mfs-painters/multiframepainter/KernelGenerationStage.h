@@ -1,8 +1,13 @@
 #pragma once
 
+#include <memory>
+
+#include <reflectionzeug/property/PropertyEnum.h>
+
 #include <glkernel/Kernel.h>
 
 #include "TypeDefinitions.h"
+#include "KernelCache.h"
 
 namespace globjects
 {
@@ -14,6 +19,7 @@ class KernelGenerationStage
 {
 public:
     KernelGenerationStage();
+    ~KernelGenerationStage();
 
     void initialize();
     void process(int multiFrameCount);
@@ -24,4 +30,31 @@ public:
     glkernel::kernel2 antiAliasingKernel;
     glkernel::kernel2 depthOfFieldKernel;
     glkernel::kernel2 shadowKernel;
+    // offsets within the RSM sampling grid cells, in [0, 1]
+    glkernel::kernel2 vplKernel;
+
+    // point set of the anti-aliasing, depth of field and shadow kernels
+    KernelSequence sequence;
+
+protected:
+    std::unique_ptr<KernelCache> m_cache;
 };
+
+namespace reflectionzeug
+{
+
+    template<>
+    struct EnumDefaultStrings<KernelSequence>
+    {
+        std::map<KernelSequence, std::string> operator()()
+        {
+            return{
+                { KernelSequence::Poisson, "Poisson" },
+                { KernelSequence::Halton, "Halton" },
+                { KernelSequence::Sobol, "Sobol" },
+                { KernelSequence::R2, "R2" },
+            };
+        }
+    };
+
+}
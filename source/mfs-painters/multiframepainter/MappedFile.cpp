@@ -0,0 +1,78 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const std::string & filename)
+: m_data(nullptr)
+, m_size(0)
+{
+#ifdef _WIN32
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    m_mapping = nullptr;
+    if (m_file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+        return;
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+        return;
+
+    m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data)
+        m_size = static_cast<size_t>(size.QuadPart);
+#else
+    m_file = open(filename.c_str(), O_RDONLY);
+    if (m_file < 0)
+        return;
+
+    struct stat fileStat;
+    if (fstat(m_file, &fileStat) != 0 || fileStat.st_size == 0)
+        return;
+
+    auto data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+    if (data == MAP_FAILED)
+        return;
+
+    m_data = data;
+    m_size = static_cast<size_t>(fileStat.st_size);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+#else
+    if (m_data)
+        munmap(m_data, m_size);
+    if (m_file >= 0)
+        close(m_file);
+#endif
+}
+
+const char * MappedFile::data() const
+{
+    return static_cast<const char *>(m_data);
+}
+
+size_t MappedFile::size() const
+{
+    return m_size;
+}
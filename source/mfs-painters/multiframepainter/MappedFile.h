@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// read-only memory mapping of a whole file, data() is null if the file could not be mapped
+class MappedFile
+{
+public:
+    MappedFile(const std::string & filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const;
+    size_t size() const;
+
+protected:
+    void * m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void * m_file;
+    void * m_mapping;
+#else
+    int m_file;
+#endif
+};
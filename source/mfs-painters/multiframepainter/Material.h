@@ -1,6 +1,7 @@
 #pragma once
 
 #include <map>
+#include <string>
 
 #include <glm/vec3.hpp>
 
@@ -23,6 +24,15 @@ enum class BumpType
     Normal
 };
 
+// the parts of a material that are known before any texture is loaded
+struct MaterialDescription
+{
+    MaterialDescription();
+
+    float specularFactor;
+    std::map<TextureType, std::string> texturePaths;
+};
+
 class Material
 {
 public:
@@ -35,6 +45,8 @@ public:
     const TextureMap& textureMap() const;
     void addTexture(TextureType type, globjects::ref_ptr<globjects::Texture> texture);
     bool hasTexture(TextureType type) const;
+    // keeps the texture types, e.g. once the textures have been copied into a material table's texture arrays
+    void releaseTextures();
 
 protected:
     TextureMap m_textureMap;
@@ -0,0 +1,415 @@
+#include "MaterialTable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/extension.h>
+#include <glbinding/gl/functions.h>
+
+#include <globjects/globjects.h>
+#include <globjects/Buffer.h>
+#include <globjects/Texture.h>
+#include <globjects/base/baselogging.h>
+
+#include "TextureCompression.h"
+#include "TextureStreaming.h"
+
+using namespace gl;
+
+
+namespace
+{
+    // larger textures are put into the arrays without their finest levels
+    const GLint s_maxArrayTextureSize = 2048;
+
+    GLsizei mipLevelCount(GLint width, GLint height)
+    {
+        GLsizei levels = 1;
+        for (auto size = std::max(width, height); size > 1; size /= 2)
+            ++levels;
+
+        return levels;
+    }
+
+    struct ArrayLayer
+    {
+        globjects::Texture * texture;
+        GLint baseLevel;
+        // the texture doesn't reach the array's size by dropping levels, it is scaled to it
+        bool resample;
+    };
+
+    struct ArrayBucket
+    {
+        GLenum format;
+        GLint width;
+        GLint height;
+        std::vector<ArrayLayer> layers;
+    };
+
+    // the number of mip levels a texture has to drop to match the bucket, -1 if it can't
+    GLint levelOffset(const ArrayBucket & bucket, GLenum format, GLint width, GLint height)
+    {
+        if (bucket.format != format)
+            return -1;
+
+        for (GLint offset = 0; width >= bucket.width && height >= bucket.height; ++offset)
+        {
+            if (width == bucket.width && height == bucket.height)
+                return offset;
+
+            if (width == 1 && height == 1)
+                break;
+
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+
+        return -1;
+    }
+
+    // the arrays are only created from textures of the texture loader, which are all block compressed
+    bool blockCompression(GLenum format, BlockCompression & compression)
+    {
+        for (auto candidate : { BlockCompression::BC1, BlockCompression::BC3, BlockCompression::BC4, BlockCompression::BC5 })
+        {
+            if (glInternalFormat(candidate) != static_cast<uint32_t>(format))
+                continue;
+
+            compression = candidate;
+            return true;
+        }
+
+        return false;
+    }
+
+    // bilinear with wrapping, like the arrays are sampled. pixels are tightly packed RGBA8
+    std::vector<unsigned char> resample(const std::vector<unsigned char> & pixels, int width, int height, int targetWidth, int targetHeight)
+    {
+        std::vector<unsigned char> target(static_cast<size_t>(targetWidth) * targetHeight * 4);
+
+        for (auto y = 0; y < targetHeight; ++y)
+        {
+            auto sourceY = (y + 0.5f) * height / targetHeight - 0.5f;
+            auto y0 = static_cast<int>(std::floor(sourceY));
+            auto fy = sourceY - y0;
+            auto row0 = static_cast<size_t>((y0 % height + height) % height) * width;
+            auto row1 = static_cast<size_t>(((y0 + 1) % height + height) % height) * width;
+
+            for (auto x = 0; x < targetWidth; ++x)
+            {
+                auto sourceX = (x + 0.5f) * width / targetWidth - 0.5f;
+                auto x0 = static_cast<int>(std::floor(sourceX));
+                auto fx = sourceX - x0;
+                auto column0 = static_cast<size_t>((x0 % width + width) % width);
+                auto column1 = static_cast<size_t>(((x0 + 1) % width + width) % width);
+
+                for (auto c = 0; c < 4; ++c)
+                {
+                    auto top = pixels[(row0 + column0) * 4 + c] * (1.f - fx) + pixels[(row0 + column1) * 4 + c] * fx;
+                    auto bottom = pixels[(row1 + column0) * 4 + c] * (1.f - fx) + pixels[(row1 + column1) * 4 + c] * fx;
+                    target[(static_cast<size_t>(y) * targetWidth + x) * 4 + c] = static_cast<unsigned char>(top * (1.f - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+
+        return target;
+    }
+
+    // reads the texture back decompressed, scales it to the array's size and compresses the whole mip chain again
+    void resampleLayer(globjects::Texture * textureArray, const ArrayBucket & bucket, globjects::Texture * source, GLint layer)
+    {
+        BlockCompression compression;
+        if (!blockCompression(bucket.format, compression))
+            return;
+
+        // the finest level that is still at least as large as the array, so no detail is lost before scaling
+        GLint level = 0;
+        auto width = source->getLevelParameter(0, GL_TEXTURE_WIDTH);
+        auto height = source->getLevelParameter(0, GL_TEXTURE_HEIGHT);
+        while (width / 2 >= bucket.width && height / 2 >= bucket.height && source->getLevelParameter(level + 1, GL_TEXTURE_WIDTH) > 0)
+        {
+            width /= 2;
+            height /= 2;
+            ++level;
+        }
+
+        auto pixels = source->getImage(level, GL_RGBA, GL_UNSIGNED_BYTE);
+        auto scaled = resample(pixels, width, height, bucket.width, bucket.height);
+        auto image = compressImage(compression, bucket.width, bucket.height, scaled.data());
+
+        textureArray->bind();
+        for (auto arrayLevel = 0u; arrayLevel < image.levels.size(); ++arrayLevel)
+        {
+            const auto & data = image.levels[arrayLevel];
+            auto levelWidth = std::max(bucket.width >> arrayLevel, 1);
+            auto levelHeight = std::max(bucket.height >> arrayLevel, 1);
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(arrayLevel), 0, 0, layer, levelWidth, levelHeight, 1,
+                bucket.format, static_cast<GLsizei>(data.size()), data.data());
+        }
+        textureArray->unbind();
+    }
+
+    // how far the texel counts are apart, in levels
+    float sizeDistance(const ArrayBucket & array, GLint width, GLint height)
+    {
+        return std::abs(std::log2(static_cast<float>(array.width) * array.height / (static_cast<float>(width) * height)));
+    }
+}
+
+
+bool MaterialTable::bindlessSupported()
+{
+    // model.frag builds samplers from handles of a per draw material index, which is not dynamically uniform
+    return globjects::hasExtension(GLextension::GL_ARB_bindless_texture) && globjects::hasExtension(GLextension::GL_NV_gpu_shader5);
+}
+
+MaterialTable::MaterialTable(const IdMaterialMap & materials, float maxAnisotropy, const TextureStreaming * streaming)
+: m_defaultMaterialIndex(materials.empty() ? 0 : materials.rbegin()->first + 1)
+{
+    std::vector<globjects::Texture *> textures;
+    for (const auto & pair : materials)
+    {
+        for (const auto & texture : pair.second.textureMap())
+        {
+            if (std::find(textures.begin(), textures.end(), texture.second.get()) == textures.end())
+                textures.push_back(texture.second);
+        }
+    }
+
+    std::map<const globjects::Texture *, std::pair<GLuint, GLuint>> locations;
+    if (bindlessSupported())
+    {
+        for (auto texture : textures)
+        {
+            auto handle = residentHandle(texture);
+            locations[texture] = { static_cast<GLuint>(handle & 0xFFFFFFFF), static_cast<GLuint>(handle >> 32) };
+        }
+    }
+    else
+    {
+        createTextureArrays(textures, maxAnisotropy, locations);
+    }
+
+    MaterialParameters untextured{ 0.0f, 0, {}, {}, 0 };
+    std::fill(std::begin(untextured.streamedTextures), std::end(untextured.streamedTextures), TextureStreaming::NotStreamed);
+
+    m_parameters.assign(m_defaultMaterialIndex + 1, untextured);
+    for (const auto & pair : materials)
+    {
+        auto & material = m_parameters[pair.first];
+        material.specularFactor = pair.second.specularFactor;
+
+        for (const auto & texture : pair.second.textureMap())
+        {
+            auto location = locations.find(texture.second.get());
+            if (location == locations.end())
+                continue;
+
+            auto type = static_cast<GLuint>(texture.first);
+            material.textureFlags |= 1u << type;
+            material.textures[type][0] = location->second.first;
+            material.textures[type][1] = location->second.second;
+
+            if (streaming)
+                material.streamedTextures[type] = streaming->index(texture.second.get());
+
+            m_textureUses[texture.second.get()].push_back({ pair.first, type });
+        }
+    }
+
+    // updated when streamed textures are replaced
+    m_buffer = new globjects::Buffer();
+    m_buffer->setStorage(m_parameters.size() * sizeof(MaterialParameters), m_parameters.data(), GL_DYNAMIC_STORAGE_BIT);
+}
+
+MaterialTable::~MaterialTable()
+{
+    for (const auto & pair : m_residentHandles)
+        glMakeTextureHandleNonResidentARB(pair.second);
+}
+
+unsigned int MaterialTable::defaultMaterialIndex() const
+{
+    return m_defaultMaterialIndex;
+}
+
+void MaterialTable::bind(GLuint storageBufferBinding, GLuint firstTextureUnit) const
+{
+    m_buffer->bindBase(GL_SHADER_STORAGE_BUFFER, storageBufferBinding);
+
+    for (auto i = 0u; i < m_textureArrays.size(); ++i)
+        m_textureArrays[i]->bindActive(firstTextureUnit + i);
+}
+
+void MaterialTable::replaceTexture(const globjects::Texture * previous, globjects::Texture * texture)
+{
+    auto uses = m_textureUses.find(previous);
+    if (uses == m_textureUses.end() || previous == texture)
+        return;
+
+    auto handle = residentHandle(texture);
+    for (const auto & use : uses->second)
+    {
+        auto & material = m_parameters[use.material];
+        material.textures[use.type][0] = static_cast<GLuint>(handle & 0xFFFFFFFF);
+        material.textures[use.type][1] = static_cast<GLuint>(handle >> 32);
+
+        m_buffer->setSubData(use.material * sizeof(MaterialParameters), sizeof(MaterialParameters), &material);
+    }
+
+    auto & textureUses = m_textureUses[texture];
+    textureUses.insert(textureUses.end(), uses->second.begin(), uses->second.end());
+    m_textureUses.erase(uses);
+}
+
+void MaterialTable::releaseTexture(const globjects::Texture * texture)
+{
+    auto handle = m_residentHandles.find(texture);
+    if (handle == m_residentHandles.end())
+        return;
+
+    glMakeTextureHandleNonResidentARB(handle->second);
+    m_residentHandles.erase(handle);
+}
+
+GLuint64 MaterialTable::residentHandle(globjects::Texture * texture)
+{
+    auto resident = m_residentHandles.find(texture);
+    if (resident != m_residentHandles.end())
+        return resident->second;
+
+    // the handles capture the sampler state, which has been set up by the model loading stage
+    auto handle = glGetTextureHandleARB(texture->id());
+    glMakeTextureHandleResidentARB(handle);
+    m_residentHandles[texture] = handle;
+
+    return handle;
+}
+
+void MaterialTable::createTextureArrays(const std::vector<globjects::Texture *> & textures, float maxAnisotropy, std::map<const globjects::Texture *, std::pair<GLuint, GLuint>> & locations)
+{
+    std::vector<ArrayBucket> buckets;
+    for (auto texture : textures)
+    {
+        auto format = static_cast<GLenum>(texture->getLevelParameter(0, GL_TEXTURE_INTERNAL_FORMAT));
+        auto width = texture->getLevelParameter(0, GL_TEXTURE_WIDTH);
+        auto height = texture->getLevelParameter(0, GL_TEXTURE_HEIGHT);
+
+        GLint baseLevel = 0;
+        while (std::max(width, height) > s_maxArrayTextureSize)
+        {
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+            ++baseLevel;
+        }
+
+        auto bucket = std::find_if(buckets.begin(), buckets.end(), [&](const ArrayBucket & bucket) {
+            return levelOffset(bucket, format, width, height) == 0;
+        });
+
+        if (bucket == buckets.end())
+            bucket = buckets.insert(buckets.end(), ArrayBucket{ format, width, height, {} });
+
+        bucket->layers.push_back({ texture, baseLevel, false });
+    }
+
+    // every format gets an array for the size it is used with most, the remaining arrays go to the most used sizes
+    // of any format. the other textures drop levels to fit into a smaller array of their format, or are resampled
+    // to the size of one, so each texture keeps its content
+    std::stable_sort(buckets.begin(), buckets.end(), [](const ArrayBucket & a, const ArrayBucket & b) {
+        return a.layers.size() > b.layers.size();
+    });
+
+    std::vector<ArrayBucket> arrays;
+    std::vector<ArrayBucket> remaining;
+    for (auto & bucket : buckets)
+    {
+        auto hasFormat = std::any_of(arrays.begin(), arrays.end(), [&](const ArrayBucket & array) {
+            return array.format == bucket.format;
+        });
+
+        (hasFormat ? remaining : arrays).push_back(std::move(bucket));
+    }
+
+    // still sorted, there are fewer formats than arrays
+    auto fillCount = std::min(remaining.size(), TextureArrayCount - std::min<size_t>(arrays.size(), TextureArrayCount));
+    std::move(remaining.begin(), remaining.begin() + fillCount, std::back_inserter(arrays));
+    remaining.erase(remaining.begin(), remaining.begin() + fillCount);
+
+    size_t resampledCount = 0;
+    for (const auto & bucket : remaining)
+    {
+        auto target = std::find_if(arrays.begin(), arrays.end(), [&](const ArrayBucket & array) {
+            return levelOffset(array, bucket.format, bucket.width, bucket.height) > 0;
+        });
+
+        if (target != arrays.end())
+        {
+            auto offset = levelOffset(*target, bucket.format, bucket.width, bucket.height);
+            for (const auto & layer : bucket.layers)
+                target->layers.push_back({ layer.texture, layer.baseLevel + offset, false });
+
+            continue;
+        }
+
+        // smaller than every array of its format or of another aspect ratio, there is at least one array of the format
+        auto closest = arrays.end();
+        for (auto array = arrays.begin(); array != arrays.end(); ++array)
+        {
+            if (array->format != bucket.format)
+                continue;
+
+            if (closest == arrays.end() || sizeDistance(*array, bucket.width, bucket.height) < sizeDistance(*closest, bucket.width, bucket.height))
+                closest = array;
+        }
+
+        for (const auto & layer : bucket.layers)
+            closest->layers.push_back({ layer.texture, 0, true });
+
+        resampledCount += bucket.layers.size();
+    }
+
+    if (resampledCount > 0)
+        globjects::info() << resampledCount << " textures do not match the size of any texture array and are resampled";
+
+    for (auto arrayIndex = 0u; arrayIndex < arrays.size(); ++arrayIndex)
+    {
+        const auto & bucket = arrays[arrayIndex];
+        auto levels = mipLevelCount(bucket.width, bucket.height);
+        auto layerCount = static_cast<GLsizei>(bucket.layers.size());
+
+        auto textureArray = globjects::Texture::createDefault(GL_TEXTURE_2D_ARRAY);
+        textureArray->storage3D(levels, bucket.format, bucket.width, bucket.height, layerCount);
+        textureArray->setParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+        textureArray->setParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+        textureArray->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        textureArray->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        textureArray->setParameter(GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+
+        for (auto layer = 0u; layer < bucket.layers.size(); ++layer)
+        {
+            const auto & source = bucket.layers[layer];
+            locations[source.texture] = { arrayIndex, layer };
+
+            if (source.resample)
+            {
+                resampleLayer(textureArray, bucket, source.texture, static_cast<GLint>(layer));
+                continue;
+            }
+
+            for (auto level = 0; level < levels; ++level)
+            {
+                auto width = std::max(bucket.width >> level, 1);
+                auto height = std::max(bucket.height >> level, 1);
+                glCopyImageSubData(source.texture->id(), GL_TEXTURE_2D, source.baseLevel + level, 0, 0, 0,
+                    textureArray->id(), GL_TEXTURE_2D_ARRAY, level, 0, 0, static_cast<GLint>(layer), width, height, 1);
+            }
+        }
+
+        m_textureArrays.push_back(textureArray);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <glbinding/gl/types.h>
+
+#include <globjects/base/ref_ptr.h>
+
+#include "TypeDefinitions.h"
+
+namespace globjects
+{
+    class Buffer;
+    class Texture;
+}
+
+class TextureStreaming;
+
+
+// The parameters and textures of all materials of a scene in a shader storage buffer, indexed by material index.
+// With ARB_bindless_texture and NV_gpu_shader5 every texture type has a resident texture handle. Without them, the
+// textures are copied into texture arrays by format and size, and every texture type has an array index and a layer.
+// The material table doesn't reference the source textures then, they can be released. model.frag reads
+// either through its materialTexture functions, so no textures have to be bound between materials.
+// Streamed textures (bindless only) also store their feedback index and are swapped via replaceTexture().
+class MaterialTable
+{
+public:
+    // has to match model.frag
+    static const int TextureArrayCount = 8;
+
+    static bool bindlessSupported();
+
+    MaterialTable(const IdMaterialMap & materials, float maxAnisotropy, const TextureStreaming * streaming = nullptr);
+    ~MaterialTable();
+
+    // an untextured material after the scene's ones, for geometry drawn without material
+    unsigned int defaultMaterialIndex() const;
+
+    // binds the storage buffer and, without bindless textures, the arrays to consecutive texture units
+    void bind(gl::GLuint storageBufferBinding, gl::GLuint firstTextureUnit) const;
+
+    // bindless only, the materials using previous read texture from now on. previous stays resident until it
+    // is released, frames that are still in flight may read it
+    void replaceTexture(const globjects::Texture * previous, globjects::Texture * texture);
+    void releaseTexture(const globjects::Texture * texture);
+
+protected:
+    // std430 layout, textures are handles or pairs of array index and layer, indexed by TextureType
+    struct MaterialParameters
+    {
+        float specularFactor;
+        gl::GLuint textureFlags;
+        gl::GLuint textures[5][2];
+        // TextureStreaming's feedback index of each texture
+        gl::GLuint streamedTextures[5];
+        // the struct is aligned to the 8 byte handles
+        gl::GLuint padding;
+    };
+
+    struct TextureUse
+    {
+        size_t material;
+        gl::GLuint type;
+    };
+
+    gl::GLuint64 residentHandle(globjects::Texture * texture);
+
+    // the location of each texture is its array index and layer. every texture gets a layer of an array of its
+    // format, textures that can't reach the size of one by dropping levels are resampled to it
+    void createTextureArrays(const std::vector<globjects::Texture *> & textures, float maxAnisotropy, std::map<const globjects::Texture *, std::pair<gl::GLuint, gl::GLuint>> & locations);
+
+    unsigned int m_defaultMaterialIndex;
+    globjects::ref_ptr<globjects::Buffer> m_buffer;
+
+    std::vector<MaterialParameters> m_parameters;
+    std::map<const globjects::Texture *, gl::GLuint64> m_residentHandles;
+    std::map<const globjects::Texture *, std::vector<TextureUse>> m_textureUses;
+    std::vector<globjects::ref_ptr<globjects::Texture>> m_textureArrays;
+};
@@ -0,0 +1,281 @@
+#include "MeshCache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <gloperate/primitives/PolygonalGeometry.h>
+
+#include "FileUtils.h"
+#include "MappedFile.h"
+
+
+namespace
+{
+    const char s_magic[4] = { 'M', 'F', 'S', 'M' };
+    // bump when the import post-processing or the geometry conversion changes, old files are ignored then
+    const uint32_t s_version = 2;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t meshCount;
+        uint32_t materialCount;
+        // of the model file, the cache is written after the import and is always newer
+        uint64_t sourceSize;
+        int64_t sourceModificationTime;
+        float vertexScale;
+        uint32_t reserved;
+    };
+
+    enum MeshFlags : uint32_t
+    {
+        HasNormals = 1,
+        HasTextureCoordinates = 2
+    };
+
+    // followed by the indices, vertices, normals and texture coordinates at dataOffset
+    struct MeshEntry
+    {
+        uint32_t materialIndex;
+        uint32_t flags;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        // in bytes from the start of the file
+        uint64_t dataOffset;
+    };
+
+    // followed by textureCount texture entries
+    struct MaterialEntry
+    {
+        float specularFactor;
+        uint32_t textureCount;
+    };
+
+    // followed by the path, padded to four bytes
+    struct TextureEntry
+    {
+        uint32_t type;
+        uint32_t pathLength;
+    };
+
+    size_t padded(size_t size)
+    {
+        return (size + 3) & ~size_t(3);
+    }
+
+    bool fileStatus(const std::string & filename, uint64_t & size, int64_t & modificationTime)
+    {
+        struct stat fileStat;
+        if (stat(filename.c_str(), &fileStat) != 0)
+            return false;
+
+        size = static_cast<uint64_t>(fileStat.st_size);
+        modificationTime = static_cast<int64_t>(fileStat.st_mtime);
+        return true;
+    }
+
+    template <typename T>
+    void append(std::vector<char> & buffer, const T & value)
+    {
+        auto bytes = reinterpret_cast<const char *>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    size_t meshDataSize(const MeshEntry & entry)
+    {
+        auto arrays = 1u + ((entry.flags & HasNormals) ? 1u : 0u) + ((entry.flags & HasTextureCoordinates) ? 1u : 0u);
+        return entry.indexCount * sizeof(unsigned int) + arrays * entry.vertexCount * sizeof(glm::vec3);
+    }
+}
+
+
+MeshCache::MeshCache(const std::string & modelFilename, float vertexScale)
+: m_modelFilename(modelFilename)
+, m_filename(modelFilename + ".meshcache")
+, m_vertexScale(vertexScale)
+{
+    load();
+}
+
+MeshCache::~MeshCache()
+{
+}
+
+bool MeshCache::valid() const
+{
+    return !m_meshes.empty();
+}
+
+const std::vector<MeshCache::Mesh> & MeshCache::meshes() const
+{
+    return m_meshes;
+}
+
+const std::vector<MaterialDescription> & MeshCache::materials() const
+{
+    return m_materials;
+}
+
+void MeshCache::load()
+{
+    m_meshes.clear();
+    m_materials.clear();
+    m_file = std::make_unique<MappedFile>(m_filename);
+
+    auto data = m_file->data();
+    auto size = m_file->size();
+    if (!data || size < sizeof(FileHeader))
+        return;
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+
+    uint64_t sourceSize;
+    int64_t sourceModificationTime;
+    if (!fileStatus(m_modelFilename, sourceSize, sourceModificationTime))
+        return;
+
+    if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.version != s_version
+        || header.sourceSize != sourceSize || header.sourceModificationTime != sourceModificationTime
+        || header.vertexScale != m_vertexScale)
+    {
+        std::cout << "Ignoring outdated mesh cache " << m_filename << std::endl;
+        return;
+    }
+
+    auto offset = sizeof(FileHeader) + header.meshCount * sizeof(MeshEntry);
+    if (offset > size)
+        return;
+
+    std::vector<MaterialDescription> materials(header.materialCount);
+    for (auto & material : materials)
+    {
+        MaterialEntry entry;
+        if (offset + sizeof(MaterialEntry) > size)
+            return;
+        std::memcpy(&entry, data + offset, sizeof(MaterialEntry));
+        offset += sizeof(MaterialEntry);
+
+        material.specularFactor = entry.specularFactor;
+        for (auto i = 0u; i < entry.textureCount; ++i)
+        {
+            TextureEntry texture;
+            if (offset + sizeof(TextureEntry) > size)
+                return;
+            std::memcpy(&texture, data + offset, sizeof(TextureEntry));
+            offset += sizeof(TextureEntry);
+
+            if (offset + texture.pathLength > size)
+                return;
+            material.texturePaths[static_cast<TextureType>(texture.type)] = std::string(data + offset, texture.pathLength);
+            offset += padded(texture.pathLength);
+        }
+    }
+
+    std::vector<Mesh> meshes(header.meshCount);
+    for (auto i = 0u; i < header.meshCount; ++i)
+    {
+        MeshEntry entry;
+        std::memcpy(&entry, data + sizeof(FileHeader) + i * sizeof(MeshEntry), sizeof(MeshEntry));
+
+        if (entry.dataOffset % 4 != 0 || entry.dataOffset + meshDataSize(entry) > size || entry.materialIndex >= header.materialCount)
+            return;
+
+        auto & mesh = meshes[i];
+        mesh.materialIndex = entry.materialIndex;
+        mesh.vertexCount = entry.vertexCount;
+        mesh.indexCount = entry.indexCount;
+
+        auto arrayData = data + entry.dataOffset;
+        mesh.indices = reinterpret_cast<const unsigned int *>(arrayData);
+        arrayData += entry.indexCount * sizeof(unsigned int);
+        mesh.vertices = reinterpret_cast<const glm::vec3 *>(arrayData);
+        arrayData += entry.vertexCount * sizeof(glm::vec3);
+
+        mesh.normals = nullptr;
+        if (entry.flags & HasNormals)
+        {
+            mesh.normals = reinterpret_cast<const glm::vec3 *>(arrayData);
+            arrayData += entry.vertexCount * sizeof(glm::vec3);
+        }
+
+        mesh.textureCoordinates = nullptr;
+        if (entry.flags & HasTextureCoordinates)
+            mesh.textureCoordinates = reinterpret_cast<const glm::vec3 *>(arrayData);
+    }
+
+    m_meshes = std::move(meshes);
+    m_materials = std::move(materials);
+}
+
+bool MeshCache::save(const std::vector<const gloperate::PolygonalGeometry *> & geometries, const std::vector<MaterialDescription> & materials)
+{
+    std::vector<char> materialData;
+    for (const auto & material : materials)
+    {
+        append(materialData, MaterialEntry{ material.specularFactor, static_cast<uint32_t>(material.texturePaths.size()) });
+        for (const auto & texture : material.texturePaths)
+        {
+            append(materialData, TextureEntry{ static_cast<uint32_t>(texture.first), static_cast<uint32_t>(texture.second.size()) });
+            materialData.insert(materialData.end(), texture.second.begin(), texture.second.end());
+            materialData.resize(padded(materialData.size()), 0);
+        }
+    }
+
+    auto offset = uint64_t(sizeof(FileHeader) + geometries.size() * sizeof(MeshEntry) + materialData.size());
+
+    std::vector<MeshEntry> entries;
+    for (const auto geometry : geometries)
+    {
+        auto entry = MeshEntry{ geometry->materialIndex(), 0,
+            static_cast<uint32_t>(geometry->vertices().size()), static_cast<uint32_t>(geometry->indices().size()), offset };
+        if (geometry->hasNormals())
+            entry.flags |= HasNormals;
+        if (geometry->hasTextureCoordinates())
+            entry.flags |= HasTextureCoordinates;
+
+        entries.push_back(entry);
+        offset += meshDataSize(entry);
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.meshCount = static_cast<uint32_t>(entries.size());
+    header.materialCount = static_cast<uint32_t>(materials.size());
+    header.vertexScale = m_vertexScale;
+    header.reserved = 0;
+    if (!fileStatus(m_modelFilename, header.sourceSize, header.sourceModificationTime))
+        return false;
+
+    // the meshes point into the mapped file, which can't be replaced while it is mapped
+    m_meshes.clear();
+    m_materials.clear();
+    m_file.reset();
+
+    auto written = writeFileAtomically(m_filename, [&](std::ostream & stream) {
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+        stream.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(MeshEntry));
+        stream.write(materialData.data(), materialData.size());
+
+        for (const auto geometry : geometries)
+        {
+            stream.write(reinterpret_cast<const char *>(geometry->indices().data()), geometry->indices().size() * sizeof(unsigned int));
+            stream.write(reinterpret_cast<const char *>(geometry->vertices().data()), geometry->vertices().size() * sizeof(glm::vec3));
+            if (geometry->hasNormals())
+                stream.write(reinterpret_cast<const char *>(geometry->normals().data()), geometry->normals().size() * sizeof(glm::vec3));
+            if (geometry->hasTextureCoordinates())
+                stream.write(reinterpret_cast<const char *>(geometry->textureCoordinates().data()), geometry->textureCoordinates().size() * sizeof(glm::vec3));
+        }
+    });
+
+    if (!written)
+        std::cout << "Could not write mesh cache " << m_filename << std::endl;
+
+    return written;
+}
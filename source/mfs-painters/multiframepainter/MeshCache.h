@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "Material.h"
+
+namespace gloperate
+{
+    class PolygonalGeometry;
+}
+
+class MappedFile;
+
+
+// Post-processed geometry and material table of a model, persisted in a binary file next to the model
+// that is memory-mapped on load. The file is ignored once the model file or the vertex scale changes.
+class MeshCache
+{
+public:
+    // points into the mapped file, normals and texture coordinates are null if the mesh has none
+    struct Mesh
+    {
+        unsigned int materialIndex;
+        size_t vertexCount;
+        size_t indexCount;
+        const unsigned int * indices;
+        const glm::vec3 * vertices;
+        const glm::vec3 * normals;
+        const glm::vec3 * textureCoordinates;
+    };
+
+    MeshCache(const std::string & modelFilename, float vertexScale);
+    ~MeshCache();
+
+    // whether the file matches the model, meshes() and materials() are empty otherwise
+    bool valid() const;
+
+    const std::vector<Mesh> & meshes() const;
+    const std::vector<MaterialDescription> & materials() const;
+
+    // replaces the file, releases the mapping of the old one
+    bool save(const std::vector<const gloperate::PolygonalGeometry *> & geometries, const std::vector<MaterialDescription> & materials);
+
+protected:
+    void load();
+
+    std::string m_modelFilename;
+    std::string m_filename;
+    float m_vertexScale;
+
+    std::unique_ptr<MappedFile> m_file;
+    std::vector<Mesh> m_meshes;
+    std::vector<MaterialDescription> m_materials;
+};
@@ -0,0 +1,459 @@
+#include "MeshOptimization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <gloperate/primitives/PolygonalGeometry.h>
+
+
+namespace
+{
+    // the cache modeled by the optimization is larger than the one of the statistics, as in Forsyth's paper
+    const size_t s_optimizationCacheSize = 32;
+    const size_t s_analysisCacheSize = 16;
+
+    const float s_cacheDecayPower = 1.5f;
+    const float s_lastTriangleScore = 0.75f;
+    const float s_valenceBoostScale = 2.0f;
+    const float s_valenceBoostPower = 0.5f;
+
+    const int s_overdrawViewSize = 256;
+
+    const unsigned int s_invalidIndex = std::numeric_limits<unsigned int>::max();
+
+    // the number of cache misses of each triangle, for a FIFO cache
+    std::vector<unsigned char> simulateCache(const std::vector<unsigned int> & indices, size_t vertexCount, size_t cacheSize)
+    {
+        std::vector<unsigned char> misses(indices.size() / 3, 0);
+
+        // a vertex is in the cache if fewer than cacheSize vertices have been loaded since its own load
+        std::vector<size_t> loadTimes(vertexCount, 0);
+        auto time = cacheSize + 1;
+
+        for (auto i = 0u; i < indices.size(); ++i)
+        {
+            auto & loadTime = loadTimes[indices[i]];
+            if (time - loadTime > cacheSize)
+            {
+                loadTime = time++;
+                ++misses[i / 3];
+            }
+        }
+
+        return misses;
+    }
+
+    glm::vec3 triangleNormal(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, size_t triangle)
+    {
+        const auto & a = vertices[indices[3 * triangle + 0]];
+        const auto & b = vertices[indices[3 * triangle + 1]];
+        const auto & c = vertices[indices[3 * triangle + 2]];
+
+        // the length is twice the area
+        return glm::cross(b - a, c - a);
+    }
+
+    glm::vec3 triangleCenter(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, size_t triangle)
+    {
+        return (vertices[indices[3 * triangle + 0]] + vertices[indices[3 * triangle + 1]] + vertices[indices[3 * triangle + 2]]) / 3.0f;
+    }
+
+    uint32_t spreadBits(uint32_t x)
+    {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8)) & 0x0300f00f;
+        x = (x | (x << 4)) & 0x030c30c3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    void sortSpatially(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices)
+    {
+        auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (const auto & vertex : vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex);
+            boundsMax = glm::max(boundsMax, vertex);
+        }
+        auto scale = 1023.0f / glm::max(boundsMax - boundsMin, glm::vec3(std::numeric_limits<float>::min()));
+
+        auto triangleCount = indices.size() / 3;
+        std::vector<std::pair<uint32_t, unsigned int>> codes(triangleCount);
+        for (auto triangle = 0u; triangle < triangleCount; ++triangle)
+        {
+            auto cell = (triangleCenter(indices, vertices, triangle) - boundsMin) * scale;
+            auto code = spreadBits(static_cast<uint32_t>(cell.x)) | (spreadBits(static_cast<uint32_t>(cell.y)) << 1) | (spreadBits(static_cast<uint32_t>(cell.z)) << 2);
+            codes[triangle] = { code, triangle };
+        }
+
+        std::sort(codes.begin(), codes.end());
+
+        std::vector<unsigned int> sorted;
+        sorted.reserve(indices.size());
+        for (const auto & code : codes)
+            sorted.insert(sorted.end(), indices.begin() + 3 * code.second, indices.begin() + 3 * code.second + 3);
+
+        indices = std::move(sorted);
+    }
+
+    float vertexScore(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        auto score = 0.0f;
+        if (cachePosition >= 3)
+            score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (s_optimizationCacheSize - 3), s_cacheDecayPower);
+        else if (cachePosition >= 0)
+            score = s_lastTriangleScore;
+
+        // vertices with few triangles left are finished first, so they don't have to be loaded again later
+        return score + s_valenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -s_valenceBoostPower);
+    }
+
+    // Tom Forsyth, Linear-Speed Vertex Cache Optimisation
+    void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertexCount)
+    {
+        auto triangleCount = indices.size() / 3;
+
+        // the triangles of each vertex that have not been emitted yet, the emitted ones are swapped to the back
+        std::vector<unsigned int> remaining(vertexCount, 0);
+        for (auto index : indices)
+            ++remaining[index];
+
+        std::vector<size_t> offsets(vertexCount + 1, 0);
+        for (auto vertex = 0u; vertex < vertexCount; ++vertex)
+            offsets[vertex + 1] = offsets[vertex] + remaining[vertex];
+
+        std::vector<unsigned int> adjacency(indices.size());
+        {
+            auto fill = offsets;
+            for (auto i = 0u; i < indices.size(); ++i)
+                adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        std::vector<int> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (auto vertex = 0u; vertex < vertexCount; ++vertex)
+            vertexScores[vertex] = vertexScore(-1, remaining[vertex]);
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> cache;
+        std::vector<unsigned int> nextCache;
+        cache.reserve(s_optimizationCacheSize + 3);
+        nextCache.reserve(s_optimizationCacheSize + 3);
+
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+
+        auto nextInputTriangle = 0u;
+        auto best = s_invalidIndex;
+
+        while (result.size() < indices.size())
+        {
+            // the cache has run dry, the traversal continues in input order
+            if (best == s_invalidIndex)
+            {
+                while (emitted[nextInputTriangle])
+                    ++nextInputTriangle;
+
+                best = nextInputTriangle;
+            }
+
+            emitted[best] = true;
+            nextCache.clear();
+
+            for (auto corner = 0u; corner < 3; ++corner)
+            {
+                auto vertex = indices[3 * best + corner];
+                result.push_back(vertex);
+
+                auto begin = adjacency.begin() + offsets[vertex];
+                auto end = begin + remaining[vertex];
+                auto position = std::find(begin, end, best);
+                if (position != end)
+                {
+                    std::iter_swap(position, end - 1);
+                    --remaining[vertex];
+                }
+
+                if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+                    nextCache.push_back(vertex);
+            }
+
+            // the emitted triangle's vertices move to the front, the ones pushed beyond the cache size are evicted
+            for (auto vertex : cache)
+            {
+                if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+                    nextCache.push_back(vertex);
+            }
+
+            for (auto i = 0u; i < nextCache.size(); ++i)
+            {
+                auto vertex = nextCache[i];
+                cachePositions[vertex] = i < s_optimizationCacheSize ? static_cast<int>(i) : -1;
+                vertexScores[vertex] = vertexScore(cachePositions[vertex], remaining[vertex]);
+            }
+
+            // only the triangles of cached vertices change their score, the best of them is emitted next
+            best = s_invalidIndex;
+            auto bestScore = 0.0f;
+            for (auto vertex : nextCache)
+            {
+                for (auto i = offsets[vertex]; i < offsets[vertex] + remaining[vertex]; ++i)
+                {
+                    auto triangle = adjacency[i];
+                    auto score = vertexScores[indices[3 * triangle]] + vertexScores[indices[3 * triangle + 1]] + vertexScores[indices[3 * triangle + 2]];
+
+                    if (score > bestScore)
+                    {
+                        best = triangle;
+                        bestScore = score;
+                    }
+                }
+            }
+
+            nextCache.resize(std::min(nextCache.size(), s_optimizationCacheSize));
+            std::swap(cache, nextCache);
+        }
+
+        indices = std::move(result);
+    }
+
+    // Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced Overdraw. the clusters start where
+    // the cache has been flushed, so reordering them costs little locality. outward facing clusters are drawn
+    // first, they are more likely to occlude the others
+    void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices)
+    {
+        auto triangleCount = indices.size() / 3;
+        auto misses = simulateCache(indices, vertices.size(), s_analysisCacheSize);
+
+        struct Cluster
+        {
+            size_t first;
+            size_t count;
+            glm::vec3 center;
+            glm::vec3 normal;
+            float area;
+            float sortKey;
+        };
+
+        std::vector<Cluster> clusters;
+        auto meshCenter = glm::vec3(0.0f);
+        auto meshArea = 0.0f;
+
+        for (auto triangle = 0u; triangle < triangleCount; ++triangle)
+        {
+            if (clusters.empty() || misses[triangle] == 3)
+                clusters.push_back({ triangle, 0, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, 0.0f });
+
+            auto & cluster = clusters.back();
+            auto normal = triangleNormal(indices, vertices, triangle);
+            auto area = glm::length(normal);
+            auto center = triangleCenter(indices, vertices, triangle);
+
+            ++cluster.count;
+            cluster.center += center * area;
+            cluster.normal += normal;
+            cluster.area += area;
+
+            meshCenter += center * area;
+            meshArea += area;
+        }
+
+        if (clusters.size() < 2 || meshArea <= 0.0f)
+            return;
+
+        meshCenter /= meshArea;
+        for (auto & cluster : clusters)
+        {
+            if (cluster.area > 0.0f && glm::length(cluster.normal) > 0.0f)
+                cluster.sortKey = glm::dot(cluster.center / cluster.area - meshCenter, glm::normalize(cluster.normal));
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster & a, const Cluster & b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<unsigned int> sorted;
+        sorted.reserve(indices.size());
+        for (const auto & cluster : clusters)
+            sorted.insert(sorted.end(), indices.begin() + 3 * cluster.first, indices.begin() + 3 * (cluster.first + cluster.count));
+
+        indices = std::move(sorted);
+    }
+
+    std::vector<glm::vec3> reorder(const std::vector<glm::vec3> & attribute, const std::vector<unsigned int> & remap, size_t count)
+    {
+        std::vector<glm::vec3> reordered(count);
+        for (auto i = 0u; i < attribute.size(); ++i)
+        {
+            if (remap[i] != s_invalidIndex)
+                reordered[remap[i]] = attribute[i];
+        }
+
+        return reordered;
+    }
+
+    // the vertices in order of first use, unused ones are dropped
+    void optimizeVertexFetch(gloperate::PolygonalGeometry & geometry, std::vector<unsigned int> & indices)
+    {
+        std::vector<unsigned int> remap(geometry.vertices().size(), s_invalidIndex);
+        auto vertexCount = 0u;
+        for (auto & index : indices)
+        {
+            if (remap[index] == s_invalidIndex)
+                remap[index] = vertexCount++;
+
+            index = remap[index];
+        }
+
+        geometry.setVertices(reorder(geometry.vertices(), remap, vertexCount));
+        if (geometry.hasNormals())
+            geometry.setNormals(reorder(geometry.normals(), remap, vertexCount));
+        if (geometry.hasTextureCoordinates())
+            geometry.setTextureCoordinates(reorder(geometry.textureCoordinates(), remap, vertexCount));
+        geometry.setIndices(std::move(indices));
+    }
+
+    float edge(const glm::vec3 & a, const glm::vec3 & b, float x, float y)
+    {
+        return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+    }
+}
+
+
+MeshStatistics::MeshStatistics()
+: triangleCount(0)
+, cacheMisses(0)
+, shadedPixels(0)
+, coveredPixels(0)
+{
+}
+
+float MeshStatistics::acmr() const
+{
+    return triangleCount > 0 ? static_cast<float>(cacheMisses) / triangleCount : 0.0f;
+}
+
+float MeshStatistics::overdraw() const
+{
+    return coveredPixels > 0 ? static_cast<float>(shadedPixels) / coveredPixels : 1.0f;
+}
+
+MeshStatistics & MeshStatistics::operator+=(const MeshStatistics & other)
+{
+    triangleCount += other.triangleCount;
+    cacheMisses += other.cacheMisses;
+    shadedPixels += other.shadedPixels;
+    coveredPixels += other.coveredPixels;
+    return *this;
+}
+
+MeshStatistics analyzeMesh(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices)
+{
+    MeshStatistics statistics;
+    statistics.triangleCount = indices.size() / 3;
+    if (statistics.triangleCount == 0)
+        return statistics;
+
+    for (auto misses : simulateCache(indices, vertices.size(), s_analysisCacheSize))
+        statistics.cacheMisses += misses;
+
+    auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const auto & vertex : vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex);
+        boundsMax = glm::max(boundsMax, vertex);
+    }
+    auto scale = static_cast<float>(s_overdrawViewSize - 1) / glm::max(boundsMax - boundsMin, glm::vec3(std::numeric_limits<float>::min()));
+
+    std::vector<float> depthBuffer(s_overdrawViewSize * s_overdrawViewSize);
+    std::vector<glm::vec3> projected(vertices.size());
+
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        for (auto sign : { 1.0f, -1.0f })
+        {
+            // looking along -sign * axis, with a right-handed screen space, so front faces are counter-clockwise
+            auto uAxis = (axis + 1) % 3;
+            auto vAxis = (axis + 2) % 3;
+            auto uMin = sign > 0.0f ? boundsMin[uAxis] : -boundsMax[uAxis];
+
+            for (auto i = 0u; i < vertices.size(); ++i)
+            {
+                const auto & vertex = vertices[i];
+                projected[i] = glm::vec3((sign * vertex[uAxis] - uMin) * scale[uAxis], (vertex[vAxis] - boundsMin[vAxis]) * scale[vAxis], -sign * vertex[axis]);
+            }
+
+            std::fill(depthBuffer.begin(), depthBuffer.end(), std::numeric_limits<float>::max());
+
+            for (auto i = 0u; i + 2 < indices.size(); i += 3)
+            {
+                const auto & a = projected[indices[i]];
+                const auto & b = projected[indices[i + 1]];
+                const auto & c = projected[indices[i + 2]];
+
+                auto area = edge(a, b, c.x, c.y);
+                if (area <= 0.0f)
+                    continue;
+
+                auto xBegin = std::max(static_cast<int>(std::ceil(std::min({ a.x, b.x, c.x }))), 0);
+                auto xEnd = std::min(static_cast<int>(std::floor(std::max({ a.x, b.x, c.x }))), s_overdrawViewSize - 1);
+                auto yBegin = std::max(static_cast<int>(std::ceil(std::min({ a.y, b.y, c.y }))), 0);
+                auto yEnd = std::min(static_cast<int>(std::floor(std::max({ a.y, b.y, c.y }))), s_overdrawViewSize - 1);
+
+                for (auto y = yBegin; y <= yEnd; ++y)
+                {
+                    for (auto x = xBegin; x <= xEnd; ++x)
+                    {
+                        auto wa = edge(b, c, static_cast<float>(x), static_cast<float>(y));
+                        auto wb = edge(c, a, static_cast<float>(x), static_cast<float>(y));
+                        auto wc = edge(a, b, static_cast<float>(x), static_cast<float>(y));
+                        if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+                            continue;
+
+                        auto depth = (wa * a.z + wb * b.z + wc * c.z) / area;
+                        auto & stored = depthBuffer[y * s_overdrawViewSize + x];
+                        if (depth < stored)
+                        {
+                            stored = depth;
+                            ++statistics.shadedPixels;
+                        }
+                    }
+                }
+            }
+
+            statistics.coveredPixels += static_cast<size_t>(std::count_if(depthBuffer.begin(), depthBuffer.end(), [](float depth) {
+                return depth != std::numeric_limits<float>::max();
+            }));
+        }
+    }
+
+    return statistics;
+}
+
+void optimizeMesh(gloperate::PolygonalGeometry & geometry)
+{
+    auto indices = geometry.indices();
+    const auto & vertices = geometry.vertices();
+    if (indices.size() < 3 || vertices.empty())
+        return;
+
+    indices.resize(indices.size() - indices.size() % 3);
+
+    sortSpatially(indices, vertices);
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(geometry, indices);
+}
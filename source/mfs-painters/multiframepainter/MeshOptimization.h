@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+namespace gloperate
+{
+    class PolygonalGeometry;
+}
+
+
+// Sums over one or more meshes, so the statistics of a whole model can be accumulated
+struct MeshStatistics
+{
+    MeshStatistics();
+
+    // average cache misses per triangle, for a FIFO post-transform cache of 16 vertices
+    float acmr() const;
+    // shaded per covered pixel, for orthographic views along the six axis directions
+    float overdraw() const;
+
+    MeshStatistics & operator+=(const MeshStatistics & other);
+
+    size_t triangleCount;
+    size_t cacheMisses;
+    size_t shadedPixels;
+    size_t coveredPixels;
+};
+
+MeshStatistics analyzeMesh(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices);
+
+// Reorders the triangles for the post-transform vertex cache (Forsyth), then clusters of them for less overdraw
+// (Sander et al.), and the vertices in order of first use. The triangles are sorted in Morton order first,
+// whenever the cache runs dry the traversal continues with the next one in that order, so consecutive
+// triangles are spatially coherent, which also holds for the surfels captured from them.
+void optimizeMesh(gloperate::PolygonalGeometry & geometry);
@@ -2,6 +2,10 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iterator>
+#include <limits>
 
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -9,10 +13,10 @@
 #include <glbinding/gl/enum.h>
 
 #include <globjects/Texture.h>
+#include <globjects/base/baselogging.h>
 
 #include <gloperate/primitives/PolygonalGeometry.h>
 #include <gloperate/primitives/Scene.h>
-#include <gloperate/resources/ResourceManager.h>
 #include <gloperate/base/make_unique.hpp>
 
 #include <assimp/scene.h>
@@ -21,6 +25,9 @@
 #include <assimp/postprocess.h>
 #include <assimp/material.h>
 
+#include "TextureLoader.h"
+#include "MeshOptimization.h"
+
 using namespace gl;
 using gloperate::make_unique;
 
@@ -52,31 +59,199 @@ namespace
 
         return conversion.at(aiTexType);
     }
+
+    // a quarter of the loader's staging buffer, so the uploads of a frame rarely wait for the ones of the previous frames
+    const size_t s_uploadBudgetPerFrame = 16 * 1024 * 1024;
+
+    // the shaders only read the channels that are kept
+    BlockCompression textureCompression(TextureType type, BumpType bumpType)
+    {
+        switch (type)
+        {
+        case TextureType::Diffuse:
+            return BlockCompression::BC3;
+        case TextureType::Opacity:
+            return BlockCompression::BC4;
+        case TextureType::Bump:
+            return bumpType == BumpType::Normal ? BlockCompression::BC5 : BlockCompression::BC4;
+        default:
+            return BlockCompression::BC1;
+        }
+    }
 }
 
 ModelLoadingStage::ModelLoadingStage()
-: m_currentPreset(Preset::None)
+: m_maxAnisotropy(1.0f)
+, m_textureBudget(1024 * 1024 * 1024)
+, m_requestedPreset(Preset::None)
 {
 }
 
 ModelLoadingStage::~ModelLoadingStage()
 {
+    // the future's destructor waits for the background thread
 }
 
 void ModelLoadingStage::loadScene(Preset preset)
 {
-    m_currentPreset = preset;
-    m_currentPresetInformation = std::make_unique<PresetInformation>(getPresetInformation(preset));
+    m_requestedPreset = preset;
 
-    m_drawablesMap = std::make_unique<IdDrawablesMap>();
-    m_materialMap = std::make_unique<IdMaterialMap>();
-    m_textures = StringTextureMap{};
+    auto data = prepareScene(preset);
+    data->preparation->wait();
 
-    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &m_maxAnisotropy);
+    auto scene = beginScene(*data);
+    uploadTextures(*data, *scene, std::numeric_limits<size_t>::max());
+    finishScene(*data, *scene);
+
+    m_scenes.push_front(std::move(scene));
+    evictScenes();
+}
+
+void ModelLoadingStage::requestScene(Preset preset)
+{
+    m_requestedPreset = preset;
+
+    // a running load is finished first, updateScene() starts the next one
+    if (!loading())
+        startLoading();
+}
+
+bool ModelLoadingStage::updateScene()
+{
+    if (m_loadingScene.valid() && m_loadingScene.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        m_uploadingData = m_loadingScene.get();
+        m_uploadingScene = beginScene(*m_uploadingData);
+    }
+
+    // uploading all textures at once would stall the frame the scene is swapped in
+    auto changed = false;
+    if (m_uploadingScene && uploadTextures(*m_uploadingData, *m_uploadingScene, s_uploadBudgetPerFrame))
+    {
+        finishScene(*m_uploadingData, *m_uploadingScene);
+        m_uploadingData = nullptr;
+
+        // keep it around even if another preset has been requested meanwhile
+        changed = m_scenes.empty();
+        m_scenes.insert(changed ? m_scenes.begin() : std::next(m_scenes.begin()), std::move(m_uploadingScene));
+        evictScenes();
+    }
+
+    if (!hasScene() || m_scenes.front()->preset == m_requestedPreset)
+        return changed;
+
+    auto cached = std::find_if(m_scenes.begin(), m_scenes.end(), [this](const std::unique_ptr<Scene>& scene) {
+        return scene->preset == m_requestedPreset;
+    });
+
+    if (cached == m_scenes.end())
+    {
+        if (!loading())
+            startLoading();
+
+        return changed;
+    }
+
+    m_scenes.splice(m_scenes.begin(), m_scenes, cached);
+    return true;
+}
+
+bool ModelLoadingStage::updateTextureStreaming()
+{
+    if (!hasScene())
+        return false;
+
+    auto& scene = *m_scenes.front();
+    if (!scene.textureStreaming)
+        return false;
+
+    return scene.textureStreaming->update(*scene.materialTable);
+}
+
+size_t ModelLoadingStage::textureBudget() const
+{
+    return m_textureBudget;
+}
+
+void ModelLoadingStage::setTextureBudget(size_t budget)
+{
+    m_textureBudget = budget;
+
+    for (auto& scene : m_scenes)
+    {
+        if (scene->textureStreaming)
+            scene->textureStreaming->setBudget(budget);
+    }
+
+    if (m_uploadingScene && m_uploadingScene->textureStreaming)
+        m_uploadingScene->textureStreaming->setBudget(budget);
+}
+
+bool ModelLoadingStage::loading() const
+{
+    return m_loadingScene.valid() || m_uploadingScene;
+}
+
+bool ModelLoadingStage::hasScene() const
+{
+    return !m_scenes.empty();
+}
+
+void ModelLoadingStage::startLoading()
+{
+    auto preset = m_requestedPreset;
+    auto cached = std::any_of(m_scenes.begin(), m_scenes.end(), [preset](const std::unique_ptr<Scene>& scene) {
+        return scene->preset == preset;
+    });
+
+    if (!cached)
+        m_loadingScene = std::async(std::launch::async, &ModelLoadingStage::prepareScene, preset);
+}
+
+void ModelLoadingStage::evictScenes()
+{
+    // the GPU memory of a scene is released with its geometry and textures
+    while (m_scenes.size() > s_residentSceneCount)
+        m_scenes.pop_back();
+}
+
+std::unique_ptr<ModelLoadingStage::SceneData> ModelLoadingStage::prepareScene(Preset preset)
+{
+    auto data = std::make_unique<SceneData>();
+    data->preset = preset;
+    data->information = getPresetInformation(preset);
 
     auto modelFilename = getFilename(preset);
-    auto dir = getDirectory(modelFilename);
 
+    // skips the assimp import and its post-processing, which take far longer than rendering a frame
+    MeshCache meshCache(modelFilename, data->information.vertexScale);
+    if (meshCache.valid())
+    {
+        data->materials = meshCache.materials();
+        for (const auto & cachedMesh : meshCache.meshes())
+            data->geometries.push_back(convertGeometry(cachedMesh));
+    }
+    else
+    {
+        importScene(modelFilename, meshCache, *data);
+    }
+
+    std::vector<TextureLoader::Key> requests;
+    for (const auto& material : data->materials)
+    {
+        for (const auto& texturePath : material.texturePaths)
+            requests.push_back(textureKey(texturePath.first, texturePath.second, data->information.bumpType));
+    }
+    std::sort(requests.begin(), requests.end());
+    requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+    data->preparation = std::make_unique<TextureLoader::Preparation>(std::move(requests));
+
+    return data;
+}
+
+bool ModelLoadingStage::importScene(const std::string& modelFilename, MeshCache& meshCache, SceneData& data)
+{
+    auto dir = getDirectory(modelFilename);
 
     const aiScene* assimpScene = aiImportFile(
         modelFilename.c_str(),
@@ -93,57 +268,143 @@ void ModelLoadingStage::loadScene(Preset preset)
     {
         std::cout << "Model could not be loaded: " << aiGetErrorString() << std::endl;
 
-        return ;
+        return false;
     }
 
     for (unsigned int m = 0; m < assimpScene->mNumMaterials; m++)
+        data.materials.push_back(describeMaterial(assimpScene->mMaterials[m], dir));
+
+    // the optimization is only paid for when the mesh cache is written
+    MeshStatistics before;
+    MeshStatistics after;
+
+    std::vector<const gloperate::PolygonalGeometry *> geometries;
+    for (size_t i = 0; i < assimpScene->mNumMeshes; ++i)
     {
-        auto mat = loadMaterial(assimpScene->mMaterials[m], dir);
-        (*m_materialMap)[m] = mat;
-        (*m_drawablesMap)[m] = PolygonalDrawables{};
+        auto geometry = convertGeometry(assimpScene->mMeshes[i], data.information.vertexScale);
+
+        before += analyzeMesh(geometry->indices(), geometry->vertices());
+        optimizeMesh(*geometry);
+        after += analyzeMesh(geometry->indices(), geometry->vertices());
+
+        geometries.push_back(geometry.get());
+        data.geometries.push_back(std::move(geometry));
     }
 
-    for (size_t i = 0; i < assimpScene->mNumMeshes; ++i)
+    aiReleaseImport(assimpScene);
+
+    std::cout << "Mesh optimization: ACMR " << before.acmr() << " -> " << after.acmr()
+        << ", overdraw " << before.overdraw() << " -> " << after.overdraw() << std::endl;
+
+    if (!meshCache.save(geometries, data.materials))
+        std::cout << "Could not write the mesh cache for " << modelFilename << std::endl;
+
+    return true;
+}
+
+std::unique_ptr<ModelLoadingStage::Scene> ModelLoadingStage::beginScene(const SceneData& data)
+{
+    auto scene = std::make_unique<Scene>();
+    scene->preset = data.preset;
+    scene->information = data.information;
+
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &m_maxAnisotropy);
+
+    if (!m_textureLoader)
+        m_textureLoader = std::make_unique<TextureLoader>();
+
+    // only the coarsest levels are uploaded with the scene, the finer ones once the texture feedback requests them
+    if (MaterialTable::bindlessSupported())
+    {
+        auto setup = [this](globjects::Texture* texture) { setupTexture(texture); };
+        scene->textureStreaming = std::make_unique<TextureStreaming>(*m_textureLoader, setup, m_textureBudget);
+    }
+
+    return scene;
+}
+
+bool ModelLoadingStage::uploadTextures(SceneData& data, Scene& scene, size_t uploadBudget)
+{
+    auto prepared = data.preparation->take(data.textures);
+
+    // at least one texture per call, even if it exceeds the budget on its own
+    size_t uploaded = 0;
+    while (!data.textures.empty() && uploaded < uploadBudget)
     {
-        auto mesh = convertGeometry(assimpScene->mMeshes[i], m_currentPresetInformation->vertexScale);
-        auto& drawables = m_drawablesMap->at(mesh->materialIndex());
-        drawables.push_back(std::make_unique<PolygonalDrawable>(*mesh.get()));
+        auto texture = data.textures.begin();
+        if (!texture->second.valid)
+            globjects::warning() << "Texture could not be loaded, using a neutral replacement: " << texture->first.first;
+
+        if (scene.textureStreaming)
+        {
+            auto residentSize = scene.textureStreaming->residentSize();
+            scene.textures[texture->first] = scene.textureStreaming->add(std::move(texture->second.image));
+            uploaded += scene.textureStreaming->residentSize() - residentSize;
+        }
+        else
+        {
+            auto uploadedTexture = m_textureLoader->upload(texture->second.image);
+            setupTexture(uploadedTexture);
+            scene.textures[texture->first] = uploadedTexture;
+
+            for (const auto& level : texture->second.image.levels)
+                uploaded += level.size();
+        }
+
+        data.textures.erase(texture);
     }
 
-    if (preset == Preset::CrytekSponza) {
-        auto newMatIndex = assimpScene->mNumMaterials;
+    return prepared && data.textures.empty();
+}
+
+void ModelLoadingStage::finishScene(SceneData& data, Scene& scene)
+{
+    for (unsigned int m = 0; m < data.materials.size(); m++)
+    {
+        scene.materials[m] = loadMaterial(data.materials[m], data.information.bumpType, scene.textures);
+    }
+
+    if (data.preset == Preset::CrytekSponza) {
+        auto newMatIndex = static_cast<unsigned int>(scene.materials.size());
         Material mat;
-        (*m_materialMap)[newMatIndex] = mat;
+        scene.materials[newMatIndex] = mat;
 
         std::unique_ptr<Icosahedron> drawable = std::move(std::make_unique<Icosahedron>());
         drawable->modelMatrix = glm::translate(drawable->modelMatrix, { 0.0f, 1.0f, -0.3f });
 
         auto drawables = PolygonalDrawables{};
         drawables.push_back(std::move(drawable));
-        (*m_drawablesMap)[newMatIndex] = std::move(drawables);
+        scene.drawables[newMatIndex] = std::move(drawables);
 
     }
 
-    aiReleaseImport(assimpScene);
+    // after all materials are known, including the ones of procedural drawables
+    scene.geometry = std::make_unique<SceneGeometry>(data.geometries, scene.materials);
+    scene.materialTable = std::make_unique<MaterialTable>(scene.materials, m_maxAnisotropy, scene.textureStreaming.get());
+
+    // the texture arrays hold copies, keeping the textures would double their memory
+    if (!MaterialTable::bindlessSupported())
+    {
+        for (auto& material : scene.materials)
+            material.second.releaseTextures();
+
+        scene.textures.clear();
+    }
 }
 
-globjects::ref_ptr<globjects::Texture> ModelLoadingStage::loadTexture(const std::string& filename) const
+void ModelLoadingStage::setupTexture(globjects::Texture* tex) const
 {
-    globjects::ref_ptr<globjects::Texture> tex = resourceManager->load<globjects::Texture>(filename);
     tex->setParameter(GL_TEXTURE_WRAP_R, GL_REPEAT);
     tex->setParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
     tex->setParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
     tex->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     tex->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     tex->setParameter(GL_TEXTURE_MAX_ANISOTROPY_EXT, m_maxAnisotropy);
-    tex->generateMipmap();
-
-    return tex;
 }
 
-Material ModelLoadingStage::loadMaterial(aiMaterial* aiMat, const std::string& directory)
+MaterialDescription ModelLoadingStage::describeMaterial(aiMaterial* aiMat, const std::string& directory)
 {
-    Material material;
+    MaterialDescription description;
 
     for (aiTextureType aiTexType : textureTypes)
     {
@@ -153,7 +414,7 @@ Material ModelLoadingStage::loadMaterial(aiMaterial* aiMat, const std::string& d
         aiReturn ret = aiMat->Get(AI_MATKEY_SHININESS, specularFactor);
         if (ret == aiReturn_SUCCESS)
         {
-            material.specularFactor = specularFactor;
+            description.specularFactor = specularFactor;
         }
 
         aiString texPath;
@@ -166,25 +427,36 @@ Material ModelLoadingStage::loadMaterial(aiMaterial* aiMat, const std::string& d
         auto path = directory + "/" + texPathStd;
         std::replace(path.begin(), path.end(), '\\', '/');
 
-        globjects::ref_ptr<globjects::Texture> texture = nullptr;
-        auto textureIt = m_textures.find(path);
-        if (textureIt != m_textures.end())
-        {
-            texture = (*textureIt).second;
-        }
-        else
-        {
-            texture = loadTexture(path);
-            m_textures[path] = texture;
-        }
+        description.texturePaths[type] = path;
+    }
+
+    return description;
+}
+
+TextureLoader::Key ModelLoadingStage::textureKey(TextureType type, const std::string& path, BumpType bumpType)
+{
+    return TextureLoader::Key(path, textureCompression(type, bumpType));
+}
+
+Material ModelLoadingStage::loadMaterial(const MaterialDescription& description, BumpType bumpType, const TextureLoader::Textures& textures)
+{
+    Material material;
+    material.specularFactor = description.specularFactor;
+
+    for (const auto& texturePath : description.texturePaths)
+    {
+        // every requested texture has been prepared, failed ones are replaced by a neutral texture
+        auto texture = textures.find(textureKey(texturePath.first, texturePath.second, bumpType));
+        if (texture == textures.end())
+            continue;
 
-        material.addTexture(type, texture);
+        material.addTexture(texturePath.first, texture->second);
     }
 
     return material;
 }
 
-PresetInformation ModelLoadingStage::getPresetInformation(Preset preset)
+const PresetInformation& ModelLoadingStage::getPresetInformation(Preset preset)
 {
     static const std::map<Preset, PresetInformation> conversion {
         //                          camera eye             camera center          near;far         light position       light center     light radius   ground color   ground height  alpha   bump mapping type  reflections  zThickness  focalDist  focalRadius vertex scale
@@ -217,7 +489,7 @@ std::string ModelLoadingStage::getFilename(Preset preset)
     return conversion.at(preset);
 }
 
-std::unique_ptr<gloperate::PolygonalGeometry> ModelLoadingStage::convertGeometry(const aiMesh * mesh, float vertexScale) const
+std::unique_ptr<gloperate::PolygonalGeometry> ModelLoadingStage::convertGeometry(const aiMesh * mesh, float vertexScale)
 {
     auto geometry = make_unique<gloperate::PolygonalGeometry>();
 
@@ -265,19 +537,60 @@ std::unique_ptr<gloperate::PolygonalGeometry> ModelLoadingStage::convertGeometry
 
     return geometry;
 }
+
+std::unique_ptr<gloperate::PolygonalGeometry> ModelLoadingStage::convertGeometry(const MeshCache::Mesh & mesh)
+{
+    auto geometry = make_unique<gloperate::PolygonalGeometry>();
+
+    // the cached geometry is already scaled
+    geometry->setIndices(std::vector<unsigned int>(mesh.indices, mesh.indices + mesh.indexCount));
+    geometry->setVertices(std::vector<glm::vec3>(mesh.vertices, mesh.vertices + mesh.vertexCount));
+
+    if (mesh.normals)
+        geometry->setNormals(std::vector<glm::vec3>(mesh.normals, mesh.normals + mesh.vertexCount));
+
+    if (mesh.textureCoordinates)
+        geometry->setTextureCoordinates(std::vector<glm::vec3>(mesh.textureCoordinates, mesh.textureCoordinates + mesh.vertexCount));
+
+    geometry->setMaterialIndex(mesh.materialIndex);
+
+    return geometry;
+}
 const Preset& ModelLoadingStage::getCurrentPreset() const
 {
-    return m_currentPreset;
+    // the requested scene is the one that is loaded first
+    return hasScene() ? m_scenes.front()->preset : m_requestedPreset;
 }
 const PresetInformation& ModelLoadingStage::getCurrentPresetInformation() const
 {
-    return *m_currentPresetInformation.get();
+    if (hasScene())
+        return m_scenes.front()->information;
+
+    // loadScene() or requestScene() has to be called first
+    assert(m_requestedPreset != Preset::None);
+    return getPresetInformation(m_requestedPreset);
+}
+const SceneGeometry& ModelLoadingStage::getSceneGeometry() const
+{
+    assert(hasScene());
+    return *m_scenes.front()->geometry;
+}
+const MaterialTable& ModelLoadingStage::getMaterialTable() const
+{
+    assert(hasScene());
+    return *m_scenes.front()->materialTable;
+}
+TextureStreaming* ModelLoadingStage::getTextureStreaming() const
+{
+    return hasScene() ? m_scenes.front()->textureStreaming.get() : nullptr;
 }
 const IdDrawablesMap& ModelLoadingStage::getDrawablesMap() const
 {
-    return *m_drawablesMap.get();
+    static const IdDrawablesMap none;
+    return hasScene() ? m_scenes.front()->drawables : none;
 }
 const IdMaterialMap& ModelLoadingStage::getMaterialMap() const
 {
-    return *m_materialMap.get();
+    static const IdMaterialMap none;
+    return hasScene() ? m_scenes.front()->materials : none;
 }
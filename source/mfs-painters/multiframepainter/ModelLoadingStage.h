@@ -1,5 +1,7 @@
 #pragma once
 
+#include <future>
+#include <list>
 #include <vector>
 #include <memory>
 
@@ -8,6 +10,11 @@
 #include "TypeDefinitions.h"
 #include "Preset.h"
 #include "Material.h"
+#include "MaterialTable.h"
+#include "MeshCache.h"
+#include "SceneGeometry.h"
+#include "TextureLoader.h"
+#include "TextureStreaming.h"
 
 namespace globjects
 {
@@ -18,7 +25,6 @@ namespace gloperate
 {
     class PolygonalGeometry;
     class Drawable;
-    class ResourceManager;
     class Scene;
 }
 
@@ -33,33 +39,97 @@ public:
     ModelLoadingStage();
     ~ModelLoadingStage();
 
-    gloperate::ResourceManager* resourceManager;
-
+    // blocks until the scene is loaded
     void loadScene(Preset preset);
 
+    // loads the scene on a background thread and uploads its textures over several frames, the current scene
+    // keeps being rendered until updateScene() swaps it in
+    void requestScene(Preset preset);
+    // call once per frame on the GL thread, returns whether the current scene has changed
+    bool updateScene();
+    // call once per frame after updateScene(), returns whether any texture of the current scene has been replaced
+    bool updateTextureStreaming();
+    bool loading() const;
+    // false until the first scene is loaded, the scene getters fall back to the requested preset and empty maps
+    bool hasScene() const;
+
+    // in bytes, for the streamed textures of each scene
+    size_t textureBudget() const;
+    void setTextureBudget(size_t budget);
+
     const Preset& getCurrentPreset() const;
     const PresetInformation& getCurrentPresetInformation() const;
+    const SceneGeometry& getSceneGeometry() const;
+    const MaterialTable& getMaterialTable() const;
+    // null without bindless textures, all textures are completely resident then
+    TextureStreaming* getTextureStreaming() const;
+    // drawables that are not part of the scene geometry, e.g. procedural primitives
     const IdDrawablesMap& getDrawablesMap() const;
     const IdMaterialMap& getMaterialMap() const;
 
 
 protected:
-    using StringTextureMap = std::map<std::string, globjects::ref_ptr<globjects::Texture>>;
+    // everything that can be loaded without a GL context
+    struct SceneData
+    {
+        Preset preset;
+        PresetInformation information;
+        std::vector<MaterialDescription> materials;
+        std::vector<std::unique_ptr<gloperate::PolygonalGeometry>> geometries;
+        // keeps preparing the textures while the GL thread uploads the prepared ones
+        std::unique_ptr<TextureLoader::Preparation> preparation;
+        // prepared, but not uploaded yet
+        TextureLoader::PreparedTextures textures;
+    };
+
+    struct Scene
+    {
+        Preset preset;
+        PresetInformation information;
+        std::unique_ptr<SceneGeometry> geometry;
+        // destroyed after the material table, which makes the textures' handles non-resident
+        std::unique_ptr<TextureStreaming> textureStreaming;
+        std::unique_ptr<MaterialTable> materialTable;
+        IdDrawablesMap drawables;
+        IdMaterialMap materials;
+        TextureLoader::Textures textures;
+    };
+
+    // the current scene and the ones used most recently before it
+    static const size_t s_residentSceneCount = 2;
 
     float m_maxAnisotropy;
-    StringTextureMap m_textures;
-
-
-    globjects::ref_ptr<globjects::Texture> loadTexture(const std::string& filename) const;
-    Material loadMaterial(aiMaterial* mat, const std::string& directory);
-    std::unique_ptr<gloperate::PolygonalGeometry> convertGeometry(const aiMesh * mesh, float vertexScale) const;
-
-    static PresetInformation getPresetInformation(Preset preset);
+    size_t m_textureBudget;
+    std::unique_ptr<TextureLoader> m_textureLoader;
+
+    static std::unique_ptr<SceneData> prepareScene(Preset preset);
+    // imports the model with assimp and writes the mesh cache
+    static bool importScene(const std::string& modelFilename, MeshCache& meshCache, SceneData& data);
+    std::unique_ptr<Scene> beginScene(const SceneData& data);
+    // uploads the textures prepared so far until uploadBudget bytes are exceeded, returns whether all are uploaded
+    bool uploadTextures(SceneData& data, Scene& scene, size_t uploadBudget);
+    // once all textures are uploaded
+    void finishScene(SceneData& data, Scene& scene);
+
+    void startLoading();
+    void evictScenes();
+
+    void setupTexture(globjects::Texture* tex) const;
+    static MaterialDescription describeMaterial(aiMaterial* mat, const std::string& directory);
+    static TextureLoader::Key textureKey(TextureType type, const std::string& path, BumpType bumpType);
+    Material loadMaterial(const MaterialDescription& description, BumpType bumpType, const TextureLoader::Textures& textures);
+    static std::unique_ptr<gloperate::PolygonalGeometry> convertGeometry(const aiMesh * mesh, float vertexScale);
+    static std::unique_ptr<gloperate::PolygonalGeometry> convertGeometry(const MeshCache::Mesh & mesh);
+
+    static const PresetInformation& getPresetInformation(Preset preset);
     static std::string getFilename(Preset preset);
 
 
-    Preset m_currentPreset;
-    std::unique_ptr<PresetInformation> m_currentPresetInformation;
-    std::unique_ptr<IdDrawablesMap> m_drawablesMap;
-    std::unique_ptr<IdMaterialMap> m_materialMap;
+    // most recently used first
+    std::list<std::unique_ptr<Scene>> m_scenes;
+    Preset m_requestedPreset;
+    std::future<std::unique_ptr<SceneData>> m_loadingScene;
+    // loaded, its textures are being uploaded
+    std::unique_ptr<SceneData> m_uploadingData;
+    std::unique_ptr<Scene> m_uploadingScene;
 };
@@ -4,6 +4,7 @@
 #include <random>
 #include <memory>
 #include <iostream>
+#include <string>
 
 #include <cpplocate/ModuleInfo.h>
 
@@ -27,8 +28,12 @@
 #include "GIStage.h"
 #include "DeferredShadingStage.h"
 #include "SSAOStage.h"
+#include "AccumulationStage.h"
 #include "BlitStage.h"
+#include "FrameConstants.h"
+#include "AutoTuner.h"
 #include "PerfCounter.h"
+#include "AllocationTracker.h"
 #include "ImperfectShadowmap.h"
 #include "ClusteredShading.h"
 #include "VPLProcessor.h"
@@ -42,7 +47,12 @@ MultiFramePainter::MultiFramePainter(gloperate::ResourceManager & resourceManage
 : Painter("MultiFramePainter", resourceManager, moduleInfo)
 , resourceManager(resourceManager)
 , preset(Preset::CrytekSponza)
+, useDOF(false)
+, m_autoTune(false)
 , m_useFullHD(false)
+, m_multiFrameCount(64)
+, m_currentFrame(1)
+, m_accumulationResetRequired(true)
 {
     // Setup painter
     m_targetFramebufferCapability = addCapability(new gloperate::TargetFramebufferCapability());
@@ -58,9 +68,11 @@ MultiFramePainter::MultiFramePainter(gloperate::ResourceManager & resourceManage
     giStage = std::make_unique<GIStage>(*modelLoadingStage, *kernelGenerationStage);
     ssaoStage = std::make_unique<SSAOStage>(*kernelGenerationStage, *modelLoadingStage);
     deferredShadingStage = std::make_unique<DeferredShadingStage>();
+    accumulationStage = std::make_unique<AccumulationStage>();
     blitStage = std::make_unique<BlitStage>();
 
-    modelLoadingStage->resourceManager = &resourceManager;
+    m_frameConstants = std::make_unique<FrameConstants>();
+
 
     // Get data path
     std::string dataPath = moduleInfo.value("dataPath");
@@ -93,13 +105,73 @@ void MultiFramePainter::onInitialize()
 
     });
 
+    // the current scene is rendered until the new one has been loaded in the background
+    this->addProperty<Preset>("Preset",
+        [this]() { return preset; },
+        [this](const Preset & value) {
+            preset = value;
+            modelLoadingStage->requestScene(preset);
+    });
+
+    // in MB, finer texture levels are streamed in as long as they fit
+    this->addProperty<int>("TextureBudget",
+        [this]() { return static_cast<int>(modelLoadingStage->textureBudget() / (1024 * 1024)); },
+        [this](const int & value) {
+            modelLoadingStage->setTextureBudget(static_cast<size_t>(value) * 1024 * 1024);
+    })->setOptions({
+        { "minimum", 64 },
+        { "maximum", 16384 }
+    });
+
+    // benchmarks the pipeline configurations of each scene and resolution that has not been tuned yet
+    this->addProperty<bool>("AutoTune",
+        [this]() { return m_autoTune; },
+        [this](const bool & value) {
+            m_autoTune = value;
+            m_autoTuner->cancel();
+            selectConfiguration();
+    });
+
+    this->addProperty<int>("MultiFrameCount",
+        [this]() { return m_multiFrameCount; },
+        [this](const int & value) {
+            m_multiFrameCount = value;
+            kernelGenerationStage->process(m_multiFrameCount);
+            resetAccumulation();
+    })->setOptions({
+        { "minimum", 1 },
+        { "maximum", 4096 }
+    });
+
+    this->addProperty<KernelSequence>("SampleSequence",
+        [this]() { return kernelGenerationStage->sequence; },
+        [this](const KernelSequence & value) {
+            kernelGenerationStage->sequence = value;
+            kernelGenerationStage->process(m_multiFrameCount);
+            resetAccumulation();
+    });
+
+    this->addProperty<bool>("DepthOfField",
+        [this]() { return useDOF; },
+        [this](const bool & value) {
+            useDOF = value;
+            rasterizationStage->useDOF = useDOF;
+            resetAccumulation();
+    });
+
     gloperate::registerNamedStrings("data/shaders", "glsl", true);
 
+    // has to be registered before the stages build their programs
+    m_configuration = PipelineConfiguration::defaults(preset);
+    m_configuration.registerNamedString();
+    m_autoTuner = std::make_unique<AutoTuner>("data/pipeline.cache");
+
     // disable debug group console output
     gl::glDebugMessageControl(gl::GL_DEBUG_SOURCE_APPLICATION, gl::GL_DEBUG_TYPE_PUSH_GROUP, gl::GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, gl::GL_FALSE);
     gl::glDebugMessageControl(gl::GL_DEBUG_SOURCE_APPLICATION, gl::GL_DEBUG_TYPE_POP_GROUP, gl::GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, gl::GL_FALSE);
 
     kernelGenerationStage->initialize();
+    kernelGenerationStage->process(m_multiFrameCount);
 
     modelLoadingStage->loadScene(preset);
 
@@ -107,6 +179,7 @@ void MultiFramePainter::onInitialize()
     rasterizationStage->camera = m_cameraCapability;
     rasterizationStage->viewport = m_virtualViewportCapability;
     rasterizationStage->useDOF = useDOF;
+    rasterizationStage->useZPrepass = m_configuration.zPrepass;
     rasterizationStage->initialize();
     rasterizationStage->initProperties(*this);
     rasterizationStage->loadPreset(modelLoadingStage->getCurrentPresetInformation());
@@ -114,50 +187,60 @@ void MultiFramePainter::onInitialize()
     giStage->viewport = m_virtualViewportCapability;
     giStage->camera = m_cameraCapability;
     giStage->projection = m_projectionCapability;
-    giStage->faceNormalBuffer = rasterizationStage->faceNormalBuffer;
+    giStage->normalBuffer = rasterizationStage->normalBuffer;
     giStage->depthBuffer = rasterizationStage->depthBuffer;
     giStage->initialize();
     giStage->initProperties(*this);
+    giStage->setConfiguration(m_configuration);
 
     ssaoStage->viewport = m_virtualViewportCapability;
     ssaoStage->camera = m_cameraCapability;
     ssaoStage->projection = m_projectionCapability;
-    ssaoStage->faceNormalBuffer = rasterizationStage->faceNormalBuffer;
     ssaoStage->normalBuffer = rasterizationStage->normalBuffer;
     ssaoStage->depthBuffer = rasterizationStage->depthBuffer;
     ssaoStage->initialize();
+    ssaoStage->initProperties(*this);
 
     deferredShadingStage->viewport = m_virtualViewportCapability;
     deferredShadingStage->camera = m_cameraCapability;
     deferredShadingStage->projection = m_projectionCapability;
     deferredShadingStage->diffuseBuffer = rasterizationStage->diffuseBuffer;
-    deferredShadingStage->specularBuffer = rasterizationStage->specularBuffer;
+    deferredShadingStage->normalBuffer = rasterizationStage->normalBuffer;
     deferredShadingStage->giBuffer = giStage->giBlurFinalBuffer;
     deferredShadingStage->occlusionBuffer = ssaoStage->occlusionBuffer;
-    deferredShadingStage->faceNormalBuffer = rasterizationStage->faceNormalBuffer;
-    deferredShadingStage->normalBuffer = rasterizationStage->normalBuffer;
     deferredShadingStage->depthBuffer = rasterizationStage->depthBuffer;
     deferredShadingStage->shadowmap = giStage->rsmRenderer->vsmBuffer;
     deferredShadingStage->biasedShadowTransform = &giStage->vplProcessor->biasedShadowTransform;
     deferredShadingStage->lightDirection = &giStage->lightDirection;
     deferredShadingStage->lightPosition = &giStage->lightPosition;
     deferredShadingStage->lightIntensity = &giStage->lightIntensity;
+    deferredShadingStage->areaLightShadows = &giStage->areaLightShadows;
     deferredShadingStage->initialize();
     deferredShadingStage->initProperties(*this);
 
+    accumulationStage->viewport = m_virtualViewportCapability;
+    accumulationStage->camera = m_cameraCapability;
+    accumulationStage->projection = m_projectionCapability;
+    accumulationStage->frame = deferredShadingStage->shadedFrame;
+    accumulationStage->depthBuffer = rasterizationStage->depthBuffer;
+    accumulationStage->normalBuffer = rasterizationStage->normalBuffer;
+    accumulationStage->initialize();
+    accumulationStage->initProperties(*this);
+
+    giStage->tileError = accumulationStage->tileError;
+    ssaoStage->tileError = accumulationStage->tileError;
+    deferredShadingStage->tileError = accumulationStage->tileError;
+
     blitStage->viewport = m_viewportCapability;
     blitStage->virtualViewport = m_virtualViewportCapability;
     blitStage->depth = rasterizationStage->depthBuffer;
 
     blitStage->m_buffers = {
         rasterizationStage->diffuseBuffer,
-        rasterizationStage->specularBuffer,
         rasterizationStage->normalBuffer,
-        rasterizationStage->faceNormalBuffer,
         rasterizationStage->depthBuffer,
         giStage->rsmRenderer->diffuseBuffer,
         giStage->rsmRenderer->specularBuffer,
-        giStage->rsmRenderer->normalBuffer,
         giStage->rsmRenderer->faceNormalBuffer,
         giStage->rsmRenderer->vsmBuffer,
         giStage->rsmRenderer->depthBuffer,
@@ -172,6 +255,9 @@ void MultiFramePainter::onInitialize()
         giStage->giBlurFinalBuffer,
         ssaoStage->occlusionBuffer,
         deferredShadingStage->shadedFrame,
+        accumulationStage->accumulation,
+        accumulationStage->accumulatedFrame,
+        accumulationStage->tileError,
     };
 
     blitStage->initialize();
@@ -180,25 +266,162 @@ void MultiFramePainter::onInitialize()
 
 void MultiFramePainter::onPaint()
 {
+    auto allocationCount = AllocationTracker::allocationCount();
+
+    if (modelLoadingStage->updateScene())
+    {
+        rasterizationStage->loadPreset(modelLoadingStage->getCurrentPresetInformation());
+        giStage->loadPreset(modelLoadingStage->getCurrentPresetInformation());
+        selectConfiguration();
+        m_accumulationResetRequired = true;
+    }
+
+    // the samples taken with coarser levels would stay visible in the accumulation
+    if (modelLoadingStage->updateTextureStreaming())
+    {
+        m_accumulationResetRequired = true;
+    }
+
     if (!m_useFullHD && m_viewportCapability->hasChanged()) {
         m_virtualViewportCapability->setViewport(0, 0, m_viewportCapability->width(), m_viewportCapability->height());
     }
 
+    if (m_virtualViewportCapability->hasChanged() || giStage->lightMoving())
+    {
+        m_accumulationResetRequired = true;
+    }
+
+    if (m_virtualViewportCapability->hasChanged())
+    {
+        selectConfiguration();
+    }
+
+    // each frame of the tuning renders all samples again, so the candidates are compared at the same cost
+    if (m_autoTuner->running())
     {
-    AutoGLPerfCounter c("GBuffer");
-    rasterizationStage->process();
+        applyConfiguration(m_autoTuner->configuration());
+        PerfCounter::setInfo("AutoTune", "candidate %zu of %zu", m_autoTuner->candidateIndex() + 1, m_autoTuner->candidateCount());
+        m_accumulationResetRequired = true;
     }
-    giStage->process();
-    ssaoStage->process();
-    deferredShadingStage->process();
+
+    // camera motion keeps the samples that are still visible, they are reprojected into the new view
+    bool cameraChanged = m_cameraCapability->hasChanged() || m_projectionCapability->hasChanged();
+    if (cameraChanged && !accumulationStage->temporalReprojection())
+    {
+        m_accumulationResetRequired = true;
+    }
+
+    if (m_accumulationResetRequired)
+    {
+        m_currentFrame = 1;
+        m_accumulationResetRequired = false;
+    }
+
+    accumulationStage->currentFrame = m_currentFrame;
+    accumulationStage->reprojectHistory = cameraChanged && m_currentFrame > 1;
+    if (m_currentFrame == 1 || accumulationStage->reprojectHistory)
+        accumulationStage->resetConvergence();
+    accumulationStage->updateConvergence();
+
+    // a converged image is presented from the accumulation buffer without rendering anything new
+    if (!accumulationStage->converged())
+    {
+        rasterizationStage->currentFrame = m_currentFrame;
+        giStage->currentFrame = m_currentFrame;
+        ssaoStage->currentFrame = m_currentFrame;
+
+        // after the first samples only tiles that have not converged yet are shaded again
+        auto tileErrorThreshold = accumulationStage->tileMaskThreshold();
+        giStage->tileErrorThreshold = tileErrorThreshold;
+        ssaoStage->tileErrorThreshold = tileErrorThreshold;
+        deferredShadingStage->tileErrorThreshold = tileErrorThreshold;
+
+        // the camera uniforms of all passes but the rasterization, which also renders from the light
+        m_frameConstants->update(*m_cameraCapability, *m_projectionCapability, *m_virtualViewportCapability);
+
+        m_autoTuner->beginFrame();
+
+        {
+        AutoGLPerfCounter c("GBuffer");
+        rasterizationStage->process();
+        }
+        giStage->process();
+        ssaoStage->process();
+        deferredShadingStage->process();
+        accumulationStage->process();
+
+        if (m_autoTuner->endFrame())
+        {
+            const auto & tuned = m_autoTuner->configuration();
+            PerfCounter::setInfo("AutoTune", "%dpx clusters with %d slices, %dx%d GI work groups, z-prepass %s",
+                tuned.clusterPixelSize, tuned.clusterDepthSlices, tuned.giWorkGroupSize, tuned.giWorkGroupSize, tuned.zPrepass ? "on" : "off");
+            applyConfiguration(tuned);
+        }
+
+        ++m_currentFrame;
+    }
+
     blitStage->process();
 
+    if (accumulationStage->converged())
+        PerfCounter::setInfo("Samples", "converged at %d", accumulationStage->convergedSampleCount());
+    else
+        PerfCounter::setInfo("Samples", "%d", m_currentFrame - 1);
+
+    // the steady state frame loop should not allocate at all
+    if (AllocationTracker::enabled())
+        PerfCounter::setInfo("Allocations", "%llu", static_cast<unsigned long long>(AllocationTracker::allocationCount() - allocationCount));
+
     m_virtualViewportCapability->setChanged(false);
     m_viewportCapability->setChanged(false);
     m_cameraCapability->setChanged(false);
     m_projectionCapability->setChanged(false);
 }
 
+void MultiFramePainter::selectConfiguration()
+{
+    auto currentPreset = modelLoadingStage->getCurrentPreset();
+    auto width = m_virtualViewportCapability->width();
+    auto height = m_virtualViewportCapability->height();
+
+    gl::GLint maxTextureSize = 0;
+    gl::glGetIntegerv(gl::GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    // invalid persisted results are tuned again, or replaced by the defaults
+    auto configuration = PipelineConfiguration::defaults(currentPreset);
+    auto tuned = m_autoTuner->find(currentPreset, width, height, maxTextureSize, configuration);
+
+    m_autoTuner->cancel();
+    if (m_autoTune && !tuned && width > 0 && height > 0)
+    {
+        // the candidates are applied frame by frame from onPaint()
+        m_autoTuner->start(currentPreset, width, height, configuration.candidates(width, height, maxTextureSize));
+        if (m_autoTuner->running())
+            return;
+    }
+
+    applyConfiguration(configuration);
+}
+
+void MultiFramePainter::applyConfiguration(const PipelineConfiguration & configuration)
+{
+    if (configuration == m_configuration)
+        return;
+
+    m_configuration = configuration;
+    m_configuration.registerNamedString();
+
+    rasterizationStage->useZPrepass = m_configuration.zPrepass;
+    giStage->setConfiguration(m_configuration);
+
+    resetAccumulation();
+}
+
+void MultiFramePainter::resetAccumulation()
+{
+    m_accumulationResetRequired = true;
+}
+
 std::string MultiFramePainter::getPerfCounterString() const
 {
     return PerfCounter::generateString();
@@ -8,6 +8,7 @@
 #include "mfs-painters-api.h"
 
 #include "Preset.h"
+#include "PipelineConfiguration.h"
 
 
 namespace gloperate 
@@ -26,7 +27,10 @@ class RasterizationStage;
 class GIStage;
 class DeferredShadingStage;
 class SSAOStage;
+class AccumulationStage;
 class BlitStage;
+class FrameConstants;
+class AutoTuner;
 
 
 class MFS_PAINTERS_API MultiFramePainter : public gloperate::Painter
@@ -38,6 +42,9 @@ public:
     // Viewer.cpp can't access PerfCounter::generateString(), probably because different compilation unit
     std::string getPerfCounterString() const;
 
+    // restarts the accumulation with the next frame, to be called whenever the rendered image changes
+    void resetAccumulation();
+
     gloperate::ResourceManager& resourceManager;
     Preset preset;
     bool useDOF;
@@ -46,6 +53,9 @@ protected:
     virtual void onInitialize() override;
     virtual void onPaint() override;
 
+    // the tuned or default configuration of the current scene and resolution, starts tuning it if enabled
+    void selectConfiguration();
+    void applyConfiguration(const PipelineConfiguration & configuration);
 
 protected:
 
@@ -62,7 +72,18 @@ protected:
     std::unique_ptr<GIStage> giStage;
     std::unique_ptr<SSAOStage> ssaoStage;
     std::unique_ptr<DeferredShadingStage> deferredShadingStage;
+    std::unique_ptr<AccumulationStage> accumulationStage;
     std::unique_ptr<BlitStage> blitStage;
 
+    std::unique_ptr<FrameConstants> m_frameConstants;
+    std::unique_ptr<AutoTuner> m_autoTuner;
+
+    PipelineConfiguration m_configuration;
+    bool m_autoTune;
+
     bool m_useFullHD;
+
+    int m_multiFrameCount;
+    int m_currentFrame;
+    bool m_accumulationResetRequired;
 };
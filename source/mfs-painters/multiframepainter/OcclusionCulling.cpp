@@ -0,0 +1,151 @@
+#include "OcclusionCulling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/common.hpp>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <glbinding/gl/bitfield.h>
+
+#include <globjects/Buffer.h>
+#include <globjects/Program.h>
+#include <globjects/Shader.h>
+#include <globjects/Texture.h>
+
+#include "PerfCounter.h"
+
+using namespace gl;
+
+namespace
+{
+    // have to match the shaders in data/shaders/occlusion_culling
+    const int s_hierarchyLocalSize = 8;
+    const int s_cullLocalSize = 64;
+
+    enum StorageBufferBinding : GLuint
+    {
+        DrawParameterBinding,
+        CommandBinding,
+        RemainingCommandBinding
+    };
+}
+
+
+OcclusionCulling::OcclusionCulling()
+: m_depthSize(0)
+, m_levelCount(0)
+, m_hasSecondPhase(false)
+{
+    m_hierarchyLevelZeroProgram = new globjects::Program();
+    m_hierarchyLevelZeroProgram->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/occlusion_culling/hiz.comp"));
+
+    globjects::Shader::globalReplace("#define LEVEL_ZERO", "#undef LEVEL_ZERO");
+    m_hierarchyProgram = new globjects::Program();
+    m_hierarchyProgram->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/occlusion_culling/hiz.comp"));
+    globjects::Shader::clearGlobalReplacements();
+
+    m_firstPhaseProgram = new globjects::Program();
+    m_firstPhaseProgram->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/occlusion_culling/cull.comp"));
+
+    globjects::Shader::globalReplace("#define FIRST_PHASE", "#undef FIRST_PHASE");
+    m_secondPhaseProgram = new globjects::Program();
+    m_secondPhaseProgram->attach(globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/occlusion_culling/cull.comp"));
+    globjects::Shader::clearGlobalReplacements();
+}
+
+OcclusionCulling::~OcclusionCulling()
+{
+}
+
+const SceneGeometry::DrawList & OcclusionCulling::cullFirstPhase(const SceneGeometry & geometry, const SceneGeometry::DrawList & draws)
+{
+    m_hasSecondPhase = m_hierarchy && draws.drawCount() > 0;
+    if (!m_hasSecondPhase)
+        return draws;
+
+    AutoGLDebugGroup c("Occlusion culling");
+
+    m_firstPhaseDraws.copyFrom(draws);
+    m_secondPhaseDraws.copyFrom(draws);
+
+    m_secondPhaseDraws.commandBuffer()->bindBase(GL_SHADER_STORAGE_BUFFER, RemainingCommandBinding);
+    cull(m_firstPhaseProgram, geometry, m_firstPhaseDraws);
+
+    return m_firstPhaseDraws;
+}
+
+void OcclusionCulling::buildHierarchy(globjects::Texture * depthBuffer, int width, int height, const glm::mat4 & transform)
+{
+    AutoGLDebugGroup c("Hi-Z");
+
+    // level zero is half the size of the depth buffer, like a mipmap level of it
+    auto levelZeroSize = glm::max(glm::ivec2(width, height) / 2, glm::ivec2(1));
+    if (!m_hierarchy || glm::ivec2(width, height) != m_depthSize)
+    {
+        m_depthSize = glm::ivec2(width, height);
+        m_levelCount = static_cast<int>(std::log2(std::max(levelZeroSize.x, levelZeroSize.y))) + 1;
+
+        m_hierarchy = new globjects::Texture(GL_TEXTURE_2D);
+        m_hierarchy->setName("Hi-Z");
+        m_hierarchy->storage2D(m_levelCount, GL_R32F, levelZeroSize.x, levelZeroSize.y);
+        m_hierarchy->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        m_hierarchy->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    m_transform = transform;
+
+    depthBuffer->bindActive(0);
+
+    auto inputSize = m_depthSize;
+    for (auto level = 0; level < m_levelCount; ++level)
+    {
+        auto outputSize = glm::max(levelZeroSize / (1 << level), glm::ivec2(1));
+
+        if (level > 0)
+            m_hierarchy->bindImageTexture(0, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        m_hierarchy->bindImageTexture(1, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        auto program = level == 0 ? m_hierarchyLevelZeroProgram : m_hierarchyProgram;
+        program->setUniform("inputSize", inputSize);
+        program->setUniform("outputSize", outputSize);
+        program->dispatchCompute(
+            (outputSize.x + s_hierarchyLocalSize - 1) / s_hierarchyLocalSize,
+            (outputSize.y + s_hierarchyLocalSize - 1) / s_hierarchyLocalSize,
+            1);
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        inputSize = outputSize;
+    }
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+const SceneGeometry::DrawList * OcclusionCulling::cullSecondPhase(const SceneGeometry & geometry)
+{
+    if (!m_hasSecondPhase)
+        return nullptr;
+
+    AutoGLDebugGroup c("Occlusion culling");
+
+    cull(m_secondPhaseProgram, geometry, m_secondPhaseDraws);
+
+    return &m_secondPhaseDraws;
+}
+
+void OcclusionCulling::cull(globjects::Program * program, const SceneGeometry & geometry, const SceneGeometry::DrawList & draws) const
+{
+    geometry.drawParameterBuffer()->bindBase(GL_SHADER_STORAGE_BUFFER, DrawParameterBinding);
+    draws.commandBuffer()->bindBase(GL_SHADER_STORAGE_BUFFER, CommandBinding);
+    m_hierarchy->bindActive(0);
+
+    auto drawCount = static_cast<int>(draws.drawCount());
+    program->setUniform("drawCount", drawCount);
+    program->setUniform("transform", m_transform);
+    program->setUniform("depthSize", m_depthSize);
+    program->setUniform("levelCount", m_levelCount);
+    program->dispatchCompute((drawCount + s_cullLocalSize - 1) / s_cullLocalSize, 1, 1);
+
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
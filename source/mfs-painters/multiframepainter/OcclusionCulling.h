@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <globjects/base/ref_ptr.h>
+
+#include "SceneGeometry.h"
+
+namespace globjects
+{
+    class Program;
+    class Texture;
+}
+
+
+// Two phase occlusion culling of the scene geometry's draws against a hierarchical depth buffer (Hi-Z).
+// The first phase tests the draws against the Hi-Z of the previous frame, with the transform that frame was rendered with.
+// After these are drawn, the Hi-Z is rebuilt from the current depth and the draws culled in the first phase are
+// tested again, the ones that turn out to be visible are drawn in a second phase. The Hi-Z is then rebuilt once more,
+// so the next frame is tested against the complete depth. Culled draws keep their place in the draw list with an
+// instance count of zero, so the commands never have to be read back.
+class OcclusionCulling
+{
+public:
+    OcclusionCulling();
+    ~OcclusionCulling();
+
+    // draws are the frustum culled draws of the current frame, they are returned as is without a previous frame
+    const SceneGeometry::DrawList & cullFirstPhase(const SceneGeometry & geometry, const SceneGeometry::DrawList & draws);
+
+    // transform is the one the depth was rendered with, the last hierarchy of a frame is kept for the next frame's first phase
+    void buildHierarchy(globjects::Texture * depthBuffer, int width, int height, const glm::mat4 & transform);
+
+    // the draws occluded in the first phase that aren't occluded by the current depth, nullptr without a second phase
+    const SceneGeometry::DrawList * cullSecondPhase(const SceneGeometry & geometry);
+
+protected:
+    void cull(globjects::Program * program, const SceneGeometry & geometry, const SceneGeometry::DrawList & draws) const;
+
+    globjects::ref_ptr<globjects::Program> m_hierarchyLevelZeroProgram;
+    globjects::ref_ptr<globjects::Program> m_hierarchyProgram;
+    globjects::ref_ptr<globjects::Program> m_firstPhaseProgram;
+    globjects::ref_ptr<globjects::Program> m_secondPhaseProgram;
+
+    globjects::ref_ptr<globjects::Texture> m_hierarchy;
+    glm::ivec2 m_depthSize;
+    int m_levelCount;
+    glm::mat4 m_transform;
+    bool m_hasSecondPhase;
+
+    SceneGeometry::DrawList m_firstPhaseDraws;
+    SceneGeometry::DrawList m_secondPhaseDraws;
+};
@@ -1,6 +1,9 @@
 #include "PerfCounter.h"
 
 #include <cassert>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 
 #include <glbinding/gl/enum.h>
 #include <glbinding/gl/functions.h>
@@ -9,7 +12,6 @@
 #include <globjects/base/ref_ptr.h>
 #include <gloperate/base/ChronoTimer.h>
 
-#include <unordered_map>
 #include <vector>
 #include <sstream>
 #include <string>
@@ -20,59 +22,96 @@ using namespace globjects;
 
 namespace
 {
-    static std::unordered_map<std::string, uint64_t> map;
-    static std::unordered_map<std::string, gloperate::ChronoTimer> timerMap;
-    static std::vector<std::string> orderedNames;
+    struct Counter
+    {
+        std::string name;
+        uint64_t nanoseconds;
+        gloperate::ChronoTimer timer;
+        bool timerRunning;
+        ref_ptr<Query> query;
+    };
+
+    struct Info
+    {
+        std::string name;
+        char text[128];
+    };
+
+    // few enough for a linear search
+    static std::vector<Counter> counters;
+    static std::vector<size_t> orderedCounters;
     static const float smoothingFactor = 0.95f;
 
-    static std::unordered_map<std::string, ref_ptr<Query>> glTimerMap;
-    static std::string runningGLQuery("");
+    static const char * runningGLQuery = nullptr;
+
+    static std::vector<Info> infos;
 }
 
-void PerfCounter::begin(const std::string & name)
+void PerfCounter::begin(const char * name)
 {
-    assert(timerMap.find(name) != timerMap.end());
-    timerMap[name] = gloperate::ChronoTimer();
+    auto & counter = counters[counterIndex(name)];
+    assert(!counter.timerRunning);
+
+    counter.timer = gloperate::ChronoTimer();
+    counter.timerRunning = true;
 }
 
-void PerfCounter::end(const std::string & name)
+void PerfCounter::end(const char * name)
 {
-    assert(timerMap.find(name) != timerMap.end());
+    auto index = counterIndex(name);
+    auto & counter = counters[index];
+    assert(counter.timerRunning);
 
-    auto elapsedTime = timerMap[name].elapsed();
-    timerMap.erase(name);
+    auto elapsedTime = counter.timer.elapsed();
+    counter.timerRunning = false;
 
-    addNameToOrderedNames(name);
+    addToOrderedCounters(index);
 
-    addMeasurement(name, elapsedTime.count());
+    addMeasurement(index, elapsedTime.count());
 }
 
-void PerfCounter::beginGL(const std::string & name)
+void PerfCounter::beginGL(const char * name)
 {
-    assert(runningGLQuery == "");
+    assert(runningGLQuery == nullptr);
     runningGLQuery = name;
 
-    if (glTimerMap.find(name) == glTimerMap.end()) {
-        auto query = new Query();
-        glTimerMap[name] = query;
+    auto index = counterIndex(name);
+    auto & counter = counters[index];
+    if (!counter.query) {
+        counter.query = new Query();
     }
     else {
-        addMeasurement(name, glTimerMap[name]->get(GL_QUERY_RESULT));
+        addMeasurement(index, counter.query->get(GL_QUERY_RESULT));
     }
 
-    glTimerMap[name]->begin(GL_TIME_ELAPSED);
+    counter.query->begin(GL_TIME_ELAPSED);
 }
 
-void PerfCounter::endGL(const std::string & name)
+void PerfCounter::endGL(const char * name)
 {
-    assert(glTimerMap.find(name) != glTimerMap.end());
-    assert(runningGLQuery == name);
+    auto index = counterIndex(name);
+    assert(counters[index].query);
+    assert(runningGLQuery != nullptr && std::strcmp(runningGLQuery, name) == 0);
+
+    addToOrderedCounters(index);
 
-    addNameToOrderedNames(name);
+    runningGLQuery = nullptr;
 
-    runningGLQuery = "";
+    counters[index].query->end(GL_TIME_ELAPSED);
+}
 
-    glTimerMap[name]->end(GL_TIME_ELAPSED);
+void PerfCounter::setInfo(const char * name, const char * format, ...)
+{
+    auto info = std::find_if(infos.begin(), infos.end(), [name](const Info & info) {
+        return info.name == name;
+    });
+    if (info == infos.end())
+        info = infos.insert(infos.end(), Info{ name, {} });
+
+    va_list arguments;
+    va_start(arguments, format);
+    std::vsnprintf(info->text, sizeof(info->text), format, arguments);
+    va_end(arguments);
 }
 
 std::string PerfCounter::generateString()
@@ -80,31 +119,42 @@ std::string PerfCounter::generateString()
     std::stringstream ss;
     ss.precision(2);
 
-    for (std::string name : orderedNames)
-        ss << name << ": " << std::fixed << map[name] / 1000000.0 << "  ";
+    for (auto index : orderedCounters)
+        ss << counters[index].name << ": " << std::fixed << counters[index].nanoseconds / 1000000.0 << "  ";
+    for (const auto & info : infos)
+        ss << info.name << ": " << info.text << "  ";
     return ss.str();
 }
 
-void PerfCounter::addNameToOrderedNames(const std::string & name)
+size_t PerfCounter::counterIndex(const char * name)
 {
-    if (std::find(orderedNames.begin(), orderedNames.end(), name) == orderedNames.end())
-        orderedNames.push_back(name);
+    auto counter = std::find_if(counters.begin(), counters.end(), [name](const Counter & counter) {
+        return counter.name == name;
+    });
+    if (counter != counters.end())
+        return static_cast<size_t>(counter - counters.begin());
+
+    counters.push_back(Counter{ name, 0, gloperate::ChronoTimer(), false, nullptr });
+    return counters.size() - 1;
 }
 
-void PerfCounter::addMeasurement(const std::string & name, uint64_t nanoseconds)
+void PerfCounter::addToOrderedCounters(size_t index)
 {
-    if (map[name] == 0L)
-        map[name] = nanoseconds;
-    else {
-        auto initial = map[name];
-        auto i = 1 - smoothingFactor;
-        auto a = map[name] * smoothingFactor;
-        map[name] = uint64_t(nanoseconds * (1 - smoothingFactor) + map[name] * smoothingFactor);
-    }
+    if (std::find(orderedCounters.begin(), orderedCounters.end(), index) == orderedCounters.end())
+        orderedCounters.push_back(index);
 }
 
+void PerfCounter::addMeasurement(size_t index, uint64_t nanoseconds)
+{
+    auto & smoothed = counters[index].nanoseconds;
+    if (smoothed == 0L)
+        smoothed = nanoseconds;
+    else
+        smoothed = uint64_t(nanoseconds * (1 - smoothingFactor) + smoothed * smoothingFactor);
+}
 
-AutoGLPerfCounter::AutoGLPerfCounter(std::string name)
+
+AutoGLPerfCounter::AutoGLPerfCounter(const char * name)
 : m_name(name)
 , m_debugGroup(name)
 {
@@ -117,10 +167,9 @@ AutoGLPerfCounter::~AutoGLPerfCounter()
 }
 
 
-AutoGLDebugGroup::AutoGLDebugGroup(std::string name)
-: m_name(name)
+AutoGLDebugGroup::AutoGLDebugGroup(const char * name)
 {
-    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name.data());
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
 }
 
 AutoGLDebugGroup::~AutoGLDebugGroup()
@@ -129,7 +178,7 @@ AutoGLDebugGroup::~AutoGLDebugGroup()
 }
 
 
-AutoPerfCounter::AutoPerfCounter(std::string name)
+AutoPerfCounter::AutoPerfCounter(const char * name)
 : m_name(name)
 {
     PerfCounter::begin(m_name);
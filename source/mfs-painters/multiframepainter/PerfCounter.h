@@ -1,47 +1,52 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
+// Counters are identified by their name, which is compared against the ones seen before instead of hashed,
+// so measuring doesn't build or allocate strings after a counter's first use. Names have to be static strings,
+// or outlive the Auto* objects that hold them.
 class PerfCounter
 {
 public:
-    static void begin(const std::string & name);
-    static void beginGL(const std::string & name);
-    static void end(const std::string & name);
-    static void endGL(const std::string & name);
+    static void begin(const char * name);
+    static void beginGL(const char * name);
+    static void end(const char * name);
+    static void endGL(const char * name);
+    // non-timing information that is appended to the generated string, formatted like printf
+    static void setInfo(const char * name, const char * format, ...);
     static std::string generateString();
 
 protected:
-    static void addNameToOrderedNames(const std::string & name);
-    static void addMeasurement(const std::string & name, uint64_t nanoseconds);
+    static size_t counterIndex(const char * name);
+    static void addToOrderedCounters(size_t index);
+    static void addMeasurement(size_t index, uint64_t nanoseconds);
 };
 
 
 class AutoGLDebugGroup
 {
 public:
-    AutoGLDebugGroup(std::string name);
+    AutoGLDebugGroup(const char * name);
     ~AutoGLDebugGroup();
-protected:
-    std::string m_name;
 };
 
 class AutoGLPerfCounter
 {
 public:
-    AutoGLPerfCounter(std::string name);
+    AutoGLPerfCounter(const char * name);
     ~AutoGLPerfCounter();
 protected:
-    std::string m_name;
+    const char * m_name;
     AutoGLDebugGroup m_debugGroup;
 };
 
 class AutoPerfCounter
 {
 public:
-    AutoPerfCounter(std::string name);
+    AutoPerfCounter(const char * name);
     ~AutoPerfCounter();
 protected:
-    std::string m_name;
-};
\ No newline at end of file
+    const char * m_name;
+};
@@ -0,0 +1,142 @@
+#include "PipelineConfiguration.h"
+
+#include <globjects/NamedString.h>
+#include <globjects/base/StaticStringSource.h>
+
+
+namespace
+{
+    const char * s_namedString = "/data/shaders/pipeline_configuration.glsl";
+
+    // has to match totalVplCount in the shaders
+    const int s_vplCount = 1024;
+
+    // clustering.comp packs the cluster coordinates into 8 bits each
+    const int s_maxClustersPerDimension = 256;
+
+    // guaranteed by every implementation
+    const int s_maxWorkGroupInvocations = 1024;
+
+    // kept, so the named string can be updated in place
+    globjects::ref_ptr<globjects::StaticStringSource> s_shaderSource;
+
+    int divCeil(int dividend, int divisor)
+    {
+        return (dividend + divisor - 1) / divisor;
+    }
+}
+
+
+PipelineConfiguration::PipelineConfiguration()
+: zPrepass(false)
+, clusterPixelSize(128)
+, clusterDepthSlices(16)
+, giWorkGroupSize(8)
+, interleavedSize(4)
+{
+}
+
+PipelineConfiguration PipelineConfiguration::defaults(Preset preset)
+{
+    PipelineConfiguration configuration;
+    // crytek sponza has a lot of overdraw for its low geometric complexity
+    configuration.zPrepass = preset == Preset::CrytekSponza;
+
+    return configuration;
+}
+
+std::vector<PipelineConfiguration> PipelineConfiguration::candidates(int width, int height, int maxTextureSize) const
+{
+    std::vector<PipelineConfiguration> candidates;
+    if (valid(width, height, maxTextureSize))
+        candidates.push_back(*this);
+
+    for (auto zPrepass : { false, true })
+    {
+        for (auto clusterPixelSize : { 64, 128, 256 })
+        {
+            for (auto clusterDepthSlices : { 16, 32 })
+            {
+                for (auto giWorkGroupSize : { 8, 16 })
+                {
+                    auto candidate = *this;
+                    candidate.zPrepass = zPrepass;
+                    candidate.clusterPixelSize = clusterPixelSize;
+                    candidate.clusterDepthSlices = clusterDepthSlices;
+                    candidate.giWorkGroupSize = giWorkGroupSize;
+
+                    if (candidate != *this && candidate.valid(width, height, maxTextureSize))
+                        candidates.push_back(candidate);
+                }
+            }
+        }
+    }
+
+    return candidates;
+}
+
+bool PipelineConfiguration::valid(int width, int height, int maxTextureSize) const
+{
+    // persisted configurations may hold anything
+    if (clusterPixelSize <= 0 || clusterDepthSlices <= 0 || giWorkGroupSize <= 0 || interleavedSize <= 0)
+        return false;
+
+    auto clustersX = divCeil(width, clusterPixelSize);
+    auto clustersY = divCeil(height, clusterPixelSize);
+
+    return clustersX <= s_maxClustersPerDimension
+        && clustersY <= s_maxClustersPerDimension
+        // one invocation of clustering.comp per depth slice
+        && clusterDepthSlices <= clusterPixelSize
+        && clusterDepthSlices <= s_maxClustersPerDimension
+        // the light lists texture has a column per cluster
+        && clustersX * clustersY * clusterDepthSlices <= maxTextureSize
+        // the work groups of clustering.comp and gi.comp, within the minimum of GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS
+        && clusterPixelSize <= s_maxWorkGroupInvocations
+        && giWorkGroupSize <= s_maxWorkGroupInvocations / giWorkGroupSize
+        && interleavedSize * interleavedSize <= s_vplCount;
+}
+
+void PipelineConfiguration::registerNamedString() const
+{
+    if (s_shaderSource)
+    {
+        s_shaderSource->setString(shaderSource());
+        return;
+    }
+
+    s_shaderSource = new globjects::StaticStringSource(shaderSource());
+    globjects::NamedString::create(s_namedString, s_shaderSource);
+}
+
+std::string PipelineConfiguration::shaderSource() const
+{
+    auto define = [](const char * name, int value) {
+        return std::string("#define ") + name + " " + std::to_string(value) + "\n";
+    };
+
+    return std::string("#ifndef PIPELINE_CONFIGURATION\n")
+        + "#define PIPELINE_CONFIGURATION\n"
+        + "// generated from PipelineConfiguration\n"
+        + define("CLUSTER_PIXEL_SIZE", clusterPixelSize)
+        + define("CLUSTER_DEPTH_SLICES", clusterDepthSlices)
+        + define("GI_WORK_GROUP_SIZE", giWorkGroupSize)
+        + define("INTERLEAVED_SIZE", interleavedSize)
+        // light_lists.comp tests the VPLs of a sub-list in one work group
+        + define("LIGHT_SUBLIST_SIZE", s_vplCount / (interleavedSize * interleavedSize))
+        + "#endif\n";
+}
+
+bool PipelineConfiguration::operator==(const PipelineConfiguration & other) const
+{
+    return zPrepass == other.zPrepass
+        && clusterPixelSize == other.clusterPixelSize
+        && clusterDepthSlices == other.clusterDepthSlices
+        && giWorkGroupSize == other.giWorkGroupSize
+        && interleavedSize == other.interleavedSize;
+}
+
+bool PipelineConfiguration::operator!=(const PipelineConfiguration & other) const
+{
+    return !(*this == other);
+}
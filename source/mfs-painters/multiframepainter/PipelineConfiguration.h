@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Preset.h"
+
+
+// The constants that only change how fast a frame is rendered, not what it looks like. They are shared by the
+// stages and their shaders: the shaders include /data/shaders/pipeline_configuration.glsl, which is generated
+// from this struct by registerNamedString(), so the programs built afterwards always match the C++ side.
+struct PipelineConfiguration
+{
+    PipelineConfiguration();
+
+    // the configuration used for a scene that has not been tuned
+    static PipelineConfiguration defaults(Preset preset);
+
+    // the variations of the tuned members that are valid at the given resolution, starting with this one
+    std::vector<PipelineConfiguration> candidates(int width, int height, int maxTextureSize) const;
+
+    // whether the clusters fit the cluster ID encoding and the light list texture
+    bool valid(int width, int height, int maxTextureSize) const;
+
+    // creates or updates the named string, programs that include it have to be rebuilt afterwards
+    void registerNamedString() const;
+    std::string shaderSource() const;
+
+    bool operator==(const PipelineConfiguration & other) const;
+    bool operator!=(const PipelineConfiguration & other) const;
+
+    // tuned members
+
+    // depth only pass before the G-buffer pass, pays off for scenes with a lot of overdraw and cheap geometry
+    bool zPrepass;
+    // the screen space size of the light clusters in pixels, also the work group size of clustering.comp
+    int clusterPixelSize;
+    int clusterDepthSlices;
+    // gi.comp runs on giWorkGroupSize x giWorkGroupSize work groups
+    int giWorkGroupSize;
+
+    // not tuned, changes which VPLs a pixel gathers per frame and thereby the image
+
+    // the VPLs are split into interleavedSize^2 light sub-lists, neighbouring pixels gather different ones
+    int interleavedSize;
+};
@@ -10,6 +10,7 @@
 #include <globjects/Texture.h>
 #include <globjects/Program.h>
 #include <globjects/Shader.h>
+#include <globjects/Uniform.h>
 
 #include <gloperate/base/make_unique.hpp>
 #include <gloperate/painter/AbstractPerspectiveProjectionCapability.h>
@@ -23,8 +24,13 @@
 
 #include "Material.h"
 #include "ModelLoadingStage.h"
+#include "MaterialTable.h"
+#include "SceneGeometry.h"
+#include "OcclusionCulling.h"
+#include "TextureStreaming.h"
 #include "KernelGenerationStage.h"
 #include "MultiFramePainter.h"
+#include "PerfCounter.h"
 
 using namespace gl;
 using gloperate::make_unique;
@@ -36,21 +42,30 @@ namespace
         ShadowSampler,
         MaskSampler,
         NoiseSampler,
-        DiffuseSampler,
-        SpecularSampler,
-        EmissiveSampler,
-        OpacitySampler,
-        BumpSampler
+        // followed by the material table's texture arrays, if bindless textures are not supported
+        FirstTextureArraySampler
     };
+
+    // have to match the bindings in material_table.glsl and texture_feedback.frag
+    const GLuint MaterialBufferBinding = 0;
+    const GLuint StreamedTextureSizeBinding = 1;
+    const GLuint TextureFeedbackBinding = 2;
 }
 
 RasterizationStage::RasterizationStage(std::string name, ModelLoadingStage& modelLoadingStage, KernelGenerationStage& kernelGenerationStage, bool renderRSM)
 : m_name(name)
+, m_drawInfoName(name + " draws")
 , m_modelLoadingStage(modelLoadingStage)
 , m_kernelGenerationStage(kernelGenerationStage)
 , m_renderRSM(renderRSM)
 {
+    useDOF = false;
+    useZPrepass = false;
     currentFrame = 1;
+    m_useOcclusionCulling = true;
+    m_quantizedVerticesUniform = nullptr;
+    m_zOnlyQuantizedVerticesUniform = nullptr;
+    m_textureFeedbackQuantizedVerticesUniform = nullptr;
 }
 RasterizationStage::~RasterizationStage()
 {
@@ -58,65 +73,93 @@ RasterizationStage::~RasterizationStage()
 
 void RasterizationStage::initProperties(MultiFramePainter& painter)
 {
+    painter.addProperty<bool>("OcclusionCulling",
+        [this]() { return m_useOcclusionCulling; },
+        [this](const bool & value) { m_useOcclusionCulling = value; }
+    );
 }
 
 void RasterizationStage::initialize()
 {
     setupGLState();
 
-    diffuseBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
-    specularBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
-    faceNormalBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
-    normalBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
-    vsmBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
-    depthBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    auto createBuffer = [this](const std::string & name) {
+        auto buffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
+        buffer->setName(m_name + " " + name);
+        buffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST);
+        buffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
+        return buffer;
+    };
 
-    diffuseBuffer->setName(m_name + " Diffuse");
-    specularBuffer->setName(m_name + " Specular");
-    faceNormalBuffer->setName(m_name + " Face Normal");
-    normalBuffer->setName(m_name + " Normal");
-    vsmBuffer->setName(m_name + " VSM");
-    depthBuffer->setName(m_name + " Depth");
+    diffuseBuffer = createBuffer(m_renderRSM ? "Diffuse" : "Diffuse Specular");
+    depthBuffer = createBuffer("Depth");
 
     m_fbo = new globjects::Framebuffer();
     m_fbo->attachTexture(GL_COLOR_ATTACHMENT0, diffuseBuffer);
-    m_fbo->attachTexture(GL_COLOR_ATTACHMENT1, specularBuffer);
-    m_fbo->attachTexture(GL_COLOR_ATTACHMENT2, faceNormalBuffer);
-    m_fbo->attachTexture(GL_COLOR_ATTACHMENT3, normalBuffer);
-    m_fbo->attachTexture(GL_COLOR_ATTACHMENT4, vsmBuffer);
     m_fbo->attachTexture(GL_DEPTH_ATTACHMENT, depthBuffer);
 
-    diffuseBuffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST);
-    diffuseBuffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
-    specularBuffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST);
-    specularBuffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
-    faceNormalBuffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST);
-    faceNormalBuffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
-    normalBuffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST);
-    normalBuffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
-    depthBuffer->setParameter(gl::GL_TEXTURE_MIN_FILTER, gl::GL_NEAREST);
-    depthBuffer->setParameter(gl::GL_TEXTURE_MAG_FILTER, gl::GL_NEAREST);
-
-    vsmBuffer->bind();
-    vsmBuffer->setParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    vsmBuffer->setParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glm::vec4 color(0.0);
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, (float*)&color);
+    if (m_renderRSM)
+    {
+        specularBuffer = createBuffer("Specular");
+        faceNormalBuffer = createBuffer("Face Normal");
+
+        vsmBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
+        vsmBuffer->setName(m_name + " VSM");
+        vsmBuffer->bind();
+        vsmBuffer->setParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        vsmBuffer->setParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glm::vec4 color(0.0);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, (float*)&color);
+
+        m_fbo->attachTexture(GL_COLOR_ATTACHMENT1, specularBuffer);
+        m_fbo->attachTexture(GL_COLOR_ATTACHMENT2, faceNormalBuffer);
+        m_fbo->attachTexture(GL_COLOR_ATTACHMENT3, vsmBuffer);
+        m_drawBuffers = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+    }
+    else
+    {
+        normalBuffer = createBuffer("Normals");
+
+        m_fbo->attachTexture(GL_COLOR_ATTACHMENT1, normalBuffer);
+        m_drawBuffers = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    }
 
     if (!m_renderRSM)
         globjects::Shader::globalReplace("#define RENDER_RSM", "#undef RENDER_RSM");
+    if (!MaterialTable::bindlessSupported())
+        globjects::Shader::globalReplace("#define BINDLESS_TEXTURES", "#undef BINDLESS_TEXTURES");
     m_program = new globjects::Program();
     m_program->attach(
         globjects::Shader::fromFile(GL_VERTEX_SHADER, "data/shaders/model.vert"),
         globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "data/shaders/model.frag")
     );
     globjects::Shader::clearGlobalReplacements();
+    m_quantizedVerticesUniform = m_program->getUniform<bool>("quantizedVertices");
+
+    m_textureArraySamplers.clear();
+    for (auto i = 0; i < MaterialTable::TextureArrayCount; ++i)
+        m_textureArraySamplers.push_back(FirstTextureArraySampler + i);
 
     m_zOnlyProgram = new globjects::Program();
     m_zOnlyProgram->attach(
         globjects::Shader::fromFile(GL_VERTEX_SHADER, "data/shaders/model.vert"),
         globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "data/shaders/empty.frag")
     );
+    m_zOnlyQuantizedVerticesUniform = m_zOnlyProgram->getUniform<bool>("quantizedVertices");
+
+    // only the camera's view requests texture levels, the reflective shadow map is too coarse to need them
+    if (!m_renderRSM && MaterialTable::bindlessSupported())
+    {
+        m_textureFeedbackProgram = new globjects::Program();
+        m_textureFeedbackProgram->attach(
+            globjects::Shader::fromFile(GL_VERTEX_SHADER, "data/shaders/model.vert"),
+            globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "data/shaders/texture_feedback.frag")
+        );
+        m_textureFeedbackQuantizedVerticesUniform = m_textureFeedbackProgram->getUniform<bool>("quantizedVertices");
+    }
+
+    m_occlusionCulling = make_unique<OcclusionCulling>();
+    m_icosahedron = new gloperate::Icosahedron(2);
 }
 
 
@@ -141,11 +184,19 @@ void RasterizationStage::process()
 
 void RasterizationStage::resizeTextures(int width, int height)
 {
-    diffuseBuffer->image2D(0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-    specularBuffer->image2D(0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-    faceNormalBuffer->image2D(0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
-    normalBuffer->image2D(0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
-    vsmBuffer->image2D(0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, nullptr);
+    if (m_renderRSM)
+    {
+        diffuseBuffer->image2D(0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        specularBuffer->image2D(0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        faceNormalBuffer->image2D(0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        vsmBuffer->image2D(0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, nullptr);
+    }
+    else
+    {
+        // 16 instead of 28 bytes per pixel with the depth, the G-buffer pass is bandwidth bound at high resolutions
+        diffuseBuffer->image2D(0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        normalBuffer->image2D(0, GL_RGBA16, width, height, 0, GL_RGBA, GL_UNSIGNED_SHORT, nullptr);
+    }
     depthBuffer->image2D(0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
 
     m_fbo->printStatus(true);
@@ -159,44 +210,61 @@ void RasterizationStage::render()
                viewport->height());
 
     m_fbo->bind();
-    m_fbo->setDrawBuffers({
-        GL_COLOR_ATTACHMENT0,
-        GL_COLOR_ATTACHMENT1,
-        GL_COLOR_ATTACHMENT2,
-        GL_COLOR_ATTACHMENT3,
-        GL_COLOR_ATTACHMENT4
-    });
+    m_fbo->setDrawBuffers(m_drawBuffers);
 
     auto maxFloat = std::numeric_limits<float>::max();
 
-    m_fbo->clearBuffer(GL_COLOR, 0, glm::vec4(0.0f));
-    m_fbo->clearBuffer(GL_COLOR, 1, glm::vec4(0.0f));
-    m_fbo->clearBuffer(GL_COLOR, 2, glm::vec4(0.0f));
-    m_fbo->clearBuffer(GL_COLOR, 3, glm::vec4(0.0f));
-    m_fbo->clearBuffer(GL_COLOR, 4, glm::vec4(0.0));
+    // zero normals mark the background in the camera's G-buffer, see gbuffer_packing.glsl
+    for (auto i = 0; i < static_cast<int>(m_drawBuffers.size()); ++i)
+        m_fbo->clearBuffer(GL_COLOR, i, glm::vec4(0.0f));
     m_fbo->clearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
 
-    auto subpixelSample = m_kernelGenerationStage.antiAliasingKernel[currentFrame - 1];
+    // the kernels are reused cyclically if more frames are accumulated than there are samples
+    auto sampleIndex = static_cast<size_t>(currentFrame - 1) % m_kernelGenerationStage.antiAliasingKernel.size();
+
+    auto subpixelSample = m_kernelGenerationStage.antiAliasingKernel[sampleIndex];
     auto viewportSize = glm::vec2(viewport->width(), viewport->height());
-    auto focalPoint = m_kernelGenerationStage.depthOfFieldKernel[currentFrame - 1] * m_focalPoint;
+    auto focalPoint = m_kernelGenerationStage.depthOfFieldKernel[sampleIndex] * m_focalPoint;
     focalPoint *= useDOF;
 
-    for (auto program : std::vector<globjects::Program*>{ m_program, m_zOnlyProgram })
+    auto viewProjection = projection->projection() * camera->view();
+    auto ndcOffset = 2.0f * subpixelSample / viewportSize;
+
+    // the clip volume after the depth of field and antialiasing shifts of model.vert:
+    // xy += (cocPoint + ndcOffset) * w - cocPoint * focalDist
+    auto cullingTransform = viewProjection;
+    auto shift = focalPoint + ndcOffset;
+    for (auto column = 0; column < 4; ++column)
     {
+        cullingTransform[column][0] += shift.x * cullingTransform[column][3];
+        cullingTransform[column][1] += shift.y * cullingTransform[column][3];
+    }
+    cullingTransform[3][0] -= focalPoint.x * m_focalDist;
+    cullingTransform[3][1] -= focalPoint.y * m_focalDist;
+
+    auto& geometry = m_modelLoadingStage.getSceneGeometry();
+    geometry.cull(cullingTransform, m_visibleDraws);
+    PerfCounter::setInfo(m_drawInfoName.c_str(), "%zu drawn, %zu culled",
+        m_visibleDraws.drawCount(), geometry.allDraws().drawCount() - m_visibleDraws.drawCount());
+
+    // the draws occluded in the previous frame are left to the second phase
+    auto& draws = m_useOcclusionCulling ? m_occlusionCulling->cullFirstPhase(geometry, m_visibleDraws) : m_visibleDraws;
+
+    for (auto program : { m_program.get(), m_zOnlyProgram.get(), m_textureFeedbackProgram.get() })
+    {
+        if (!program)
+            continue;
+
         program->setUniform("shadowmap", ShadowSampler);
         program->setUniform("masksTexture", MaskSampler);
         program->setUniform("noiseTexture", NoiseSampler);
-        program->setUniform("diffuseTexture", DiffuseSampler);
-        program->setUniform("specularTexture", SpecularSampler);
-        program->setUniform("emissiveTexture", EmissiveSampler);
-        program->setUniform("opacityTexture", OpacitySampler);
-        program->setUniform("bumpTexture", BumpSampler);
+        program->setUniform("textureArrays", m_textureArraySamplers);
 
         program->setUniform("cameraEye", camera->eye());
-        program->setUniform("viewProjection", projection->projection() * camera->view());
+        program->setUniform("viewProjection", viewProjection);
 
         // offset needs to be doubled, because ndc range is [-1;1] and not [0;1]
-        program->setUniform("ndcOffset", 2.0f * subpixelSample / viewportSize);
+        program->setUniform("ndcOffset", ndcOffset);
 
         program->setUniform("cocPoint", focalPoint);
         program->setUniform("focalDist", m_focalDist);
@@ -204,71 +272,29 @@ void RasterizationStage::render()
 
     glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-    // zPrepass speeds up crytek sponza due to its low geometric complexity
-    if (m_modelLoadingStage.getCurrentPreset() == Preset::CrytekSponza)
-        zPrepass();
+    if (useZPrepass)
+        zPrepass(draws);
 
     m_program->use();
+    m_program->setUniform("bumpType", static_cast<int>(m_bumpType));
 
     glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    for (auto& pair : m_modelLoadingStage.getDrawablesMap())
-    {
-        auto materialId = pair.first;
-        auto& drawables = pair.second;
 
-        auto& material = m_modelLoadingStage.getMaterialMap().at(materialId);
+    auto& materialTable = m_modelLoadingStage.getMaterialTable();
+    materialTable.bind(MaterialBufferBinding, FirstTextureArraySampler);
 
-        bool hasDiffuseTex = material.hasTexture(TextureType::Diffuse);
-        bool hasBumpTex = material.hasTexture(TextureType::Bump);
-        bool hasSpecularTex = material.hasTexture(TextureType::Specular);
-        bool hasEmissiveTex = material.hasTexture(TextureType::Emissive);
-        bool hasOpacityTex = material.hasTexture(TextureType::Opacity);
+    drawSceneGeometry(draws);
 
-        if (hasDiffuseTex)
-        {
-            auto tex = material.textureMap().at(TextureType::Diffuse);
-            tex->bindActive(DiffuseSampler);
-        }
-
-        if (hasSpecularTex)
-        {
-            auto tex = material.textureMap().at(TextureType::Specular);
-            tex->bindActive(SpecularSampler);
-        }
-
-        if (hasEmissiveTex)
-        {
-            auto tex = material.textureMap().at(TextureType::Emissive);
-            tex->bindActive(EmissiveSampler);
-        }
-
-        if (hasOpacityTex)
-        {
-            auto tex = material.textureMap().at(TextureType::Opacity);
-            tex->bindActive(OpacitySampler);
+    for (auto& pair : m_modelLoadingStage.getDrawablesMap())
+    {
+        if (m_modelLoadingStage.getMaterialMap().at(pair.first).hasTexture(TextureType::Opacity))
             glDisable(GL_CULL_FACE);
-        } else {
+        else
             glEnable(GL_CULL_FACE);
-        }
-
-        auto bumpType = BumpType::None;
-        if (hasBumpTex)
-        {
-            bumpType = m_bumpType;
-            auto tex = material.textureMap().at(TextureType::Bump);
-            tex->bindActive(BumpSampler);
-        }
-
-        m_program->setUniform("shininess", material.specularFactor);
 
-        m_program->setUniform("bumpType", static_cast<int>(bumpType));
-        m_program->setUniform("useDiffuseTexture", hasDiffuseTex);
-        m_program->setUniform("useSpecularTexture", hasSpecularTex);
-        m_program->setUniform("useEmissiveTexture", hasEmissiveTex);
-        m_program->setUniform("useOpacityTexture", hasOpacityTex);
-        m_program->setUniform("model", glm::mat4());
+        glVertexAttribI1ui(SceneGeometry::MaterialIndexAttribute, pair.first);
 
-        for (auto& drawable : drawables)
+        for (auto& drawable : pair.second)
         {
             drawable->draw();
         }
@@ -278,32 +304,79 @@ void RasterizationStage::render()
     auto icoMat = glm::mat4();
     icoMat = glm::translate(icoMat, { 0.0f, 1.0f, -0.3f });
     m_program->setUniform("model", icoMat);
+    glVertexAttribI1ui(SceneGeometry::MaterialIndexAttribute, materialTable.defaultMaterialIndex());
 
-    auto ico = globjects::make_ref<gloperate::Icosahedron>(2);
-    ico->draw();
+    m_icosahedron->draw();
 
+    const SceneGeometry::DrawList* secondPhaseDraws = nullptr;
+    if (m_useOcclusionCulling)
+    {
+        // the second phase is tested against the depth of the first one
+        m_occlusionCulling->buildHierarchy(depthBuffer, viewport->width(), viewport->height(), cullingTransform);
+
+        secondPhaseDraws = m_occlusionCulling->cullSecondPhase(geometry);
+        if (secondPhaseDraws)
+        {
+            m_program->use();
+            drawSceneGeometry(*secondPhaseDraws);
+
+            // the next frame's first phase is tested against everything drawn in this one
+            m_occlusionCulling->buildHierarchy(depthBuffer, viewport->width(), viewport->height(), cullingTransform);
+        }
+    }
 
     m_program->release();
 
+    if (m_textureFeedbackProgram && m_modelLoadingStage.getTextureStreaming())
+    {
+        textureFeedbackPass(draws);
+        if (secondPhaseDraws)
+            textureFeedbackPass(*secondPhaseDraws);
+    }
+
     m_fbo->unbind();
 }
 
-void RasterizationStage::zPrepass()
+void RasterizationStage::drawSceneGeometry(const SceneGeometry::DrawList& draws)
+{
+    auto& geometry = m_modelLoadingStage.getSceneGeometry();
+
+    m_program->setUniform("model", glm::mat4());
+
+    // the shader fetches all material data by material index, only culling differs between the two groups
+    m_quantizedVerticesUniform->set(true);
+    geometry.bind();
+    glEnable(GL_CULL_FACE);
+    geometry.draw(draws, 0, draws.opaqueDrawCount(), GL_TRIANGLES);
+    // alpha tested geometry is mostly foliage, which is seen from both sides
+    glDisable(GL_CULL_FACE);
+    geometry.draw(draws, draws.opaqueDrawCount(), draws.drawCount() - draws.opaqueDrawCount(), GL_TRIANGLES);
+    geometry.release();
+    m_quantizedVerticesUniform->set(false);
+}
+
+void RasterizationStage::zPrepass(const SceneGeometry::DrawList& draws)
 {
     m_zOnlyProgram->use();
+    m_zOnlyProgram->setUniform("model", glm::mat4());
+
+    // the opaque draws come first, alpha tested ones are left to the main pass
+    auto& geometry = m_modelLoadingStage.getSceneGeometry();
+    m_zOnlyQuantizedVerticesUniform->set(true);
+    geometry.bind();
+    geometry.draw(draws, 0, draws.opaqueDrawCount(), GL_TRIANGLES);
+    geometry.release();
+    m_zOnlyQuantizedVerticesUniform->set(false);
 
     for (auto& pair : m_modelLoadingStage.getDrawablesMap())
     {
-        auto materialId = pair.first;
-        auto& drawables = pair.second;
-
-        auto& material = m_modelLoadingStage.getMaterialMap().at(materialId);
+        auto& material = m_modelLoadingStage.getMaterialMap().at(pair.first);
         if (material.hasTexture(TextureType::Opacity))
         {
             continue;
         }
 
-        for (auto& drawable : drawables)
+        for (auto& drawable : pair.second)
         {
             drawable->draw();
         }
@@ -312,6 +385,37 @@ void RasterizationStage::zPrepass()
     m_zOnlyProgram->release();
 }
 
+void RasterizationStage::textureFeedbackPass(const SceneGeometry::DrawList& draws)
+{
+    auto textureStreaming = m_modelLoadingStage.getTextureStreaming();
+    textureStreaming->bind(StreamedTextureSizeBinding, TextureFeedbackBinding);
+
+    m_textureFeedbackProgram->use();
+    m_textureFeedbackProgram->setUniform("model", glm::mat4());
+    m_textureFeedbackProgram->setUniform("feedbackOffset", textureStreaming->feedbackOffset());
+    m_textureFeedbackQuantizedVerticesUniform->set(true);
+
+    // the depth of the camera pass is complete, every visible fragment passes the equal test
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_EQUAL);
+
+    auto& geometry = m_modelLoadingStage.getSceneGeometry();
+    geometry.bind();
+    glEnable(GL_CULL_FACE);
+    geometry.draw(draws, 0, draws.opaqueDrawCount(), GL_TRIANGLES);
+    glDisable(GL_CULL_FACE);
+    geometry.draw(draws, draws.opaqueDrawCount(), draws.drawCount() - draws.opaqueDrawCount(), GL_TRIANGLES);
+    geometry.release();
+
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    m_textureFeedbackQuantizedVerticesUniform->set(false);
+    m_textureFeedbackProgram->release();
+}
+
 void RasterizationStage::setupGLState()
 {
     glEnable(GL_DEPTH_TEST);
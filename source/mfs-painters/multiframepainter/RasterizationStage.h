@@ -1,14 +1,21 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
+#include <glbinding/gl/types.h>
+
 #include <globjects/base/ref_ptr.h>
 
 #include "TypeDefinitions.h"
+#include "SceneGeometry.h"
 
 namespace globjects
 {
     class Program;
     class Texture;
     class Framebuffer;
+    template <typename T> class Uniform;
 }
 
 namespace gloperate
@@ -18,9 +25,11 @@ namespace gloperate
     class AbstractCameraCapability;
 
     class PolygonalDrawable;
+    class Icosahedron;
 }
 
 class GroundPlane;
+class OcclusionCulling;
 class ModelLoadingStage;
 class KernelGenerationStage;
 class MultiFramePainter;
@@ -42,8 +51,14 @@ public:
     gloperate::AbstractViewportCapability * viewport;
     gloperate::AbstractCameraCapability * camera;
     bool useDOF;
+    // see PipelineConfiguration::zPrepass
+    bool useZPrepass;
 
     int currentFrame;
+    // the camera pass writes the compact layout of gbuffer_packing.glsl: diffuse and specular intensity in
+    // diffuseBuffer, both normals octahedral encoded in normalBuffer. the RSM keeps the separate targets,
+    // VPLProcessor reads its face normals and the shadow mapping its VSM, so specularBuffer, faceNormalBuffer
+    // and vsmBuffer only exist for it and normalBuffer only for the camera pass
     globjects::ref_ptr<globjects::Texture> diffuseBuffer;
     globjects::ref_ptr<globjects::Texture> specularBuffer;
     globjects::ref_ptr<globjects::Texture> faceNormalBuffer;
@@ -57,11 +72,28 @@ protected:
     void resizeTextures(int width, int height);
     static void setupGLState();
     void render();
-    void zPrepass();
+    void drawSceneGeometry(const SceneGeometry::DrawList& draws);
+    void zPrepass(const SceneGeometry::DrawList& draws);
+    // after all draws, so only visible fragments request texture levels from TextureStreaming
+    void textureFeedbackPass(const SceneGeometry::DrawList& draws);
 
     globjects::ref_ptr<globjects::Framebuffer> m_fbo;
+    std::vector<gl::GLenum> m_drawBuffers;
     globjects::ref_ptr<globjects::Program> m_program;
     globjects::ref_ptr<globjects::Program> m_zOnlyProgram;
+    // null for the RSM and without bindless textures, there is no texture streaming then
+    globjects::ref_ptr<globjects::Program> m_textureFeedbackProgram;
+    // toggled around every scene geometry draw, by name each toggle would allocate
+    globjects::Uniform<bool> * m_quantizedVerticesUniform;
+    globjects::Uniform<bool> * m_zOnlyQuantizedVerticesUniform;
+    globjects::Uniform<bool> * m_textureFeedbackQuantizedVerticesUniform;
+
+    std::vector<int> m_textureArraySamplers;
+    // the scene geometry's draws inside the current frame's frustum
+    SceneGeometry::DrawList m_visibleDraws;
+    std::unique_ptr<OcclusionCulling> m_occlusionCulling;
+    bool m_useOcclusionCulling;
+    globjects::ref_ptr<gloperate::Icosahedron> m_icosahedron;
 
     float m_focalPoint;
     float m_focalDist;
@@ -72,4 +104,6 @@ protected:
     bool m_renderRSM;
 
     std::string m_name;
+    // built once, the performance counters are updated every frame
+    std::string m_drawInfoName;
 };
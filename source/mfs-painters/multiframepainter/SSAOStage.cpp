@@ -1,5 +1,9 @@
 #include "SSAOStage.h"
 
+#include <algorithm>
+
+#include <glm/gtc/constants.hpp>
+
 #include <glbinding/gl/enum.h>
 
 #include <glkernel/Kernel.h>
@@ -7,30 +11,64 @@
 #include <globjects/Texture.h>
 #include <globjects/Program.h>
 #include <globjects/Framebuffer.h>
+#include <globjects/Uniform.h>
 
 #include <gloperate/primitives/ScreenAlignedQuad.h>
 #include <gloperate/painter/AbstractViewportCapability.h>
 #include <gloperate/painter/AbstractPerspectiveProjectionCapability.h>
 #include <gloperate/painter/AbstractCameraCapability.h>
 
+#include <reflectionzeug/property/PropertyGroup.h>
+
 #include "KernelGenerationStage.h"
 #include "ModelLoadingStage.h"
+#include "MultiFramePainter.h"
 #include "PerfCounter.h"
 
 using namespace gl;
 
 namespace
 {
-    const unsigned int s_ssaoKernelSize = 16;
+    // progressive mode distributes the reference kernel over multiple frames
+    const unsigned int s_ssaoKernelSize = 64;
+    const unsigned int s_ssaoSingleFrameSampleCount = 16;
     const unsigned int s_ssaoNoiseSize = 128;
 }
 
 SSAOStage::SSAOStage(KernelGenerationStage& kernelGenerationStage, const ModelLoadingStage& modelLoadingStage)
-: m_kernelGenerationStage(kernelGenerationStage)
+: currentFrame(1)
+, tileErrorThreshold(-1.0f)
+, m_tileErrorThresholdUniform(nullptr)
+, m_kernelGenerationStage(kernelGenerationStage)
 , m_modelLoadingStage(modelLoadingStage)
+, m_progressive(true)
+, m_samplesPerFrame(4)
 {
 }
 
+void SSAOStage::initProperties(MultiFramePainter& painter)
+{
+    auto group = painter.addGroup("SSAO");
+    group->addProperty<bool>("Progressive",
+        [this]() { return m_progressive; },
+        [this, &painter](const bool & value) {
+            m_progressive = value;
+            painter.resetAccumulation();
+        }
+    );
+
+    group->addProperty<int>("SamplesPerFrame",
+        [this]() { return m_samplesPerFrame; },
+        [this, &painter](const int & count) {
+            m_samplesPerFrame = count;
+            painter.resetAccumulation();
+        }
+    )->setOptions({
+        { "minimum", 1 },
+        { "maximum", static_cast<int>(s_ssaoKernelSize) },
+    });
+}
+
 void SSAOStage::initialize()
 {
     occlusionBuffer = globjects::Texture::createDefault(GL_TEXTURE_2D);
@@ -45,6 +83,12 @@ void SSAOStage::initialize()
         globjects::Shader::fromFile(GL_VERTEX_SHADER, "data/shaders/deferredshading.vert"),
         globjects::Shader::fromFile(GL_FRAGMENT_SHADER, "data/shaders/ssao.frag"));
 
+    program->setUniform("normalSampler", 0);
+    program->setUniform("depthSampler", 1);
+    program->setUniform("ssaoKernelSampler", 2);
+    program->setUniform("ssaoNoiseSampler", 3);
+    program->setUniform("tileErrorSampler", 4);
+    m_tileErrorThresholdUniform = program->getUniform<float>("tileErrorThreshold");
 
     m_screenAlignedQuad = new gloperate::ScreenAlignedQuad(program);
 
@@ -56,8 +100,6 @@ void SSAOStage::process()
 {
     AutoGLPerfCounter c("SSAO");
 
-    const auto screenSize = glm::vec2(viewport->width(), viewport->height());
-
     if (viewport->hasChanged())
         resizeTexture(viewport->width(), viewport->height());
 
@@ -66,24 +108,28 @@ void SSAOStage::process()
     m_fbo->bind();
     m_fbo->setDrawBuffer(GL_COLOR_ATTACHMENT0);
 
-    faceNormalBuffer->bindActive(0);
+    normalBuffer->bindActive(0);
     depthBuffer->bindActive(1);
     m_ssaoKernelTexture->bindActive(2);
     m_ssaoNoiseTexture->bindActive(3);
+    tileError->bindActive(4);
 
-    m_screenAlignedQuad->program()->setUniform("normalSampler", 0);
-    m_screenAlignedQuad->program()->setUniform("depthSampler", 1);
-    m_screenAlignedQuad->program()->setUniform("ssaoKernelSampler", 2);
-    m_screenAlignedQuad->program()->setUniform("ssaoNoiseSampler", 3);
+    m_tileErrorThresholdUniform->set(tileErrorThreshold);
 
     m_screenAlignedQuad->program()->setUniform("ssaoRadius", m_modelLoadingStage.getCurrentPresetInformation().lightMaxShift * 0.5f);
-    m_screenAlignedQuad->program()->setUniform("projectionMatrix", projection->projection());
-    m_screenAlignedQuad->program()->setUniform("projectionInverseMatrix", projection->projectionInverted());
-    m_screenAlignedQuad->program()->setUniform("normalMatrix", camera->normal());
-    m_screenAlignedQuad->program()->setUniform("view", camera->view());
-    m_screenAlignedQuad->program()->setUniform("farZ", projection->zFar());
-    m_screenAlignedQuad->program()->setUniform("screenSize", screenSize);
-    m_screenAlignedQuad->program()->setUniform("samplerSizes", glm::vec4(s_ssaoKernelSize, 1.f / s_ssaoKernelSize, s_ssaoNoiseSize, 1.f / s_ssaoNoiseSize));
+    // every frame takes every stride-th kernel sample, so each subset covers all sample distances.
+    // once all subsets have been used, the noise is rotated to get new sample directions.
+    auto sampleCount = m_progressive ? static_cast<unsigned int>(m_samplesPerFrame) : s_ssaoSingleFrameSampleCount;
+    auto stride = std::max(s_ssaoKernelSize / sampleCount, 1u);
+    auto frameIndex = m_progressive ? static_cast<unsigned int>(currentFrame - 1) : 0u;
+    auto kernelOffset = frameIndex % stride;
+    auto noiseRotation = glm::mod((frameIndex / stride) * glm::golden_ratio<float>() * glm::two_pi<float>(), glm::two_pi<float>());
+
+    m_screenAlignedQuad->program()->setUniform("samplerSizes", glm::vec4(sampleCount, 1.f / sampleCount, s_ssaoNoiseSize, 1.f / s_ssaoNoiseSize));
+    m_screenAlignedQuad->program()->setUniform("kernelTexelSize", 1.f / s_ssaoKernelSize);
+    m_screenAlignedQuad->program()->setUniform("kernelOffset", static_cast<float>(kernelOffset));
+    m_screenAlignedQuad->program()->setUniform("kernelStride", static_cast<float>(stride));
+    m_screenAlignedQuad->program()->setUniform("noiseRotation", noiseRotation);
  
 
     m_screenAlignedQuad->draw();
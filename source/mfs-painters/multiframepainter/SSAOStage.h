@@ -10,6 +10,7 @@ namespace globjects
 {
     class Framebuffer;
     class Texture;
+    template <typename T> class Uniform;
 }
 
 namespace gloperate
@@ -23,12 +24,15 @@ namespace gloperate
 
 class KernelGenerationStage;
 class ModelLoadingStage;
+class MultiFramePainter;
 
 class SSAOStage
 {
 public:
     SSAOStage(KernelGenerationStage& kernelGenerationStage, const ModelLoadingStage& modelLoadingStage);
 
+    void initProperties(MultiFramePainter& painter);
+
     void initialize();
     void process();
 
@@ -38,10 +42,14 @@ public:
     int ssaoKernelSize;
     int ssaoNoiseSize;
 
-    globjects::ref_ptr<globjects::Texture> specularBuffer;
-    globjects::ref_ptr<globjects::Texture> faceNormalBuffer;
+    // 1-based sample index, selects the kernel samples of the current frame in progressive mode
+    int currentFrame;
+
+    // the packed normals of the camera's G-buffer, see gbuffer_packing.glsl
     globjects::ref_ptr<globjects::Texture> normalBuffer;
     globjects::ref_ptr<globjects::Texture> depthBuffer;
+    globjects::ref_ptr<globjects::Texture> tileError;
+    float tileErrorThreshold;
 
     globjects::ref_ptr<globjects::Texture> occlusionBuffer;
 
@@ -54,9 +62,14 @@ protected:
 
     globjects::ref_ptr<globjects::Framebuffer> m_fbo;
     globjects::ref_ptr<gloperate::ScreenAlignedQuad> m_screenAlignedQuad;
+    // kept from initialize(), a name this long is a heap allocated string per setUniform()
+    globjects::Uniform<float> * m_tileErrorThresholdUniform;
 
     globjects::ref_ptr<globjects::Texture> m_ssaoKernelTexture;
     globjects::ref_ptr<globjects::Texture> m_ssaoNoiseTexture;
     KernelGenerationStage& m_kernelGenerationStage;
     const ModelLoadingStage& m_modelLoadingStage;
+
+    bool m_progressive;
+    int m_samplesPerFrame;
 };
@@ -0,0 +1,342 @@
+#include "SceneGeometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include <glm/common.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+#include <globjects/Buffer.h>
+#include <globjects/VertexArray.h>
+#include <globjects/VertexAttributeBinding.h>
+
+#include <gloperate/primitives/PolygonalGeometry.h>
+
+using namespace gl;
+
+
+namespace
+{
+    enum Attribute : GLuint
+    {
+        VertexAttribute,
+        NormalAttribute,
+        TextureCoordinateAttribute,
+        // followed by SceneGeometry::MaterialIndexAttribute
+        BoundsMinAttribute = SceneGeometry::MaterialIndexAttribute + 1,
+        BoundsExtentAttribute
+    };
+
+    bool isOpaque(const IdMaterialMap & materials, unsigned int materialIndex)
+    {
+        auto material = materials.find(materialIndex);
+        return material == materials.end() || !material->second.hasTexture(TextureType::Opacity);
+    }
+
+    bool needsWideIndices(const gloperate::PolygonalGeometry & geometry)
+    {
+        return geometry.vertices().size() > std::numeric_limits<GLushort>::max();
+    }
+
+    GLushort packUnorm16(float value)
+    {
+        return static_cast<GLushort>(std::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+    }
+
+    GLshort packSnorm16(float value)
+    {
+        return static_cast<GLshort>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    // projects onto the octahedron and unfolds its lower half, see unpackNormal in vertex_packing.glsl
+    glm::vec2 octahedralEncode(const glm::vec3 & normal)
+    {
+        auto sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (sum == 0.0f)
+            return glm::vec2(0.0f);
+
+        auto projected = normal / sum;
+        if (projected.z >= 0.0f)
+            return glm::vec2(projected.x, projected.y);
+
+        return glm::vec2(
+            (1.0f - std::abs(projected.y)) * (projected.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(projected.x)) * (projected.y >= 0.0f ? 1.0f : -1.0f));
+    }
+
+    template <typename T>
+    globjects::Buffer * createBuffer(const std::vector<T> & data)
+    {
+        // immutable storage can't be empty, scenes that failed to load have no geometry
+        auto buffer = new globjects::Buffer();
+        buffer->setStorage(std::max<size_t>(data.size(), 1) * sizeof(T), data.empty() ? nullptr : data.data(), GL_NONE_BIT);
+        return buffer;
+    }
+}
+
+
+SceneGeometry::SceneGeometry(const std::vector<std::unique_ptr<gloperate::PolygonalGeometry>> & geometries, const IdMaterialMap & materials)
+{
+    // opaque materials first, then the 32 bit index draws before the 16 bit ones like in the index buffer, then by
+    // material. the mesh order is kept within a material
+    std::vector<size_t> order(geometries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        auto materialA = geometries[a]->materialIndex();
+        auto materialB = geometries[b]->materialIndex();
+        auto opaqueA = isOpaque(materials, materialA);
+        auto opaqueB = isOpaque(materials, materialB);
+        if (opaqueA != opaqueB)
+            return opaqueA;
+
+        auto wideA = needsWideIndices(*geometries[a]);
+        auto wideB = needsWideIndices(*geometries[b]);
+        return wideA != wideB ? wideA : materialA < materialB;
+    });
+
+    size_t vertexCount = 0;
+    size_t wideIndexCount = 0;
+    size_t narrowIndexCount = 0;
+    for (const auto & geometry : geometries)
+    {
+        vertexCount += geometry->vertices().size();
+        if (needsWideIndices(*geometry))
+            wideIndexCount += geometry->indices().size();
+        else
+            narrowIndexCount += geometry->indices().size();
+    }
+
+    // the 32 bit indices first, firstIndex of the 16 bit ones counts 16 bit units from the buffer start
+    std::vector<unsigned char> indexData(wideIndexCount * sizeof(GLuint) + narrowIndexCount * sizeof(GLushort));
+    auto wideIndexOffset = size_t(0);
+    auto narrowIndexOffset = wideIndexCount * sizeof(GLuint) / sizeof(GLushort);
+
+    std::vector<PackedVertex> vertexData;
+    vertexData.reserve(vertexCount);
+    auto & commands = m_allDraws.m_commands;
+    std::vector<DrawParameters> drawParameters;
+    std::vector<BoundingBox> bounds;
+
+    for (auto index : order)
+    {
+        const auto & geometry = *geometries[index];
+        const auto & vertices = geometry.vertices();
+        const auto & indices = geometry.indices();
+        auto materialIndex = geometry.materialIndex();
+        auto drawIndex = static_cast<GLuint>(commands.size());
+        auto wide = needsWideIndices(geometry);
+
+        auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (const auto & vertex : vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex);
+            boundsMax = glm::max(boundsMax, vertex);
+        }
+        auto boundsExtent = vertices.empty() ? glm::vec3(0.0f) : boundsMax - boundsMin;
+
+        auto firstIndex = wide ? wideIndexOffset : narrowIndexOffset;
+        commands.push_back({ static_cast<GLuint>(indices.size()), 1, static_cast<GLuint>(firstIndex), static_cast<GLint>(vertexData.size()), drawIndex });
+        drawParameters.push_back({ materialIndex,
+            { boundsMin.x, boundsMin.y, boundsMin.z },
+            { boundsExtent.x, boundsExtent.y, boundsExtent.z } });
+        bounds.push_back({ boundsMin, boundsMax });
+
+        if (wide)
+        {
+            std::memcpy(indexData.data() + wideIndexOffset * sizeof(GLuint), indices.data(), indices.size() * sizeof(GLuint));
+            wideIndexOffset += indices.size();
+        }
+        else
+        {
+            auto narrowIndices = reinterpret_cast<GLushort *>(indexData.data()) + narrowIndexOffset;
+            std::transform(indices.begin(), indices.end(), narrowIndices, [](unsigned int i) { return static_cast<GLushort>(i); });
+            narrowIndexOffset += indices.size();
+        }
+
+        // an empty extent leaves the component at the bounds minimum
+        auto inverseExtent = 1.0f / glm::max(boundsExtent, glm::vec3(std::numeric_limits<float>::min()));
+        for (auto i = 0u; i < vertices.size(); ++i)
+        {
+            PackedVertex packed;
+
+            auto normalized = (vertices[i] - boundsMin) * inverseExtent;
+            packed.position[0] = packUnorm16(normalized.x);
+            packed.position[1] = packUnorm16(normalized.y);
+            packed.position[2] = packUnorm16(normalized.z);
+            packed.position[3] = 0;
+
+            auto normal = geometry.hasNormals() ? octahedralEncode(geometry.normals()[i]) : glm::vec2(0.0f);
+            packed.normal[0] = packSnorm16(normal.x);
+            packed.normal[1] = packSnorm16(normal.y);
+
+            auto textureCoordinate = geometry.hasTextureCoordinates() ? glm::vec2(geometry.textureCoordinates()[i]) : glm::vec2(0.0f);
+            packed.textureCoordinate[0] = glm::packHalf1x16(textureCoordinate.x);
+            packed.textureCoordinate[1] = glm::packHalf1x16(textureCoordinate.y);
+
+            vertexData.push_back(packed);
+        }
+
+        auto indexType = wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+        auto & indexRanges = m_allDraws.m_indexRanges;
+        if (indexRanges.empty() || indexRanges.back().type != indexType)
+            indexRanges.push_back({ drawIndex, 0, indexType });
+        ++indexRanges.back().drawCount;
+        m_indexTypes.push_back(indexType);
+
+        if (isOpaque(materials, materialIndex))
+            ++m_allDraws.m_opaqueDrawCount;
+    }
+
+    m_hierarchy = BoundingVolumeHierarchy(bounds);
+
+    m_vertices = createBuffer(vertexData);
+    m_indices = createBuffer(indexData);
+    m_drawParameters = createBuffer(drawParameters);
+    m_allDraws.m_buffer = createBuffer(commands);
+
+    m_vao = new globjects::VertexArray();
+    m_vao->bindElementBuffer(m_indices);
+
+    auto setupAttribute = [this](GLuint attribute, globjects::Buffer * buffer, GLint stride) {
+        auto binding = m_vao->binding(attribute);
+        binding->setAttribute(attribute);
+        binding->setBuffer(buffer, 0, stride);
+        m_vao->enable(attribute);
+        return binding;
+    };
+
+    setupAttribute(VertexAttribute, m_vertices, sizeof(PackedVertex))->setFormat(3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+    setupAttribute(NormalAttribute, m_vertices, sizeof(PackedVertex))->setFormat(2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+    setupAttribute(TextureCoordinateAttribute, m_vertices, sizeof(PackedVertex))->setFormat(2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, textureCoordinate));
+
+    // per draw, the base instance of each command is its draw index
+    auto materialBinding = setupAttribute(MaterialIndexAttribute, m_drawParameters, sizeof(DrawParameters));
+    materialBinding->setIFormat(1, GL_UNSIGNED_INT, offsetof(DrawParameters, materialIndex));
+    materialBinding->setDivisor(1);
+
+    auto boundsMinBinding = setupAttribute(BoundsMinAttribute, m_drawParameters, sizeof(DrawParameters));
+    boundsMinBinding->setFormat(3, GL_FLOAT, GL_FALSE, offsetof(DrawParameters, boundsMin));
+    boundsMinBinding->setDivisor(1);
+
+    auto boundsExtentBinding = setupAttribute(BoundsExtentAttribute, m_drawParameters, sizeof(DrawParameters));
+    boundsExtentBinding->setFormat(3, GL_FLOAT, GL_FALSE, offsetof(DrawParameters, boundsExtent));
+    boundsExtentBinding->setDivisor(1);
+}
+
+SceneGeometry::~SceneGeometry()
+{
+}
+
+const SceneGeometry::DrawList & SceneGeometry::allDraws() const
+{
+    return m_allDraws;
+}
+
+void SceneGeometry::cull(const glm::mat4 & transform, DrawList & draws) const
+{
+    m_visibleDraws.clear();
+    m_hierarchy.cull(transform, m_visibleDraws);
+    // back to the order of the scene geometry, which groups the draws by opacity and index type
+    std::sort(m_visibleDraws.begin(), m_visibleDraws.end());
+
+    draws.m_commands.clear();
+    draws.m_indexRanges.clear();
+    draws.m_opaqueDrawCount = 0;
+
+    for (auto drawIndex : m_visibleDraws)
+    {
+        auto indexType = m_indexTypes[drawIndex];
+        if (draws.m_indexRanges.empty() || draws.m_indexRanges.back().type != indexType)
+            draws.m_indexRanges.push_back({ draws.m_commands.size(), 0, indexType });
+        ++draws.m_indexRanges.back().drawCount;
+
+        draws.m_commands.push_back(m_allDraws.m_commands[drawIndex]);
+        if (drawIndex < m_allDraws.m_opaqueDrawCount)
+            ++draws.m_opaqueDrawCount;
+    }
+
+    draws.upload();
+}
+
+void SceneGeometry::bind() const
+{
+    m_vao->bind();
+}
+
+void SceneGeometry::release() const
+{
+    m_vao->unbind();
+}
+
+void SceneGeometry::draw(const DrawList & draws, size_t firstDraw, size_t drawCount, GLenum mode) const
+{
+    draws.m_buffer->bind(GL_DRAW_INDIRECT_BUFFER);
+
+    // one call per index type within the requested draws
+    for (const auto & range : draws.m_indexRanges)
+    {
+        auto begin = std::max(firstDraw, range.firstDraw);
+        auto end = std::min(firstDraw + drawCount, range.firstDraw + range.drawCount);
+        if (begin >= end)
+            continue;
+
+        auto offset = reinterpret_cast<const void *>(begin * sizeof(DrawElementsIndirectCommand));
+        glMultiDrawElementsIndirect(mode, range.type, offset, static_cast<GLsizei>(end - begin), 0);
+    }
+
+    globjects::Buffer::unbind(GL_DRAW_INDIRECT_BUFFER);
+}
+
+globjects::Buffer * SceneGeometry::drawParameterBuffer() const
+{
+    return m_drawParameters;
+}
+
+
+SceneGeometry::DrawList::DrawList()
+: m_opaqueDrawCount(0)
+{
+}
+
+size_t SceneGeometry::DrawList::drawCount() const
+{
+    return m_commands.size();
+}
+
+size_t SceneGeometry::DrawList::opaqueDrawCount() const
+{
+    return m_opaqueDrawCount;
+}
+
+void SceneGeometry::DrawList::copyFrom(const DrawList & draws)
+{
+    m_commands = draws.m_commands;
+    m_indexRanges = draws.m_indexRanges;
+    m_opaqueDrawCount = draws.m_opaqueDrawCount;
+
+    upload();
+}
+
+globjects::Buffer * SceneGeometry::DrawList::commandBuffer() const
+{
+    return m_buffer;
+}
+
+void SceneGeometry::DrawList::upload()
+{
+    if (!m_buffer)
+        m_buffer = new globjects::Buffer();
+
+    m_buffer->setData(m_commands, GL_STREAM_DRAW);
+}
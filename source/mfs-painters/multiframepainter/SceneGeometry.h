@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/fwd.hpp>
+
+#include <glbinding/gl/types.h>
+
+#include <globjects/base/ref_ptr.h>
+
+#include "TypeDefinitions.h"
+#include "BoundingVolumeHierarchy.h"
+
+namespace globjects
+{
+    class Buffer;
+    class VertexArray;
+}
+
+namespace gloperate
+{
+    class PolygonalGeometry;
+}
+
+
+// All meshes of a scene in one vertex and one index buffer, drawn with glMultiDrawElementsIndirect.
+// The draws are sorted by material, opaque materials first, so each group needs a single call per index type.
+// Each draw's material index and bounds are instanced attributes (its base instance is the draw index).
+// Vertices are quantized to 16 bytes: positions as 16 bit normalized to the mesh bounds, octahedral
+// 2x16 bit normals and half float texture coordinates. Meshes with few vertices use 16 bit indices.
+class SceneGeometry
+{
+public:
+    static const gl::GLuint MaterialIndexAttribute = 3;
+
+    struct DrawElementsIndirectCommand
+    {
+        gl::GLuint count;
+        gl::GLuint instanceCount;
+        gl::GLuint firstIndex;
+        gl::GLint baseVertex;
+        gl::GLuint baseInstance;
+    };
+
+    // consecutive draws with the same index type
+    struct IndexRange
+    {
+        size_t firstDraw;
+        size_t drawCount;
+        gl::GLenum type;
+    };
+
+    // a subset of the draws in the scene geometry's order, with its own indirect buffer
+    class DrawList
+    {
+    public:
+        DrawList();
+
+        size_t drawCount() const;
+        // the draws of materials without opacity texture come first
+        size_t opaqueDrawCount() const;
+
+        // the same draws with an indirect buffer of their own, whose commands may then be modified on the GPU
+        void copyFrom(const DrawList & draws);
+        globjects::Buffer * commandBuffer() const;
+
+    protected:
+        friend class SceneGeometry;
+
+        void upload();
+
+        std::vector<DrawElementsIndirectCommand> m_commands;
+        std::vector<IndexRange> m_indexRanges;
+        size_t m_opaqueDrawCount;
+        globjects::ref_ptr<globjects::Buffer> m_buffer;
+    };
+
+    SceneGeometry(const std::vector<std::unique_ptr<gloperate::PolygonalGeometry>> & geometries, const IdMaterialMap & materials);
+    ~SceneGeometry();
+
+    const DrawList & allDraws() const;
+
+    // replaces the draws with the ones whose bounds intersect the clip volume of transform and uploads them
+    void cull(const glm::mat4 & transform, DrawList & draws) const;
+
+    // binds the vertex array, draw() may be called in between
+    void bind() const;
+    void release() const;
+    void draw(const DrawList & draws, size_t firstDraw, size_t drawCount, gl::GLenum mode) const;
+
+    // the material index and bounds of each draw, indexed by the commands' base instance
+    globjects::Buffer * drawParameterBuffer() const;
+
+protected:
+    struct PackedVertex
+    {
+        gl::GLushort position[4];
+        gl::GLshort normal[2];
+        gl::GLushort textureCoordinate[2];
+    };
+
+    // std430 layout, has to match occlusion_culling/cull.comp
+    struct DrawParameters
+    {
+        gl::GLuint materialIndex;
+        float boundsMin[3];
+        float boundsExtent[3];
+    };
+
+    DrawList m_allDraws;
+    BoundingVolumeHierarchy m_hierarchy;
+    std::vector<gl::GLenum> m_indexTypes;
+
+    globjects::ref_ptr<globjects::VertexArray> m_vao;
+    globjects::ref_ptr<globjects::Buffer> m_vertices;
+    globjects::ref_ptr<globjects::Buffer> m_indices;
+    globjects::ref_ptr<globjects::Buffer> m_drawParameters;
+
+    // reused between culls
+    mutable std::vector<uint32_t> m_visibleDraws;
+};
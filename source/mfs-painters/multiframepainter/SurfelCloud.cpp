@@ -0,0 +1,126 @@
+#include "SurfelCloud.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+#include <globjects/Buffer.h>
+#include <globjects/Program.h>
+#include <globjects/Query.h>
+#include <globjects/Shader.h>
+#include <globjects/TransformFeedback.h>
+
+#include <gloperate/primitives/PolygonalDrawable.h>
+
+#include "PerfCounter.h"
+#include "SceneGeometry.h"
+
+using namespace gl;
+
+namespace
+{
+    const int s_floatsPerSurfel = 5;
+    // as many points as the per frame point buffer of the tessellated rendering held
+    const int s_maxSurfelCount = 1 << 23;
+}
+
+
+SurfelCloud::SurfelCloud()
+: m_surfelCount(0)
+, m_tessLevelFactor(0.0f)
+, m_valid(false)
+{
+    m_program = new globjects::Program();
+    m_program->attach(
+        globjects::Shader::fromFile(GL_VERTEX_SHADER, "data/shaders/ism/ism.vert"),
+        globjects::Shader::fromFile(GL_TESS_CONTROL_SHADER, "data/shaders/ism/ism.tesc"),
+        globjects::Shader::fromFile(GL_TESS_EVALUATION_SHADER, "data/shaders/ism/ism.tese"),
+        globjects::Shader::fromFile(GL_GEOMETRY_SHADER, "data/shaders/ism/surfels.geom")
+    );
+
+    m_transformFeedback = new globjects::TransformFeedback();
+    m_transformFeedback->setVaryings(m_program, { "s_positionRadius", "s_normal" }, GL_INTERLEAVED_ATTRIBS);
+
+    m_query = new globjects::Query();
+}
+
+SurfelCloud::~SurfelCloud()
+{
+}
+
+void SurfelCloud::invalidate()
+{
+    m_valid = false;
+}
+
+void SurfelCloud::update(const SceneGeometry& sceneGeometry, const IdDrawablesMap& drawablesMap, float tessLevelFactor)
+{
+    if (m_valid && tessLevelFactor == m_tessLevelFactor)
+        return;
+
+    AutoGLDebugGroup c("Surfel sampling");
+
+    m_valid = true;
+    m_tessLevelFactor = tessLevelFactor;
+
+    m_program->setUniform("tessLevelFactor", tessLevelFactor);
+    m_program->use();
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glPatchParameteri(GL_PATCH_VERTICES, 3);
+
+    // the first pass only counts the tessellated triangles, so the buffer can be allocated
+    m_query->begin(GL_PRIMITIVES_GENERATED);
+    draw(sceneGeometry, drawablesMap);
+    m_query->end(GL_PRIMITIVES_GENERATED);
+
+    auto generatedCount = static_cast<int>(m_query->get(GL_QUERY_RESULT));
+    m_surfelCount = std::min(generatedCount, s_maxSurfelCount);
+    if (generatedCount > s_maxSurfelCount)
+        std::cout << "TessLevelFactor " << tessLevelFactor << " yields " << generatedCount << " surfels, only " << s_maxSurfelCount << " are kept" << std::endl;
+
+    m_buffer = new globjects::Buffer();
+    m_buffer->setName("Surfels");
+    m_buffer->setData(std::max(m_surfelCount, 1) * s_floatsPerSurfel * sizeof(float), nullptr, GL_STATIC_DRAW);
+
+    // transform feedback stops writing once the buffer is full
+    m_transformFeedback->bind();
+    m_buffer->bindBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+    m_transformFeedback->begin(GL_POINTS);
+    draw(sceneGeometry, drawablesMap);
+    m_transformFeedback->end();
+    globjects::TransformFeedback::unbind();
+
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    m_program->release();
+}
+
+int SurfelCloud::surfelCount() const
+{
+    return m_surfelCount;
+}
+
+globjects::Buffer * SurfelCloud::buffer() const
+{
+    return m_buffer;
+}
+
+void SurfelCloud::draw(const SceneGeometry& sceneGeometry, const IdDrawablesMap& drawablesMap) const
+{
+    m_program->setUniform("quantizedVertices", true);
+    sceneGeometry.bind();
+    sceneGeometry.draw(sceneGeometry.allDraws(), 0, sceneGeometry.allDraws().drawCount(), GL_PATCHES);
+    sceneGeometry.release();
+    m_program->setUniform("quantizedVertices", false);
+
+    for (const auto& pair : drawablesMap)
+    {
+        for (auto& drawable : pair.second)
+        {
+            drawable->draw(GL_PATCHES);
+        }
+    }
+}
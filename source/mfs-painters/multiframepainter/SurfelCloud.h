@@ -0,0 +1,46 @@
+#pragma once
+
+#include <globjects/base/ref_ptr.h>
+
+#include "TypeDefinitions.h"
+
+namespace globjects
+{
+    class Buffer;
+    class Program;
+    class Query;
+    class TransformFeedback;
+}
+
+class SceneGeometry;
+
+
+// Points sampled from the static scene, which the imperfect shadow maps are splatted from instead of tessellating the
+// scene every frame. The scene is tessellated once with the shaders of the ISM rasterization, so tessLevelFactor sets
+// the density, and each tessellated triangle is captured with transform feedback as a surfel at its centroid.
+class SurfelCloud
+{
+public:
+    SurfelCloud();
+    ~SurfelCloud();
+
+    // the scene has changed, it is sampled again on the next update
+    void invalidate();
+    void update(const SceneGeometry& sceneGeometry, const IdDrawablesMap& drawablesMap, float tessLevelFactor);
+
+    int surfelCount() const;
+    // five floats per surfel: position, radius and the packed normal, see ism/surfels.geom
+    globjects::Buffer * buffer() const;
+
+protected:
+    void draw(const SceneGeometry& sceneGeometry, const IdDrawablesMap& drawablesMap) const;
+
+    globjects::ref_ptr<globjects::Program> m_program;
+    globjects::ref_ptr<globjects::TransformFeedback> m_transformFeedback;
+    globjects::ref_ptr<globjects::Query> m_query;
+    globjects::ref_ptr<globjects::Buffer> m_buffer;
+
+    int m_surfelCount;
+    float m_tessLevelFactor;
+    bool m_valid;
+};
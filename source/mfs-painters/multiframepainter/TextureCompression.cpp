@@ -0,0 +1,450 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "FileUtils.h"
+
+
+namespace
+{
+    const unsigned char s_ktxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    const uint32_t s_ktxEndianness = 0x04030201;
+
+    // bump when the encoder or the mip filter changes, cached files are recompressed then
+    const char s_versionKey[] = "mfs.encoderVersion";
+    const char s_version[] = "1";
+
+    struct KtxHeader
+    {
+        unsigned char identifier[12];
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    // GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RED_RGTC1, GL_COMPRESSED_RG_RGTC2
+    const uint32_t s_internalFormats[] = { 0x83F0, 0x83F3, 0x8DBB, 0x8DBD };
+    // GL_RGB, GL_RGBA, GL_RED, GL_RG
+    const uint32_t s_baseInternalFormats[] = { 0x1907, 0x1908, 0x1903, 0x8227 };
+
+    using Block = unsigned char[16][4];
+
+    size_t blockBytes(BlockCompression format)
+    {
+        return format == BlockCompression::BC1 || format == BlockCompression::BC4 ? 8 : 16;
+    }
+
+    size_t compressedSize(BlockCompression format, int width, int height)
+    {
+        return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * blockBytes(format);
+    }
+
+    int mipLevelCount(int width, int height)
+    {
+        auto levels = 1;
+        for (auto size = std::max(width, height); size > 1; size /= 2)
+            ++levels;
+
+        return levels;
+    }
+
+    size_t padded(size_t size)
+    {
+        return (size + 3) & ~size_t(3);
+    }
+
+    // edge texels are repeated for blocks that reach over the border of the image
+    void fetchBlock(const unsigned char * pixels, int width, int height, int blockX, int blockY, Block & block)
+    {
+        for (auto y = 0; y < 4; ++y)
+        {
+            for (auto x = 0; x < 4; ++x)
+            {
+                auto sourceX = std::min(blockX * 4 + x, width - 1);
+                auto sourceY = std::min(blockY * 4 + y, height - 1);
+                std::memcpy(block[y * 4 + x], pixels + (static_cast<size_t>(sourceY) * width + sourceX) * 4, 4);
+            }
+        }
+    }
+
+    uint16_t packRgb565(const float color[3])
+    {
+        auto r = static_cast<uint16_t>(std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f));
+        auto g = static_cast<uint16_t>(std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f));
+        auto b = static_cast<uint16_t>(std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void unpackRgb565(uint16_t packed, int color[3])
+    {
+        auto r = (packed >> 11) & 31;
+        auto g = (packed >> 5) & 63;
+        auto b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // endpoints on the principal axis of the block's colors, always in four color mode
+    void encodeBC1(const Block & block, unsigned char * out)
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (auto i = 0; i < 16; ++i)
+            for (auto c = 0; c < 3; ++c)
+                mean[c] += block[i][c] / 16.0f;
+
+        float covariance[3][3] = {};
+        for (auto i = 0; i < 16; ++i)
+            for (auto a = 0; a < 3; ++a)
+                for (auto b = 0; b < 3; ++b)
+                    covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+        // power iteration
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (auto iteration = 0; iteration < 4; ++iteration)
+        {
+            float next[3];
+            for (auto a = 0; a < 3; ++a)
+                next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+
+            auto length = std::max(std::max(std::abs(next[0]), std::abs(next[1])), std::abs(next[2]));
+            if (length == 0.0f)
+                break;
+
+            for (auto a = 0; a < 3; ++a)
+                axis[a] = next[a] / length;
+        }
+
+        auto minProjection = 0.0f;
+        auto maxProjection = 0.0f;
+        for (auto i = 0; i < 16; ++i)
+        {
+            auto projection = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+
+        // insetting the endpoints slightly reduces the error of the interpolated colors
+        auto axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        auto inset = (maxProjection - minProjection) / 16.0f;
+        float endpoints[2][3];
+        for (auto c = 0; c < 3; ++c)
+        {
+            auto scale = axisLengthSquared > 0.0f ? axis[c] / axisLengthSquared : 0.0f;
+            endpoints[0][c] = mean[c] + (maxProjection - inset) * scale;
+            endpoints[1][c] = mean[c] + (minProjection + inset) * scale;
+        }
+
+        auto color0 = packRgb565(endpoints[0]);
+        auto color1 = packRgb565(endpoints[1]);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (auto c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1)
+        {
+            for (auto i = 0; i < 16; ++i)
+            {
+                auto bestIndex = 0u;
+                auto bestDistance = 0x7fffffff;
+                for (auto p = 0u; p < 4; ++p)
+                {
+                    auto distance = 0;
+                    for (auto c = 0; c < 3; ++c)
+                        distance += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        bestIndex = p;
+                    }
+                }
+                indices |= bestIndex << (2 * i);
+            }
+        }
+
+        out[0] = color0 & 0xff;
+        out[1] = color0 >> 8;
+        out[2] = color1 & 0xff;
+        out[3] = color1 >> 8;
+        for (auto i = 0; i < 4; ++i)
+            out[4 + i] = (indices >> (8 * i)) & 0xff;
+    }
+
+    // single channel, endpoints at the extremes of the block, always in eight value mode
+    void encodeBC4(const Block & block, int channel, unsigned char * out)
+    {
+        int minValue = 255;
+        int maxValue = 0;
+        for (auto i = 0; i < 16; ++i)
+        {
+            minValue = std::min(minValue, static_cast<int>(block[i][channel]));
+            maxValue = std::max(maxValue, static_cast<int>(block[i][channel]));
+        }
+
+        int palette[8] = { maxValue, minValue };
+        for (auto p = 2; p < 8; ++p)
+            palette[p] = ((8 - p) * maxValue + (p - 1) * minValue) / 7;
+
+        uint64_t indices = 0;
+        if (maxValue != minValue)
+        {
+            for (auto i = 0; i < 16; ++i)
+            {
+                auto bestIndex = uint64_t(0);
+                auto bestDistance = 256;
+                for (auto p = 0; p < 8; ++p)
+                {
+                    auto distance = std::abs(block[i][channel] - palette[p]);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        bestIndex = static_cast<uint64_t>(p);
+                    }
+                }
+                indices |= bestIndex << (3 * i);
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(maxValue);
+        out[1] = static_cast<unsigned char>(minValue);
+        for (auto i = 0; i < 6; ++i)
+            out[2 + i] = (indices >> (8 * i)) & 0xff;
+    }
+
+    std::vector<unsigned char> compressLevel(BlockCompression format, int width, int height, const unsigned char * pixels)
+    {
+        std::vector<unsigned char> data(compressedSize(format, width, height));
+        auto out = data.data();
+
+        Block block;
+        for (auto blockY = 0; blockY < (height + 3) / 4; ++blockY)
+        {
+            for (auto blockX = 0; blockX < (width + 3) / 4; ++blockX)
+            {
+                fetchBlock(pixels, width, height, blockX, blockY, block);
+
+                switch (format)
+                {
+                case BlockCompression::BC1:
+                    encodeBC1(block, out);
+                    break;
+                case BlockCompression::BC3:
+                    encodeBC4(block, 3, out);
+                    encodeBC1(block, out + 8);
+                    break;
+                case BlockCompression::BC4:
+                    encodeBC4(block, 0, out);
+                    break;
+                case BlockCompression::BC5:
+                    encodeBC4(block, 0, out);
+                    encodeBC4(block, 1, out + 8);
+                    break;
+                }
+
+                out += blockBytes(format);
+            }
+        }
+
+        return data;
+    }
+
+    // 2x2 box filter, odd sizes repeat the last row or column
+    std::vector<unsigned char> downsample(const std::vector<unsigned char> & pixels, int width, int height)
+    {
+        auto targetWidth = std::max(width / 2, 1);
+        auto targetHeight = std::max(height / 2, 1);
+        std::vector<unsigned char> target(static_cast<size_t>(targetWidth) * targetHeight * 4);
+
+        for (auto y = 0; y < targetHeight; ++y)
+        {
+            auto y0 = std::min(2 * y, height - 1);
+            auto y1 = std::min(2 * y + 1, height - 1);
+            for (auto x = 0; x < targetWidth; ++x)
+            {
+                auto x0 = std::min(2 * x, width - 1);
+                auto x1 = std::min(2 * x + 1, width - 1);
+                for (auto c = 0; c < 4; ++c)
+                {
+                    auto sum = pixels[(static_cast<size_t>(y0) * width + x0) * 4 + c] + pixels[(static_cast<size_t>(y0) * width + x1) * 4 + c]
+                             + pixels[(static_cast<size_t>(y1) * width + x0) * 4 + c] + pixels[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                    target[(static_cast<size_t>(y) * targetWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+
+        return target;
+    }
+}
+
+
+uint32_t glInternalFormat(BlockCompression format)
+{
+    return s_internalFormats[static_cast<uint32_t>(format)];
+}
+
+const char * formatName(BlockCompression format)
+{
+    static const char * names[] = { "bc1", "bc3", "bc4", "bc5" };
+    return names[static_cast<uint32_t>(format)];
+}
+
+CompressedImage compressImage(BlockCompression format, int width, int height, const unsigned char * pixels)
+{
+    CompressedImage image{ format, width, height, {} };
+
+    auto levelWidth = width;
+    auto levelHeight = height;
+    auto levelPixels = std::vector<unsigned char>(pixels, pixels + static_cast<size_t>(width) * height * 4);
+
+    for (auto level = 0; level < mipLevelCount(width, height); ++level)
+    {
+        if (level > 0)
+        {
+            levelPixels = downsample(levelPixels, levelWidth, levelHeight);
+            levelWidth = std::max(levelWidth / 2, 1);
+            levelHeight = std::max(levelHeight / 2, 1);
+        }
+
+        image.levels.push_back(compressLevel(format, levelWidth, levelHeight, levelPixels.data()));
+    }
+
+    return image;
+}
+
+CompressedImage neutralImage(BlockCompression format)
+{
+    std::vector<unsigned char> pixels(4 * 4 * 4, 128);
+    for (auto i = size_t(3); i < pixels.size(); i += 4)
+        pixels[i] = 255;
+
+    return compressImage(format, 4, 4, pixels.data());
+}
+
+bool readKtx(const std::string & filename, BlockCompression format, CompressedImage & image)
+{
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream)
+        return false;
+
+    std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(KtxHeader))
+        return false;
+
+    KtxHeader header;
+    std::memcpy(&header, data.data(), sizeof(KtxHeader));
+
+    auto width = static_cast<int>(header.pixelWidth);
+    auto height = static_cast<int>(header.pixelHeight);
+    if (std::memcmp(header.identifier, s_ktxIdentifier, sizeof(s_ktxIdentifier)) != 0 || header.endianness != s_ktxEndianness
+        || header.glInternalFormat != glInternalFormat(format) || header.numberOfFaces != 1 || width <= 0 || height <= 0
+        || header.numberOfMipmapLevels != static_cast<uint32_t>(mipLevelCount(width, height)))
+        return false;
+
+    auto offset = sizeof(KtxHeader);
+    auto keyValueEnd = offset + header.bytesOfKeyValueData;
+    if (keyValueEnd > data.size())
+        return false;
+
+    auto versionMatches = false;
+    while (offset + sizeof(uint32_t) <= keyValueEnd)
+    {
+        uint32_t keyAndValueByteSize;
+        std::memcpy(&keyAndValueByteSize, data.data() + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        if (offset + keyAndValueByteSize > keyValueEnd)
+            return false;
+
+        auto keyAndValue = std::string(data.data() + offset, keyAndValueByteSize);
+        if (keyAndValue == std::string(s_versionKey, sizeof(s_versionKey)) + std::string(s_version, sizeof(s_version)))
+            versionMatches = true;
+
+        offset += padded(keyAndValueByteSize);
+    }
+
+    if (!versionMatches)
+        return false;
+
+    image = CompressedImage{ format, width, height, {} };
+    offset = keyValueEnd;
+    for (auto level = 0u; level < header.numberOfMipmapLevels; ++level)
+    {
+        uint32_t imageSize;
+        if (offset + sizeof(uint32_t) > data.size())
+            return false;
+        std::memcpy(&imageSize, data.data() + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+
+        auto levelWidth = std::max(width >> level, 1);
+        auto levelHeight = std::max(height >> level, 1);
+        if (imageSize != compressedSize(format, levelWidth, levelHeight) || offset + imageSize > data.size())
+            return false;
+
+        image.levels.emplace_back(data.data() + offset, data.data() + offset + imageSize);
+        offset += padded(imageSize);
+    }
+
+    return true;
+}
+
+bool writeKtx(const std::string & filename, const CompressedImage & image)
+{
+    auto keyAndValue = std::string(s_versionKey, sizeof(s_versionKey)) + std::string(s_version, sizeof(s_version));
+    auto keyAndValueByteSize = static_cast<uint32_t>(keyAndValue.size());
+
+    KtxHeader header;
+    std::memcpy(header.identifier, s_ktxIdentifier, sizeof(s_ktxIdentifier));
+    header.endianness = s_ktxEndianness;
+    header.glType = 0;
+    header.glTypeSize = 1;
+    header.glFormat = 0;
+    header.glInternalFormat = glInternalFormat(image.format);
+    header.glBaseInternalFormat = s_baseInternalFormats[static_cast<uint32_t>(image.format)];
+    header.pixelWidth = static_cast<uint32_t>(image.width);
+    header.pixelHeight = static_cast<uint32_t>(image.height);
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = 0;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = static_cast<uint32_t>(image.levels.size());
+    header.bytesOfKeyValueData = static_cast<uint32_t>(sizeof(uint32_t) + padded(keyAndValueByteSize));
+
+    const char padding[4] = {};
+
+    return writeFileAtomically(filename, [&](std::ostream & stream) {
+        stream.write(reinterpret_cast<const char *>(&header), sizeof(KtxHeader));
+        stream.write(reinterpret_cast<const char *>(&keyAndValueByteSize), sizeof(uint32_t));
+        stream.write(keyAndValue.data(), keyAndValue.size());
+        stream.write(padding, padded(keyAndValueByteSize) - keyAndValueByteSize);
+
+        for (const auto & level : image.levels)
+        {
+            auto imageSize = static_cast<uint32_t>(level.size());
+            stream.write(reinterpret_cast<const char *>(&imageSize), sizeof(uint32_t));
+            stream.write(reinterpret_cast<const char *>(level.data()), level.size());
+            stream.write(padding, padded(imageSize) - imageSize);
+        }
+    });
+}
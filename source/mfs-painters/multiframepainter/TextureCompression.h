@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+enum class BlockCompression : uint32_t
+{
+    BC1, // rgb
+    BC3, // rgba
+    BC4, // r
+    BC5  // rg
+};
+
+// block compressed image with the complete mip chain, level 0 first
+struct CompressedImage
+{
+    BlockCompression format;
+    int width;
+    int height;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+// the OpenGL internal format, as stored in KTX files
+uint32_t glInternalFormat(BlockCompression format);
+// lower case, e.g. "bc1"
+const char * formatName(BlockCompression format);
+
+// computes the mip chain with a box filter and compresses every level, pixels are tightly packed RGBA8
+CompressedImage compressImage(BlockCompression format, int width, int height, const unsigned char * pixels);
+
+// a single block of opaque mid gray, which model.frag reads as a neutral value for every texture type:
+// a gray surface, weak specular, flat bump and normal maps and no cutouts
+CompressedImage neutralImage(BlockCompression format);
+
+// KTX 1.1 files with a version key, files written by other tools or older versions of the encoder are rejected
+bool readKtx(const std::string & filename, BlockCompression format, CompressedImage & image);
+bool writeKtx(const std::string & filename, const CompressedImage & image);
@@ -0,0 +1,215 @@
+#include "TextureLoader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/bitfield.h>
+
+#include <globjects/Buffer.h>
+#include <globjects/Sync.h>
+#include <globjects/Texture.h>
+
+#include <QImage>
+#include <QString>
+
+using namespace gl;
+
+
+namespace
+{
+    // large enough for a couple of compressed 4k textures in flight, bigger levels are uploaded from client memory
+    const size_t s_stagingBufferSize = 64 * 1024 * 1024;
+
+    // thread-safe, does not touch the GL. pixels are RGBA8, rows bottom up
+    bool decodeImage(const std::string & filename, int & width, int & height, std::vector<unsigned char> & pixels)
+    {
+        QImage qImage;
+        if (!qImage.load(QString::fromStdString(filename)))
+            return false;
+
+        // same layout as the resource manager's texture loader produces
+        qImage = qImage.convertToFormat(QImage::Format_RGBA8888).mirrored();
+
+        width = qImage.width();
+        height = qImage.height();
+        pixels.assign(qImage.constBits(), qImage.constBits() + qImage.bytesPerLine() * qImage.height());
+        return true;
+    }
+
+    bool modificationTime(const std::string & filename, int64_t & time)
+    {
+        struct stat fileStat;
+        if (stat(filename.c_str(), &fileStat) != 0)
+            return false;
+
+        time = static_cast<int64_t>(fileStat.st_mtime);
+        return true;
+    }
+
+    bool cacheUpToDate(const std::string & filename, const std::string & cacheFilename)
+    {
+        int64_t sourceTime;
+        int64_t cacheTime;
+        return modificationTime(filename, sourceTime) && modificationTime(cacheFilename, cacheTime) && cacheTime >= sourceTime;
+    }
+
+    bool loadImage(const std::string & filename, BlockCompression format, CompressedImage & image)
+    {
+        // each format has its own file, readKtx() rejects the others
+        auto cacheFilename = filename + "." + formatName(format) + ".ktx";
+        if (cacheUpToDate(filename, cacheFilename) && readKtx(cacheFilename, format, image))
+            return true;
+
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+        if (!decodeImage(filename, width, height, pixels))
+            return false;
+
+        image = compressImage(format, width, height, pixels.data());
+
+        // the cache directory may be read-only, the texture is still usable then
+        writeKtx(cacheFilename, image);
+        return true;
+    }
+}
+
+
+TextureLoader::Preparation::Preparation(std::vector<Key> requests)
+: m_requests(std::move(requests))
+, m_nextIndex(0)
+, m_preparedCount(0)
+{
+    auto threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), m_requests.size());
+    for (auto i = 0u; i < threadCount; ++i)
+        m_workers.emplace_back(&Preparation::prepare, this);
+}
+
+TextureLoader::Preparation::~Preparation()
+{
+    m_nextIndex = m_requests.size();
+
+    for (auto & worker : m_workers)
+        worker.join();
+}
+
+bool TextureLoader::Preparation::take(PreparedTextures & textures)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto & prepared : m_prepared)
+        textures[prepared.first] = std::move(prepared.second);
+    m_prepared.clear();
+
+    return m_preparedCount == m_requests.size();
+}
+
+void TextureLoader::Preparation::wait()
+{
+    for (auto & worker : m_workers)
+        worker.join();
+
+    m_workers.clear();
+}
+
+void TextureLoader::Preparation::prepare()
+{
+    for (auto index = m_nextIndex++; index < m_requests.size(); index = m_nextIndex++)
+    {
+        const auto & request = m_requests[index];
+
+        PreparedTexture texture;
+        texture.valid = loadImage(request.first, request.second, texture.image);
+        if (!texture.valid)
+            texture.image = neutralImage(request.second);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_prepared[request] = std::move(texture);
+        ++m_preparedCount;
+    }
+}
+
+
+TextureLoader::TextureLoader()
+: m_stagingData(nullptr)
+, m_stagingHead(0)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+    if (m_stagingBuffer)
+        m_stagingBuffer->unmap();
+}
+
+void TextureLoader::initializeStagingBuffer()
+{
+    auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    m_stagingBuffer = new globjects::Buffer();
+    m_stagingBuffer->setStorage(s_stagingBufferSize, nullptr, flags);
+    m_stagingData = static_cast<unsigned char *>(m_stagingBuffer->mapRange(0, s_stagingBufferSize, flags));
+}
+
+globjects::ref_ptr<globjects::Texture> TextureLoader::upload(const CompressedImage & image, size_t baseLevel)
+{
+    if (!m_stagingBuffer)
+        initializeStagingBuffer();
+
+    auto texture = globjects::Texture::createDefault(GL_TEXTURE_2D);
+    auto internalFormat = static_cast<GLenum>(glInternalFormat(image.format));
+
+    for (auto level = 0; baseLevel + level < image.levels.size(); ++level)
+    {
+        auto imageLevel = static_cast<int>(baseLevel) + level;
+        const auto & data = image.levels[imageLevel];
+        auto width = std::max(image.width >> imageLevel, 1);
+        auto height = std::max(image.height >> imageLevel, 1);
+        auto size = static_cast<GLsizei>(data.size());
+
+        if (!m_stagingData || data.size() > s_stagingBufferSize)
+        {
+            texture->compressedImage2D(level, internalFormat, width, height, 0, size, data.data());
+            continue;
+        }
+
+        auto offset = allocate(data.size());
+        std::memcpy(m_stagingData + offset, data.data(), data.size());
+
+        // the data pointer is an offset into the bound pixel buffer, the copy happens asynchronously
+        m_stagingBuffer->bind(GL_PIXEL_UNPACK_BUFFER);
+        texture->compressedImage2D(level, internalFormat, width, height, 0, size, reinterpret_cast<const void *>(offset));
+        globjects::Buffer::unbind(GL_PIXEL_UNPACK_BUFFER);
+
+        m_pendingUploads.push_back({ offset, offset + data.size(), globjects::Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE) });
+    }
+
+    return texture;
+}
+
+size_t TextureLoader::allocate(size_t size)
+{
+    if (m_stagingHead + size > s_stagingBufferSize)
+        m_stagingHead = 0;
+
+    auto begin = m_stagingHead;
+    auto end = begin + size;
+    auto overlaps = [begin, end](const PendingUpload & upload) {
+        return upload.begin < end && begin < upload.end;
+    };
+
+    // fences signal in order, so waiting for the oldest uploads first never waits longer than necessary
+    while (std::any_of(m_pendingUploads.begin(), m_pendingUploads.end(), overlaps))
+    {
+        m_pendingUploads.front().fence->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        m_pendingUploads.pop_front();
+    }
+
+    m_stagingHead = end;
+
+    return begin;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <globjects/base/ref_ptr.h>
+
+#include "TextureCompression.h"
+
+namespace globjects
+{
+    class Buffer;
+    class Sync;
+    class Texture;
+}
+
+
+// Loads textures in batches. A Preparation reads block compressed versions from a KTX file next to each image
+// on a pool of worker threads, or decodes and compresses the image and writes that file. upload() copies
+// them into a persistently mapped pixel buffer on the GL thread and issues the uploads from there, which
+// may already start while the rest of the batch is still being prepared.
+// Images are decoded with QImage. Textures that can't be read or decoded, e.g. missing or corrupt files,
+// are replaced by neutralImage(), the GL thread never loads textures itself.
+class TextureLoader
+{
+public:
+    struct PreparedTexture
+    {
+        // false if image is the neutral replacement
+        bool valid;
+        CompressedImage image;
+    };
+    // an image file is loaded once per format it is used with, e.g. as diffuse and as bump map
+    using Key = std::pair<std::string, BlockCompression>;
+    using PreparedTextures = std::map<Key, PreparedTexture>;
+    using Textures = std::map<Key, globjects::ref_ptr<globjects::Texture>>;
+
+    // does not touch the GL, may be created and used from any thread
+    class Preparation
+    {
+    public:
+        explicit Preparation(std::vector<Key> requests);
+        // stops after the textures that are being prepared, the others are dropped
+        ~Preparation();
+
+        // moves the textures prepared since the last call into textures, returns whether all are prepared
+        bool take(PreparedTextures & textures);
+        // blocks until all textures are prepared
+        void wait();
+
+    protected:
+        void prepare();
+
+        std::vector<Key> m_requests;
+        std::atomic<size_t> m_nextIndex;
+
+        std::mutex m_mutex;
+        PreparedTextures m_prepared;
+        size_t m_preparedCount;
+
+        std::vector<std::thread> m_workers;
+    };
+
+    TextureLoader();
+    ~TextureLoader();
+
+    // a texture with the image's levels from baseLevel on, which becomes its level 0
+    globjects::ref_ptr<globjects::Texture> upload(const CompressedImage & image, size_t baseLevel = 0);
+
+protected:
+    struct PendingUpload
+    {
+        size_t begin;
+        size_t end;
+        globjects::ref_ptr<globjects::Sync> fence;
+    };
+
+    void initializeStagingBuffer();
+
+    // waits until the GPU has consumed all uploads that overlap the returned range
+    size_t allocate(size_t size);
+
+    globjects::ref_ptr<globjects::Buffer> m_stagingBuffer;
+    unsigned char * m_stagingData;
+    size_t m_stagingHead;
+    std::deque<PendingUpload> m_pendingUploads;
+};
@@ -0,0 +1,385 @@
+#include "TextureStreaming.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/bitfield.h>
+#include <glbinding/gl/functions.h>
+
+#include <globjects/Buffer.h>
+#include <globjects/Texture.h>
+
+#include "MaterialTable.h"
+#include "TextureLoader.h"
+
+using namespace gl;
+
+
+namespace
+{
+    // the levels up to this size are uploaded with the scene and never evicted
+    const int s_tailSize = 128;
+
+    // frames between writing and reading a feedback buffer, the GPU is usually done with them by then
+    const size_t s_feedbackLatency = 3;
+
+    // limits the upload stalls when many textures come into view at once
+    const size_t s_maxUploadPerUpdate = 16 * 1024 * 1024;
+
+    // the initial value of each feedback entry, has to be larger than any level
+    const GLuint s_noRequest = 0xFFFFFFFF;
+
+    // the pixels of an 8x8 block, each writes the feedback of one frame
+    const uint64_t s_allOffsets = ~uint64_t(0);
+
+    // a level is only dropped after this many rotations, about two seconds at 60 frames per second, so textures at
+    // the edge of a level aren't uploaded and evicted over and over
+    const int s_demotionRotations = 2;
+}
+
+
+TextureStreaming::TextureStreaming(TextureLoader & loader, std::function<void(globjects::Texture *)> setupTexture, size_t budget)
+: m_loader(loader)
+, m_setupTexture(setupTexture)
+, m_currentSlot(0)
+, m_frame(0)
+, m_rotationOffsets(0)
+, m_budget(budget)
+, m_residentSize(0)
+{
+}
+
+TextureStreaming::~TextureStreaming()
+{
+    for (const auto & slot : m_feedback)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+    }
+}
+
+globjects::ref_ptr<globjects::Texture> TextureStreaming::add(CompressedImage image)
+{
+    auto tailLevel = 0;
+    while (tailLevel + 1 < static_cast<int>(image.levels.size()) && std::max(image.width >> tailLevel, image.height >> tailLevel) > s_tailSize)
+        ++tailLevel;
+
+    auto tail = m_loader.upload(image, tailLevel);
+    m_setupTexture(tail);
+
+    StreamedTexture texture{ std::move(image), tailLevel, tailLevel, tailLevel, 0, 0, tail, tail };
+    m_residentSize += levelsSize(texture, tailLevel);
+
+    m_indices[tail.get()] = static_cast<GLuint>(m_textures.size());
+    m_textures.push_back(std::move(texture));
+
+    // recreated with the next update
+    m_sizes = nullptr;
+
+    return tail;
+}
+
+GLuint TextureStreaming::index(const globjects::Texture * texture) const
+{
+    auto index = m_indices.find(texture);
+    return index != m_indices.end() ? index->second : NotStreamed;
+}
+
+size_t TextureStreaming::budget() const
+{
+    return m_budget;
+}
+
+void TextureStreaming::setBudget(size_t budget)
+{
+    m_budget = budget;
+}
+
+size_t TextureStreaming::residentSize() const
+{
+    return m_residentSize;
+}
+
+void TextureStreaming::bind(GLuint sizeBinding, GLuint feedbackBinding) const
+{
+    if (!m_sizes)
+        return;
+
+    m_sizes->bindBase(GL_SHADER_STORAGE_BUFFER, sizeBinding);
+    m_feedback[m_currentSlot].buffer->bindBase(GL_SHADER_STORAGE_BUFFER, feedbackBinding);
+}
+
+GLuint TextureStreaming::feedbackOffset() const
+{
+    // a stride coprime to 64 visits every pixel of the block
+    return static_cast<GLuint>((m_frame * 23) % 64);
+}
+
+bool TextureStreaming::update(MaterialTable & materialTable)
+{
+    if (m_textures.empty())
+        return false;
+
+    ++m_frame;
+
+    if (!m_sizes)
+    {
+        createBuffers();
+    }
+    else
+    {
+        // the frames since the last update wrote into the current slot
+        m_feedback[m_currentSlot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+        m_currentSlot = (m_currentSlot + 1) % m_feedback.size();
+    }
+
+    // the oldest slot is reused for the next frame, so its feedback is read first. if the GPU is still
+    // not done with it, its feedback is dropped instead of waiting, the rotation completes with a later frame
+    auto & slot = m_feedback[m_currentSlot];
+    if (slot.fence)
+    {
+        auto status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            readFeedback(slot);
+
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+    slot.buffer->clearData(GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &s_noRequest);
+    slot.offset = feedbackOffset();
+
+    if (m_rotationOffsets == s_allOffsets)
+        completeRotation();
+
+    while (!m_retired.empty() && m_retired.front().frame + s_feedbackLatency <= m_frame)
+    {
+        materialTable.releaseTexture(m_retired.front().texture.get());
+        m_residentSize -= m_retired.front().size;
+        m_retired.pop_front();
+    }
+
+    return stream(materialTable);
+}
+
+void TextureStreaming::createBuffers()
+{
+    std::vector<GLuint> sizes;
+    sizes.reserve(2 * m_textures.size());
+    for (const auto & texture : m_textures)
+    {
+        sizes.push_back(static_cast<GLuint>(texture.image.width));
+        sizes.push_back(static_cast<GLuint>(texture.image.height));
+    }
+
+    m_sizes = new globjects::Buffer();
+    m_sizes->setName("Streamed Texture Sizes");
+    m_sizes->setStorage(sizes.size() * sizeof(GLuint), sizes.data(), GL_NONE_BIT);
+
+    m_feedback.resize(s_feedbackLatency);
+    for (auto & slot : m_feedback)
+    {
+        slot.buffer = new globjects::Buffer();
+        slot.buffer->setName("Texture Feedback");
+        slot.buffer->setStorage(m_textures.size() * sizeof(GLuint), nullptr, GL_CLIENT_STORAGE_BIT);
+
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+    m_currentSlot = 0;
+
+    m_rotationRequests.assign(m_textures.size(), s_noRequest);
+    m_rotationOffsets = 0;
+
+    m_requests.resize(m_textures.size());
+    m_candidates.reserve(m_textures.size());
+}
+
+void TextureStreaming::readFeedback(const FeedbackSlot & slot)
+{
+    slot.buffer->getSubData(0, m_requests.size() * sizeof(GLuint), m_requests.data());
+
+    for (auto i = 0u; i < m_textures.size(); ++i)
+    {
+        if (m_requests[i] == s_noRequest)
+            continue;
+
+        m_rotationRequests[i] = std::min(m_rotationRequests[i], m_requests[i]);
+
+        // a single pixel needing a finer level is enough, the rest of the rotation can only need even finer ones
+        auto & texture = m_textures[i];
+        texture.requestedLevel = std::min(static_cast<int>(m_requests[i]), texture.requestedLevel);
+        texture.lastRequest = m_frame;
+    }
+
+    m_rotationOffsets |= uint64_t(1) << slot.offset;
+}
+
+void TextureStreaming::completeRotation()
+{
+    for (auto i = 0u; i < m_textures.size(); ++i)
+    {
+        // textures that weren't sampled keep their level until they are evicted for the least recent request
+        auto & texture = m_textures[i];
+        if (m_rotationRequests[i] == s_noRequest)
+            continue;
+
+        auto level = std::min(static_cast<int>(m_rotationRequests[i]), texture.tailLevel);
+        if (level <= texture.requestedLevel)
+        {
+            texture.coarserRotations = 0;
+            continue;
+        }
+
+        if (++texture.coarserRotations >= s_demotionRotations)
+        {
+            texture.requestedLevel = level;
+            texture.coarserRotations = 0;
+        }
+    }
+
+    std::fill(m_rotationRequests.begin(), m_rotationRequests.end(), s_noRequest);
+    m_rotationOffsets = 0;
+}
+
+bool TextureStreaming::stream(MaterialTable & materialTable)
+{
+    m_candidates.clear();
+    for (auto i = 0u; i < m_textures.size(); ++i)
+    {
+        if (m_textures[i].requestedLevel < m_textures[i].residentLevel)
+            m_candidates.push_back(i);
+    }
+
+    // most recently requested first, the finest requests first among equally recent ones
+    std::sort(m_candidates.begin(), m_candidates.end(), [this](size_t a, size_t b) {
+        const auto & textureA = m_textures[a];
+        const auto & textureB = m_textures[b];
+        if (textureA.lastRequest != textureB.lastRequest)
+            return textureA.lastRequest > textureB.lastRequest;
+
+        return textureA.requestedLevel < textureB.requestedLevel;
+    });
+
+    auto changed = false;
+    size_t uploaded = 0;
+    for (auto candidate : m_candidates)
+    {
+        auto & texture = m_textures[candidate];
+
+        // the resident levels stay allocated next to the new ones for a few frames, and so do evicted textures.
+        // their memory is only available once update() releases them
+        size_t evicted = 0;
+
+        // coarser levels than requested are better than none
+        auto level = texture.requestedLevel;
+        while (level < texture.residentLevel && m_residentSize - evicted + levelsSize(texture, level) > m_budget)
+        {
+            auto size = evict(texture, materialTable);
+            if (size > 0)
+            {
+                evicted += size;
+                changed = true;
+            }
+            else
+            {
+                ++level;
+            }
+        }
+
+        if (level >= texture.residentLevel)
+            continue;
+
+        // uploaded with a later update, after the evicted textures have been released
+        if (m_residentSize + levelsSize(texture, level) > m_budget)
+            break;
+
+        setResidentLevel(texture, level, materialTable);
+        changed = true;
+
+        uploaded += levelsSize(texture, level);
+        if (uploaded >= s_maxUploadPerUpdate)
+            break;
+    }
+
+    return changed;
+}
+
+size_t TextureStreaming::evict(const StreamedTexture & requesting, MaterialTable & materialTable)
+{
+    StreamedTexture * victim = nullptr;
+    auto victimLevel = 0;
+
+    // levels finer than requested are dropped first, regardless of how recently the texture has been requested
+    for (auto & texture : m_textures)
+    {
+        if (&texture != &requesting && texture.residentLevel < texture.requestedLevel)
+        {
+            victim = &texture;
+            victimLevel = texture.requestedLevel;
+
+            // the requested levels are a new texture, dropped to the tail if they don't fit next to the old one
+            if (victimLevel < texture.tailLevel && m_residentSize + levelsSize(texture, victimLevel) > m_budget)
+                victimLevel = texture.tailLevel;
+            break;
+        }
+    }
+
+    if (!victim)
+    {
+        for (auto & texture : m_textures)
+        {
+            if (texture.residentLevel == texture.tailLevel || texture.lastRequest >= requesting.lastRequest)
+                continue;
+
+            if (!victim || texture.lastRequest < victim->lastRequest)
+            {
+                victim = &texture;
+                victimLevel = texture.tailLevel;
+            }
+        }
+    }
+
+    if (!victim)
+        return 0;
+
+    // victims always have a texture finer than their tail, which is retired
+    auto size = levelsSize(*victim, victim->residentLevel);
+    setResidentLevel(*victim, victimLevel, materialTable);
+    return size;
+}
+
+void TextureStreaming::setResidentLevel(StreamedTexture & texture, int level, MaterialTable & materialTable)
+{
+    auto previous = texture.texture;
+
+    if (level == texture.tailLevel)
+    {
+        texture.texture = texture.tail;
+    }
+    else
+    {
+        texture.texture = m_loader.upload(texture.image, static_cast<size_t>(level));
+        m_setupTexture(texture.texture);
+    }
+
+    // the previous texture stays counted until it is released
+    if (level < texture.tailLevel)
+        m_residentSize += levelsSize(texture, level);
+
+    materialTable.replaceTexture(previous.get(), texture.texture.get());
+    if (previous != texture.tail)
+        m_retired.push_back({ previous, m_frame, levelsSize(texture, texture.residentLevel) });
+
+    texture.residentLevel = level;
+}
+
+size_t TextureStreaming::levelsSize(const StreamedTexture & texture, int level)
+{
+    size_t size = 0;
+    for (auto i = static_cast<size_t>(level); i < texture.image.levels.size(); ++i)
+        size += texture.image.levels[i].size();
+
+    return size;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include <glbinding/gl/types.h>
+
+#include <globjects/base/ref_ptr.h>
+
+#include "TextureCompression.h"
+
+namespace globjects
+{
+    class Buffer;
+    class Texture;
+}
+
+class MaterialTable;
+class TextureLoader;
+
+
+// Keeps the compressed images of a scene's textures in client memory and only their coarsest levels on the GPU.
+// The texture feedback pass writes the finest level each streamed texture is sampled at into a feedback buffer,
+// for one pixel of each 8x8 block per frame. The buffer is read back a few frames later, so the read never stalls.
+// Finer levels are requested as soon as any pixel needs them, coarser ones only after a full rotation over the
+// block's pixels has not needed the finer ones for a while. The requested levels are then uploaded, most recently
+// requested textures first, and textures that have not been requested for the longest time are evicted back
+// to their coarse levels to stay within the budget. A streamed texture is a new texture with fewer levels,
+// swapped into the material table, sparse textures would avoid the copies but are not widely supported.
+class TextureStreaming
+{
+public:
+    // has to match texture_feedback.frag
+    static const gl::GLuint NotStreamed = 0xFFFFFFFF;
+
+    TextureStreaming(TextureLoader & loader, std::function<void(globjects::Texture *)> setupTexture, size_t budget);
+    ~TextureStreaming();
+
+    // uploads the image's coarsest levels, finer ones are streamed in once the returned texture is sampled from them
+    globjects::ref_ptr<globjects::Texture> add(CompressedImage image);
+    // the feedback index of a texture returned by add(), NotStreamed for other textures
+    gl::GLuint index(const globjects::Texture * texture) const;
+
+    // in bytes, including the tails that are always resident and the replaced textures that are not released yet
+    size_t budget() const;
+    void setBudget(size_t budget);
+    size_t residentSize() const;
+
+    // binds the full size of each texture and the current frame's feedback buffer
+    void bind(gl::GLuint sizeBinding, gl::GLuint feedbackBinding) const;
+    // the pixel of each 8x8 block that writes feedback this frame
+    gl::GLuint feedbackOffset() const;
+
+    // call once per frame: reads back the feedback of an earlier frame, then uploads or evicts levels
+    // accordingly. returns whether any texture of the material table has been replaced
+    bool update(MaterialTable & materialTable);
+
+protected:
+    struct StreamedTexture
+    {
+        CompressedImage image;
+        // the first level of the coarse levels that are always resident
+        int tailLevel;
+        int residentLevel;
+        int requestedLevel;
+        uint64_t lastRequest;
+        // consecutive feedback rotations that requested a coarser level than requestedLevel
+        int coarserRotations;
+        globjects::ref_ptr<globjects::Texture> tail;
+        // the tail or a texture with the levels from residentLevel on
+        globjects::ref_ptr<globjects::Texture> texture;
+    };
+
+    struct FeedbackSlot
+    {
+        globjects::ref_ptr<globjects::Buffer> buffer;
+        // null until the frames writing the buffer have been submitted
+        gl::GLsync fence;
+        gl::GLuint offset;
+    };
+
+    struct RetiredTexture
+    {
+        globjects::ref_ptr<globjects::Texture> texture;
+        uint64_t frame;
+        size_t size;
+    };
+
+    void createBuffers();
+    void readFeedback(const FeedbackSlot & slot);
+    // the levels requested by all pixels of the 8x8 blocks
+    void completeRotation();
+    bool stream(MaterialTable & materialTable);
+    // frees memory by dropping unrequested levels or the least recently requested texture. returns the size of the
+    // retired texture, which is only released a few frames later, 0 if there is nothing to evict
+    size_t evict(const StreamedTexture & requesting, MaterialTable & materialTable);
+    void setResidentLevel(StreamedTexture & texture, int level, MaterialTable & materialTable);
+    // the size of the levels from level on
+    static size_t levelsSize(const StreamedTexture & texture, int level);
+
+    TextureLoader & m_loader;
+    std::function<void(globjects::Texture *)> m_setupTexture;
+
+    std::vector<StreamedTexture> m_textures;
+    std::map<const globjects::Texture *, gl::GLuint> m_indices;
+
+    globjects::ref_ptr<globjects::Buffer> m_sizes;
+    std::vector<FeedbackSlot> m_feedback;
+    size_t m_currentSlot;
+    uint64_t m_frame;
+
+    // replaced textures stay resident until no frame in flight may sample them
+    std::deque<RetiredTexture> m_retired;
+
+    size_t m_budget;
+    size_t m_residentSize;
+
+    // the finest level requested by each texture during the current rotation, and the offsets read in it
+    std::vector<gl::GLuint> m_rotationRequests;
+    uint64_t m_rotationOffsets;
+
+    // reused between frames
+    std::vector<gl::GLuint> m_requests;
+    std::vector<size_t> m_candidates;
+};
@@ -12,6 +12,7 @@
 #include <globjects/Program.h>
 #include <globjects/Buffer.h>
 #include <globjects/Shader.h>
+#include <globjects/Uniform.h>
 
 #include <gloperate/painter/AbstractCameraCapability.h>
 #include <gloperate/painter/AbstractProjectionCapability.h>
@@ -47,6 +48,10 @@ VPLProcessor::VPLProcessor()
     m_program->attach(
         globjects::Shader::fromFile(GL_COMPUTE_SHADER, "data/shaders/gi/vpl_processor.comp")
     );
+    m_program->setUniform("rsmDiffuseSampler", 0);
+    m_program->setUniform("rsmNormalSampler", 1);
+    m_program->setUniform("rsmDepthSampler", 2);
+    m_inverseTransformUniform = m_program->getUniform<glm::mat4>("biasedLightViewProjectionInverseMatrix");
 
     vplBuffer = new globjects::Buffer();
     vplBuffer->setData(sizeof(vpl) * maxVPLCount, nullptr, GL_STATIC_DRAW);
@@ -70,7 +75,7 @@ VPLProcessor::~VPLProcessor()
 
 }
 
-void VPLProcessor::process(const RasterizationStage& rsmRenderer, float lightIntensity, bool shuffleLights)
+void VPLProcessor::process(const RasterizationStage& rsmRenderer, float lightIntensity, bool shuffleLights, const glm::vec2& samplingOffset)
 {
 
     auto shadowBias = glm::mat4(
@@ -85,12 +90,10 @@ void VPLProcessor::process(const RasterizationStage& rsmRenderer, float lightInt
     rsmRenderer.faceNormalBuffer->bindActive(1);
     rsmRenderer.depthBuffer->bindActive(2);
 
-    m_program->setUniform("rsmDiffuseSampler", 0);
-    m_program->setUniform("rsmNormalSampler", 1);
-    m_program->setUniform("rsmDepthSampler", 2);
-    m_program->setUniform("biasedLightViewProjectionInverseMatrix", glm::inverse(biasedShadowTransform));
+    m_inverseTransformUniform->set(glm::inverse(biasedShadowTransform));
     m_program->setUniform("lightIntensity", lightIntensity);
     m_program->setUniform("shuffleLights", shuffleLights);
+    m_program->setUniform("samplingOffset", samplingOffset);
 
     vplBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
     packedVplBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
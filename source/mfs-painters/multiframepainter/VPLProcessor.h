@@ -1,5 +1,6 @@
 #pragma once
 
+#include <glm/vec2.hpp>
 #include <glm/mat4x4.hpp>
 
 #include <globjects/base/ref_ptr.h>
@@ -8,6 +9,7 @@ namespace globjects
 {
     class Buffer;
     class Program;
+    template <typename T> class Uniform;
 }
 
 class RasterizationStage;
@@ -19,7 +21,8 @@ public:
     VPLProcessor();
     ~VPLProcessor();
 
-    void process(const RasterizationStage& rsmRenderer, float lightIntensity, bool shuffleLights);
+    // samplingOffset moves the RSM samples within their grid cells, in [0, 1]
+    void process(const RasterizationStage& rsmRenderer, float lightIntensity, bool shuffleLights, const glm::vec2& samplingOffset);
 
     globjects::ref_ptr<globjects::Buffer> vplBuffer;
     globjects::ref_ptr<globjects::Buffer> packedVplBuffer;
@@ -27,5 +30,7 @@ public:
 
 private:
     globjects::ref_ptr<globjects::Program> m_program;
+    // the only per frame uniform whose name does not fit into a small string
+    globjects::Uniform<glm::mat4> * m_inverseTransformUniform;
     globjects::ref_ptr<globjects::Buffer> m_shuffledIndicesBuffer;
 };
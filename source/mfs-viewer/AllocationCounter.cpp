@@ -0,0 +1,82 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// The replacements of the global operator new and delete, only built with OPTION_TRACK_ALLOCATIONS. They have to
+// be defined in the executable: the dynamic linker resolves the painters' and all other libraries' calls to them
+// from here, while a definition in the painter plugin would only be used by the plugin itself, if at all.
+// AllocationTracker in the painters looks up the exported count at runtime.
+
+
+namespace
+{
+    std::atomic<uint64_t> s_allocationCount(0);
+}
+
+
+#ifdef _WIN32
+extern "C" __declspec(dllexport) uint64_t mfsAllocationCount()
+#else
+extern "C" __attribute__((visibility("default"))) uint64_t mfsAllocationCount()
+#endif
+{
+    return s_allocationCount.load(std::memory_order_relaxed);
+}
+
+
+void * operator new(std::size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (auto pointer = std::malloc(size > 0 ? size : 1))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t & tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, const std::nothrow_t &) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer, const std::nothrow_t &) noexcept
+{
+    std::free(pointer);
+}